@@ -2,19 +2,65 @@
 
 #include "Application.hpp"
 #include "HexEditor.hpp"
+#include "TerminalRenderer.hpp"
+#include "Compare.hpp"
+#include "PerceptualHash.hpp"
+#include "Parallel.hpp"
+#include "Pyramid.hpp"
+#include "RangeEdit.hpp"
+#include "Composite.hpp"
+#include "Morphology.hpp"
+#include "Median.hpp"
+#include "Atlas.hpp"
+
+// -----------------------------------------------------------------------------
+// Paths pasted from a file manager come quoted, every '"' goes
+static void StripQuotes(IN std::wstring& path)
+{
+    std::erase(path, L'"');
+}
 
 // -----------------------------------------------------------------------------
 void Application::Initialize()
 {
+#ifndef _WIN32
+    // glibc fixes the orientation of stdout on first use,
+    // unsynced streams let std::cout and std::wcout be mixed
+    std::ios_base::sync_with_stdio(false);
+#endif // _WIN32
+
     std::wcout << L"Availble commands\n\
         - 'q' to quit\n\
         - 'load' / 'l' to load a .bmp file from path\n\
         - 'save' / 's' to save a .bmp file in output dir ('./Output/FILE.bmp')\n\
         - 'color' to color whole image\n\
         - 'lookat' to view image in hex editor\n\
+        - 'replay' to apply a hex editor edit log ('./Output/FILE.bmp.edits') to image\n\
         - 'gray' to make image gray scale\n\
+        - 'luma' to make image gray scale with BT.709 weights\n\
+        - 'save8' to save image as 8-bit grayscale .bmp in output dir\n\
+        - 'savepal' to save image as 8-bit palettized .bmp in output dir\n\
+        - 'save4' to save image as 4-bit palettized .bmp in output dir\n\
+        - 'save1' to save image as 1-bit black and white .bmp in output dir\n\
         - 'prt' to print image to terminal\n\
-        - 'negative' to make image negative\n";
+        - 'prtc' to print image to terminal in 24-bit color\n\
+        - 'noise' to add gaussian grain\n\
+        - 'blur' to box blur image\n\
+        - 'edges' to detect edges of image\n\
+        - 'bw' to make image black and white by Otsu threshold\n\
+        - 'morph' to erode, dilate, open or close image with a square\n\
+        - 'median' to median filter image, removes salt and pepper noise\n\
+        - 'cmp' to compare image with a .bmp file from path\n\
+        - 'hash' to print perceptual hashes of image\n\
+        - 'dups' to find near duplicate .bmp files in a directory\n\
+        - 'atlas' to pack every .bmp of a directory into one atlas in output dir\n\
+        - 'thumbs' to save 256, 128 and 64 px wide thumbnails in output dir,\n\
+          optionally keeps the levels there to make them faster next time\n\
+        - 'negative' to make image negative\n\
+        - 'overlay' to blend a 24-bit or 32-bit .bmp over image\n\
+        Run with '--script FILE' ('-' for stdin) to run commands without prompts\n";
+
+    SWHexEditor::TerminalRenderer::EnableVirtualTerminal();
 
     FindPathToItself();
     CreateSaveDir();
@@ -60,12 +106,42 @@ void Application::Update()
         SaveFile();
         return;
     }
+    if (r == L"save8")
+    {
+        SWB_IS_BITMAP;
+        SaveFile(SWBitmaps::Gray8);
+        return;
+    }
+    if (r == L"savepal")
+    {
+        SWB_IS_BITMAP;
+        SaveFile(SWBitmaps::Palette8, SWBitmaps::FloydSteinberg);
+        return;
+    }
+    if (r == L"save4")
+    {
+        SWB_IS_BITMAP;
+        SaveFile(SWBitmaps::Palette4, SWBitmaps::Ordered);
+        return;
+    }
+    if (r == L"save1")
+    {
+        SWB_IS_BITMAP;
+        SaveFile(SWBitmaps::Mono1);
+        return;
+    }
     if (r == L"lookat")
     {
         SWB_IS_BITMAP;
         LookAtFile();
         return;
     }
+    if (r == L"replay")
+    {
+        SWB_IS_BITMAP;
+        ReplayEdits();
+        return;
+    }
     if (r == L"color")
     {
         SWB_IS_BITMAP;
@@ -84,12 +160,77 @@ void Application::Update()
         m_pLoadedBitmap->MakeItGrayScale();
         return;
     }
+    if (r == L"luma")
+    {
+        SWB_IS_BITMAP;
+        m_pLoadedBitmap->MakeItGrayScale(SWBitmaps::BT709);
+        return;
+    }
     if (r == L"rnbw")
     {
         SWB_IS_BITMAP;
         m_pLoadedBitmap->MakeItRainbow();
         return;
     }
+    if (r == L"noise")
+    {
+        SWB_IS_BITMAP;
+        m_pLoadedBitmap->AddNoise(SWBitmaps::Gaussian, 12.f, static_cast<uint64_t>(time(NULL)));
+        return;
+    }
+    if (r == L"blur")
+    {
+        SWB_IS_BITMAP;
+        std::wstring radius;
+        std::cout << "Radius:";
+        std::wcin >> radius;
+        m_pLoadedBitmap->BoxBlur(std::stoi(radius));
+        return;
+    }
+    if (r == L"median")
+    {
+        SWB_IS_BITMAP;
+        std::wstring radius;
+        std::cout << "Radius:";
+        std::wcin >> radius;
+        if (!SWBitmaps::MedianFilter(*m_pLoadedBitmap, std::stoi(radius)))
+            std::cout << "Median needs a 24-bit image and a radius up to " << MEDIAN_MAX_RADIUS << std::endl;
+        return;
+    }
+    if (r == L"morph")
+    {
+        SWB_IS_BITMAP;
+        std::wstring op;
+        std::cout << "Operation [erode/dilate/open/close]:";
+        std::wcin >> op;
+        std::wstring radius;
+        std::cout << "Radius:";
+        std::wcin >> radius;
+
+        const std::wstring names[] = { L"erode", L"dilate", L"open", L"close" };
+        auto it = std::find(std::begin(names), std::end(names), op);
+        if (it == std::end(names))
+        {
+            std::cout << "Unknown operation" << std::endl;
+            return;
+        }
+
+        const uint32_t uRadius = std::stoi(radius);
+        SWBitmaps::Morphology(*m_pLoadedBitmap, static_cast<SWBitmaps::MorphOp>(it - std::begin(names)), uRadius, uRadius);
+        return;
+    }
+    if (r == L"edges")
+    {
+        SWB_IS_BITMAP;
+        m_pLoadedBitmap->DetectEdges();
+        return;
+    }
+    if (r == L"bw")
+    {
+        SWB_IS_BITMAP;
+        std::cout << "Threshold: " << static_cast<uint32_t>(m_pLoadedBitmap->ThresholdOtsu()) << std::endl;
+        return;
+    }
     if (r == L"ds")
     {
         SWB_IS_BITMAP;
@@ -108,6 +249,53 @@ void Application::Update()
         SWHexEditor::Session::PrintImgFromGrayScale(m_pLoadedBitmap, std::stoi(w), std::tolower(b[0]) == 'y' ? true : false);
         return;
     }
+    if (r == L"prtc")
+    {
+        SWB_IS_BITMAP;
+        std::wstring w;
+        std::cout << "Width:";
+        std::wcin >> w;
+        SWHexEditor::TerminalRenderer::Present(SWHexEditor::TerminalRenderer::Render(*m_pLoadedBitmap, std::stoi(w), SWHexEditor::TrueColor, false));
+        return;
+    }
+    if (r == L"cmp")
+    {
+        SWB_IS_BITMAP;
+        CompareWithFile();
+        return;
+    }
+    if (r == L"overlay")
+    {
+        SWB_IS_BITMAP;
+        OverlayFile();
+        return;
+    }
+    if (r == L"hash")
+    {
+        SWB_IS_BITMAP;
+        std::cout << std::hex << std::setfill('0')
+            << "aHash: " << std::setw(16) << m_pLoadedBitmap->ComputeHash(SWBitmaps::AHash) << "\n"
+            << "dHash: " << std::setw(16) << m_pLoadedBitmap->ComputeHash(SWBitmaps::DHash) << "\n"
+            << "pHash: " << std::setw(16) << m_pLoadedBitmap->ComputeHash(SWBitmaps::PHash) << "\n"
+            << std::dec << std::setfill(' ') << std::flush;
+        return;
+    }
+    if (r == L"dups")
+    {
+        FindDuplicatesInDir();
+        return;
+    }
+    if (r == L"atlas")
+    {
+        BuildAtlasOfDir();
+        return;
+    }
+    if (r == L"thumbs")
+    {
+        SWB_IS_BITMAP;
+        SaveThumbnails();
+        return;
+    }
     if (r == L"scl")
     {
         SWB_IS_BITMAP;
@@ -140,25 +328,21 @@ void Application::LoadFile()
     std::cout << "Path:";
     std::wcin >> p;
 
-    // Remove all of '"'
-    while (p.find('"') != std::string::npos)
-    {
-        auto at = p.find_first_of('"');
-        p.erase(at, at + 1);
-    }
+    StripQuotes(p);
 
     m_pLoadedBitmap->Initialize(p);
 }   
 
 // -----------------------------------------------------------------------------
-void Application::SaveFile()
+void Application::SaveFile(IN const SWBitmaps::SaveFormat& format, IN const SWBitmaps::DitherMode& dither)
 {
     static int uBitmapIndexCounter = 1;
 
-    m_pLoadedBitmap->SaveToFile(SAVE_DIR 
+    if (!m_pLoadedBitmap->SaveToFile(SAVE_DIR 
         + L"Output" 
         + std::to_wstring(uBitmapIndexCounter++) 
-        + L".bmp");
+        + L".bmp", format, dither))
+        std::cout << "Can't save the image" << (format != SWBitmaps::Native ? ", this format needs a 24-bit one" : "") << std::endl;
 }
 
 // -----------------------------------------------------------------------------
@@ -167,17 +351,14 @@ void Application::LookAtFile()
     auto s = SWHexEditor::Session();
 
     s.SetBuffer(m_pLoadedBitmap);
+    s.SetOutputDirectory(SAVE_DIR);
     s.Start();
     
     while (s.IsSessionAlive())
     {
         s.UpdateSession();
     }
-
-    // Super secret windows exclusive feature
-#ifdef _WIN32
-    system("cls");
-#endif // _WIN32
+    s.Stop();
 
     std::wcout << L"Availble commands\n\
         - [q] for quit\n\
@@ -189,6 +370,250 @@ void Application::LookAtFile()
         - [negative] to make file negative\n";
 }
 
+// -----------------------------------------------------------------------------
+void Application::CompareWithFile()
+{
+    static int uHeatmapIndexCounter = 1;
+
+    std::wstring p;
+    std::cout << "Path:";
+    std::wcin >> p;
+
+    StripQuotes(p);
+
+    SWBitmaps::Bitmap other;
+    other.Initialize(p);
+
+    SWBitmaps::Bitmap heatmap;
+    const auto result = SWBitmaps::Compare(*m_pLoadedBitmap, other, &heatmap);
+    if (!result.Valid)
+    {
+        std::cout << "Images can't be compared" << std::endl;
+        return;
+    }
+
+    const char* channels[3] = { "Red", "Green", "Blue" };
+    for (uint8_t c = 0; c < 3; c++)
+    {
+        std::cout << channels[c] 
+            << ": max " << (uint32_t)result.MaxAbsError[c]
+            << ", MSE " << result.Mse[c]
+            << ", PSNR " << result.Psnr[c] << " dB\n";
+    }
+    std::cout << "SSIM: " << result.Ssim << std::endl;
+
+    heatmap.SaveToFile(SAVE_DIR 
+        + L"Heatmap" 
+        + std::to_wstring(uHeatmapIndexCounter++) 
+        + L".bmp");
+}
+
+// -----------------------------------------------------------------------------
+void Application::OverlayFile()
+{
+    std::wstring p;
+    std::cout << "Path:";
+    std::wcin >> p;
+
+    StripQuotes(p);
+
+    std::wstring x, y, opacity, mode;
+    std::cout << "X:";
+    std::wcin >> x;
+    std::cout << "Y:";
+    std::wcin >> y;
+    std::cout << "Opacity [0-1]:";
+    std::wcin >> opacity;
+    std::cout << "Mode [normal/multiply/screen/add]:";
+    std::wcin >> mode;
+
+    const std::wstring modes[] = { L"normal", L"multiply", L"screen", L"add" };
+    const auto it = std::find(std::begin(modes), std::end(modes), mode);
+
+    SWBitmaps::Bitmap overlay;
+    overlay.Initialize(p);
+
+    if (!SWBitmaps::Composite(*m_pLoadedBitmap, 
+        overlay, 
+        std::stoll(x), 
+        std::stoll(y), 
+        std::stof(opacity), 
+        it == std::end(modes) ? SWBitmaps::BlendNormal : static_cast<SWBitmaps::BlendMode>(it - std::begin(modes))))
+        std::cout << "Overlay needs a 24-bit image and a 24-bit or 32-bit .bmp" << std::endl;
+}
+
+// -----------------------------------------------------------------------------
+void Application::FindDuplicatesInDir()
+{
+    // Hashes only look at 32x32 cells, so every file is 
+    // read at roughly 256 px and most of the rows are never touched
+    const uint32_t uHashResolution = 256;
+    const uint8_t uMaxDistance = 6;
+
+    std::wstring p;
+    std::cout << "Directory:";
+    std::wcin >> p;
+
+    StripQuotes(p);
+
+    std::vector<std::wstring> files;
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator(p, error))
+    {
+        auto extension = entry.path().extension().wstring();
+        std::for_each(extension.begin(), extension.end(), [](wchar_t& c) {
+            c = std::tolower(c);
+            });
+
+        if (entry.is_regular_file() && extension == L".bmp")
+            files.push_back(entry.path().wstring());
+    }
+
+    std::vector<uint64_t> hashes(files.size());
+    std::vector<uint8_t> hashed(files.size(), 0);
+
+    SWBitmaps::ParallelFor(0, files.size(), [&](uint64_t first, uint64_t last) {
+        for (uint64_t i = first; i < last; i++)
+        {
+            const auto header = SWBitmaps::Bitmap::PeekHeader(files[i]);
+            if (!header.Valid)
+                continue;
+
+            const uint32_t uLongerSide = std::max<uint32_t>(header.Width, std::abs(header.Height));
+            const uint32_t uStep = std::max<uint32_t>(1, uLongerSide / uHashResolution);
+
+            SWBitmaps::Bitmap bitmap;
+            bitmap.Initialize(files[i], {}, uStep, uStep);
+            if (!bitmap.IsValid() || 
+                bitmap.GetHeader().ColorDepth != 24)
+                continue;
+
+            hashes[i] = bitmap.ComputeHash(SWBitmaps::PHash);
+            hashed[i] = 1;
+        }
+        }, 1);
+
+    SWBitmaps::HashIndex index;
+    for (uint64_t i = 0; i < files.size(); i++)
+    {
+        if (hashed[i])
+            index.Add(hashes[i], i);
+    }
+
+    const auto matches = index.FindDuplicates(uMaxDistance);
+
+    std::wcout << L"Hashed " << index.GetSize() << L" of " << files.size() << L" files\n";
+    for (auto& m : matches)
+    {
+        std::wcout << files[m.First] << L" ~ " << files[m.Second] 
+            << L" (" << (uint32_t)m.Distance << L")\n";
+    }
+    std::wcout << matches.size() << L" near duplicates" << std::endl;
+}
+
+// -----------------------------------------------------------------------------
+void Application::BuildAtlasOfDir()
+{
+    static int uAtlasIndexCounter = 1;
+
+    std::wstring p;
+    std::cout << "Directory:";
+    std::wcin >> p;
+
+    StripQuotes(p);
+
+    std::wstring padding;
+    std::cout << "Padding:";
+    std::wcin >> padding;
+
+    std::vector<std::wstring> files;
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator(p, error))
+    {
+        auto extension = entry.path().extension().wstring();
+        std::for_each(extension.begin(), extension.end(), [](wchar_t& c) {
+            c = std::tolower(c);
+            });
+
+        if (entry.is_regular_file() && extension == L".bmp")
+            files.push_back(entry.path().wstring());
+    }
+
+    const std::wstring name = L"Atlas" + std::to_wstring(uAtlasIndexCounter++);
+
+    SWBitmaps::AtlasBuilder atlas;
+    if (!atlas.Pack(files, 0, std::stoi(padding)) ||
+        !atlas.Write(SAVE_DIR + name + L".bmp") ||
+        !atlas.WriteIndex(SAVE_DIR + name + L".json", name + L".bmp"))
+    {
+        std::cout << "Atlas failed: " << atlas.GetError() << std::endl;
+        return;
+    }
+
+    std::cout << atlas.GetWidth() << "x" << atlas.GetHeight() << " atlas of " 
+        << atlas.GetPlacements().size() << " images, " 
+        << atlas.GetSkipped().size() << " skipped" << std::endl;
+}
+
+// -----------------------------------------------------------------------------
+void Application::SaveThumbnails()
+{
+    static int uThumbnailIndexCounter = 1;
+    const uint32_t widths[] = { 256, 128, 64 };
+
+    auto& pyramid = m_pLoadedBitmap->GetPyramid();
+    const bool bFromSidecar = pyramid.LoadSidecar(SAVE_DIR);
+
+    for (auto& w : widths)
+    {
+        const uint32_t h = std::max<uint32_t>(1, static_cast<uint32_t>((uint64_t)w * m_pLoadedBitmap->GetHeight() / m_pLoadedBitmap->GetWidth()));
+
+        SWBitmaps::Bitmap thumbnail;
+        pyramid.MakeThumbnail(w, h, thumbnail);
+        if (!thumbnail.IsValid())
+        {
+            std::cout << "Can't make a thumbnail of this image" << std::endl;
+            return;
+        }
+
+        thumbnail.SaveToFile(SAVE_DIR 
+            + L"Thumbnail" 
+            + std::to_wstring(uThumbnailIndexCounter++) 
+            + L".bmp");
+    }
+
+    if (bFromSidecar)
+        return;
+
+    // Levels are only kept when asked for, and only in output dir
+    std::wstring b;
+    std::cout << "Keep levels in output dir for next time [y/n]:";
+    std::wcin >> b;
+    if (std::tolower(b[0]) == 'y' && 
+        !pyramid.SaveSidecar(SAVE_DIR))
+        std::cout << "Can't save levels" << std::endl;
+}
+
+// -----------------------------------------------------------------------------
+void Application::ReplayEdits()
+{
+    std::wstring p;
+    std::cout << "Path:";
+    std::wcin >> p;
+    StripQuotes(p);
+
+    SWHexEditor::RangeEditLog log;
+    if (!log.LoadFromFile(p))
+    {
+        std::cout << "Can't read edit log" << std::endl;
+        return;
+    }
+
+    SWHexEditor::Session::ReplayEditLog(m_pLoadedBitmap, log);
+
+    std::cout << "Replayed " << log.GetEdits().size() << " edits" << std::endl;
+}
+
 // -----------------------------------------------------------------------------
 void Application::FindPathToItself()
 {
@@ -205,19 +630,22 @@ void Application::FindPathToItself()
     m_PathToItself = tmpFileName;
     free(tmpFileName);
 
+    return;
+#else
+    char tmpFileName[PATH_MAX] = {};
+    const ssize_t size = readlink("/proc/self/exe", tmpFileName, PATH_MAX - 1);
+    if (size <= 0)
+        throw;
+
+    m_PathToItself = std::filesystem::path(tmpFileName).parent_path().wstring() + L"/";
+
     return;
 #endif // _WIN32
-    throw;
 }
 
 // -----------------------------------------------------------------------------
 void Application::CreateSaveDir()
 {
-#ifdef _WIN32
-    CreateDirectory(SAVE_DIR.c_str(), NULL);
-
-    return;
-#endif // _WIN32
-
-    throw;
+    std::error_code error;
+    std::filesystem::create_directories(SAVE_DIR, error);
 }
@@ -2,7 +2,7 @@
 
 #include "Core/Bitmap.hpp"
 
-#define SAVE_DIR (m_PathToItself.substr(0, m_PathToItself.size() - 1) + L"\\Output\\")
+#define SAVE_DIR (std::filesystem::path(m_PathToItself) / L"Output" / L"").wstring()
 
 class Application
 {
@@ -30,10 +30,23 @@ private:
 
     void LoadFile();
 
-    void SaveFile();
+    void SaveFile(IN const SWBitmaps::SaveFormat& format = SWBitmaps::Native, 
+        IN const SWBitmaps::DitherMode& dither = SWBitmaps::NoDither);
 
     void LookAtFile();
 
+    void CompareWithFile();
+
+    void OverlayFile();
+
+    void FindDuplicatesInDir();
+
+    void BuildAtlasOfDir();
+
+    void SaveThumbnails();
+
+    void ReplayEdits();
+
 private:
 
     void FindPathToItself();
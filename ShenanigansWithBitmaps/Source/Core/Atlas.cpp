@@ -0,0 +1,309 @@
+#include "Pch.h"
+
+#include "Atlas.hpp"
+#include "Composite.hpp"
+#include "Parallel.hpp"
+
+using namespace SWBitmaps;
+
+// -----------------------------------------------------------------------------
+static std::string ToJsonString(IN const std::wstring& text)
+{
+    const std::u8string utf8 = std::filesystem::path(text).u8string();
+    std::string result = "\"";
+
+    for (const char8_t c : utf8)
+    {
+        switch (c)
+        {
+        case '"':
+            result += "\\\"";
+            break;
+
+        case '\\':
+            result += "\\\\";
+            break;
+
+        default:
+            if (c < 0x20)
+                result += std::format("\\u{:04x}", static_cast<uint32_t>(c));
+            else
+                result += static_cast<char>(c);
+        }
+    }
+
+    return result + "\"";
+}
+
+// -----------------------------------------------------------------------------
+bool AtlasBuilder::Pack(IN const std::vector<std::wstring>& paths,
+    IN const uint32_t& width,
+    IN const uint32_t& padding)
+{
+    m_Placements.clear();
+    m_Headers.clear();
+    m_Order.clear();
+    m_Shelves.clear();
+    m_Skipped.clear();
+    m_uWidth = 0;
+    m_uHeight = 0;
+
+    std::vector<BitmapHeader> headers(paths.size());
+    std::vector<uint8_t> usable(paths.size(), 0);
+
+    // Only the headers and the sizes of the files
+    ParallelFor(0, paths.size(), [&](uint64_t first, uint64_t last) {
+        for (uint64_t i = first; i < last; i++)
+        {
+            const BitmapHeader header = Bitmap::PeekHeader(paths[i]);
+            const bool bSupported = header.Valid && header.Width > 0 && header.Height != 0 &&
+                Bitmap::HasBgrLayout(header);
+
+            if (!bSupported)
+                continue;
+
+            std::error_code error;
+            const uint64_t uFileSize = std::filesystem::file_size(paths[i], error);
+            const uint64_t uNeeded = header.FileBeginOffset + Bitmap::CalcPitch(header.ColorDepth, header.Width) * std::abs(header.Height);
+
+            headers[i] = header;
+            usable[i] = !error && uFileSize >= uNeeded;
+        }
+        }, 16);
+
+    uint64_t uArea = 0;
+    uint64_t uWidest = 0;
+
+    for (uint64_t i = 0; i < paths.size(); i++)
+    {
+        if (!usable[i] || (width != 0 && static_cast<uint64_t>(headers[i].Width) > width))
+        {
+            m_Skipped.push_back(paths[i]);
+            continue;
+        }
+
+        AtlasPlacement placement = {};
+        placement.Path = paths[i];
+        placement.Width = headers[i].Width;
+        placement.Height = std::abs(headers[i].Height);
+
+        uArea += (placement.Width + padding) * (placement.Height + padding);
+        uWidest = std::max<uint64_t>(uWidest, placement.Width);
+
+        m_Placements.push_back(placement);
+        m_Headers.push_back(headers[i]);
+    }
+
+    if (m_Placements.empty())
+    {
+        m_Error = "no usable images, the atlas takes uncompressed 24-bit and 32-bit .bmp files";
+        return false;
+    }
+
+    m_uWidth = width != 0 ? width : std::max<uint64_t>(uWidest, static_cast<uint64_t>(std::ceil(std::sqrt(static_cast<double>(uArea)))));
+
+    // Tallest first, so shelves waste little height
+    m_Order.resize(m_Placements.size());
+    std::iota(m_Order.begin(), m_Order.end(), 0);
+    std::stable_sort(m_Order.begin(), m_Order.end(), [&](uint64_t a, uint64_t b) {
+        return m_Placements[a].Height > m_Placements[b].Height;
+        });
+
+    uint64_t x = 0;
+    for (uint64_t i = 0; i < m_Order.size(); i++)
+    {
+        AtlasPlacement& placement = m_Placements[m_Order[i]];
+
+        if (m_Shelves.empty() || x + placement.Width > m_uWidth)
+        {
+            const uint64_t y = m_Shelves.empty() ? 0 : m_Shelves.back().Y + m_Shelves.back().Height + padding;
+            m_Shelves.push_back({ y, static_cast<uint64_t>(placement.Height), i, i });
+            x = 0;
+        }
+
+        placement.X = x;
+        placement.Y = m_Shelves.back().Y;
+        m_Shelves.back().Last = i + 1;
+        x += placement.Width + padding;
+    }
+
+    m_uHeight = m_Shelves.back().Y + m_Shelves.back().Height;
+
+    if (BITMAPINFOHEADER + Bitmap::CalcPitch(24, m_uWidth) * m_uHeight > UINT32_MAX ||
+        m_uHeight > INT32_MAX)
+    {
+        m_Error = std::format("atlas of {}x{} doesn't fit into a .bmp", m_uWidth, m_uHeight);
+        return false;
+    }
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+bool AtlasBuilder::Write(IN const std::wstring& path, IN const uint64_t& bandBytes)
+{
+    if (m_Shelves.empty())
+    {
+        m_Error = "nothing is packed";
+        return false;
+    }
+
+    const uint64_t uPitch = Bitmap::CalcPitch(24, m_uWidth);
+
+    BitmapHeader header = {};
+    header.SizeOfHeader = BITMAPINFOHEADER - 14;
+    header.Width = static_cast<int32_t>(m_uWidth);
+    // Top-down, so the bands go out in file order
+    header.Height = -static_cast<int32_t>(m_uHeight);
+    header.ColorPlanes = 1;
+    header.ColorDepth = 24;
+    header.HorizontalResolution = 2835;
+    header.VerticalResolution = 2835;
+    header.FileBeginOffset = BITMAPINFOHEADER;
+    header.ImageSize = static_cast<uint32_t>(uPitch * m_uHeight);
+    header.FileSize = header.ImageSize + header.FileBeginOffset;
+
+    std::ofstream file(std::filesystem::path(path), std::ios_base::binary | std::ios_base::out);
+    if (!file.is_open())
+    {
+        m_Error = "can't create the atlas";
+        return false;
+    }
+
+    char headerBuff[BITMAPINFOHEADER] = {};
+    Bitmap::MakeHeader(header, headerBuff);
+    file.write(headerBuff, BITMAPINFOHEADER);
+
+    const uint64_t uBandRows = std::max<uint64_t>(1, bandBytes / uPitch);
+    std::vector<uint8_t> band(uBandRows * uPitch);
+    std::vector<uint64_t> items;
+    uint64_t uShelf = 0;
+
+    for (uint64_t uTop = 0; uTop < m_uHeight; uTop += uBandRows)
+    {
+        const uint64_t uBottom = std::min(m_uHeight, uTop + uBandRows);
+        memset(band.data(), 0, (uBottom - uTop) * uPitch);
+
+        // Shelves are in order of their rows, ones above the band are done
+        while (uShelf < m_Shelves.size() && m_Shelves[uShelf].Y + m_Shelves[uShelf].Height <= uTop)
+            uShelf++;
+
+        items.clear();
+        for (uint64_t s = uShelf; s < m_Shelves.size() && m_Shelves[s].Y < uBottom; s++)
+            for (uint64_t i = m_Shelves[s].First; i < m_Shelves[s].Last; i++)
+                if (m_Placements[m_Order[i]].Y + m_Placements[m_Order[i]].Height > static_cast<int64_t>(uTop))
+                    items.push_back(m_Order[i]);
+
+        std::atomic_bool bFailed = false;
+
+        ParallelFor(0, items.size(), [&](uint64_t first, uint64_t last) {
+            std::vector<char> buffer;
+
+            for (uint64_t i = first; i < last; i++)
+            {
+                const AtlasPlacement& placement = m_Placements[items[i]];
+                const uint64_t uFirst = std::max<int64_t>(0, static_cast<int64_t>(uTop) - placement.Y);
+                const uint64_t uLast = std::min<int64_t>(placement.Height, static_cast<int64_t>(uBottom) - placement.Y);
+
+                if (!ReadRows(placement, m_Headers[items[i]], uFirst, uLast, uTop, band.data(), buffer))
+                    bFailed.store(true);
+            }
+            }, 1);
+
+        if (bFailed.load())
+        {
+            m_Error = "an input changed while the atlas was written";
+            return false;
+        }
+
+        file.write((const char*)band.data(), (uBottom - uTop) * uPitch);
+    }
+
+    if (!file)
+    {
+        m_Error = "can't write the atlas";
+        return false;
+    }
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+bool AtlasBuilder::WriteIndex(IN const std::wstring& path, IN const std::wstring& imageName) const
+{
+    std::ofstream file(std::filesystem::path(path), std::ios_base::binary | std::ios_base::out);
+    if (!file.is_open())
+        return false;
+
+    file << "{\n  \"image\": " << ToJsonString(imageName)
+        << ",\n  \"width\": " << m_uWidth
+        << ",\n  \"height\": " << m_uHeight
+        << ",\n  \"sprites\": [";
+
+    // Input order, not shelf order
+    for (uint64_t i = 0; i < m_Placements.size(); i++)
+    {
+        const AtlasPlacement& placement = m_Placements[i];
+
+        file << (i ? ",\n" : "\n") << std::format("    {{ \"path\": {}, \"x\": {}, \"y\": {}, \"width\": {}, \"height\": {} }}",
+            ToJsonString(placement.Path),
+            placement.X,
+            placement.Y,
+            placement.Width,
+            placement.Height);
+    }
+
+    file << "\n  ],\n  \"skipped\": [";
+
+    for (uint64_t i = 0; i < m_Skipped.size(); i++)
+        file << (i ? ", " : "") << ToJsonString(m_Skipped[i]);
+
+    file << "]\n}\n";
+
+    return file.good();
+}
+
+// Private ---------------------------------------------------------------------
+
+// -----------------------------------------------------------------------------
+bool AtlasBuilder::ReadRows(IN const AtlasPlacement& placement,
+    IN const BitmapHeader& header,
+    IN const uint64_t& first,
+    IN const uint64_t& last,
+    IN const uint64_t& bandTop,
+    IN uint8_t* band,
+    IN std::vector<char>& buffer) const
+{
+    const uint64_t uPitch = Bitmap::CalcPitch(header.ColorDepth, header.Width);
+    const uint64_t uOutPitch = Bitmap::CalcPitch(24, m_uWidth);
+    const uint64_t uHeight = placement.Height;
+    const bool bBottomUp = header.Height > 0;
+    const bool bAlpha = Bitmap::HasAlpha(header);
+
+    // Viewed rows of a bottom-up file are backwards, but still one contiguous span
+    const uint64_t uFileFirst = bBottomUp ? uHeight - last : first;
+    const uint64_t uRows = last - first;
+
+    buffer.resize(uRows * uPitch);
+
+    std::ifstream file(std::filesystem::path(placement.Path), std::ios_base::binary | std::ios_base::in);
+    if (!file.is_open())
+        return false;
+
+    file.seekg(header.FileBeginOffset + uFileFirst * uPitch, std::ios_base::beg);
+    file.read(buffer.data(), buffer.size());
+    if (!file)
+        return false;
+
+    for (uint64_t v = first; v < last; v++)
+    {
+        const uint64_t uFileRow = bBottomUp ? uHeight - 1 - v : v;
+        const uint8_t* src = (const uint8_t*)buffer.data() + (uFileRow - uFileFirst) * uPitch;
+        uint8_t* dst = band + (placement.Y + v - bandTop) * uOutPitch + placement.X * 3;
+
+        // 24-bit rows are copied, 32-bit ones blended by their alpha if they have one
+        BlendRow(dst, src, placement.Width, header.ColorDepth, bAlpha, 256, BlendNormal);
+    }
+
+    return true;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "Bitmap.hpp"
+
+// Rows of the atlas kept in memory at once
+#define ATLAS_BAND_BYTES (64 * 1024 * 1024)
+
+namespace SWBitmaps
+{
+    // Where one input ended up, as the atlas is viewed
+    struct AtlasPlacement
+    {
+        std::wstring Path = L"";
+        int64_t X = 0;
+        int64_t Y = 0;
+        int64_t Width = 0;
+        int64_t Height = 0;
+    };
+
+    // Packs many .bmp files into one 24-bit atlas without ever having all
+    // of them, or the whole atlas, in memory. Packing reads only the headers.
+    // The atlas is written top-down one band of rows at a time, each input
+    // intersecting the band is opened and only its rows of the band are read.
+    class AtlasBuilder
+    {
+    public:
+
+        AtlasBuilder() = default;
+
+        ~AtlasBuilder() = default;
+
+    public:
+
+        // Shelves of images sorted by height, tallest first. Width 0 picks one
+        // for a roughly square atlas. Unreadable and compressed inputs are skipped,
+        // so are 32-bit bit fields in any order but BGRA.
+        bool Pack(IN const std::vector<std::wstring>& paths,
+            IN const uint32_t& width,
+            IN const uint32_t& padding);
+
+        // Gaps are black, 32-bit inputs with an alpha mask are blended over them
+        bool Write(IN const std::wstring& path, IN const uint64_t& bandBytes = ATLAS_BAND_BYTES);
+
+        // {"image", "width", "height", "sprites": [{"path", "x", "y", "width", "height"}], "skipped"}
+        bool WriteIndex(IN const std::wstring& path, IN const std::wstring& imageName) const;
+
+    public:
+
+        // Getters -------------------------------------------------------------
+
+        const std::vector<AtlasPlacement>& GetPlacements() const { return m_Placements; }
+
+        const std::vector<std::wstring>& GetSkipped() const { return m_Skipped; }
+
+        uint64_t GetWidth() const { return m_uWidth; }
+
+        uint64_t GetHeight() const { return m_uHeight; }
+
+        const std::string& GetError() const { return m_Error; }
+
+    private:
+
+        // Copies viewed rows [first, last) of the input into the band starting at viewed row 'bandTop'
+        bool ReadRows(IN const AtlasPlacement& placement,
+            IN const BitmapHeader& header,
+            IN const uint64_t& first,
+            IN const uint64_t& last,
+            IN const uint64_t& bandTop,
+            IN uint8_t* band,
+            IN std::vector<char>& buffer) const;
+
+    private:
+
+        // Images of one shelf start at its top, none is taller than the first
+        struct Shelf
+        {
+            uint64_t Y = 0;
+            uint64_t Height = 0;
+            uint64_t First = 0;
+            uint64_t Last = 0;
+        };
+
+        std::vector<AtlasPlacement> m_Placements;
+        std::vector<BitmapHeader> m_Headers;
+        // Indices into placements, in shelf order
+        std::vector<uint64_t> m_Order;
+        std::vector<Shelf> m_Shelves;
+        std::vector<std::wstring> m_Skipped;
+
+        uint64_t m_uWidth = 0;
+        uint64_t m_uHeight = 0;
+
+        std::string m_Error = "";
+
+    };
+}
@@ -1,15 +1,27 @@
 #include "Pch.h"
 
 #include "Bitmap.hpp"
+#include "Parallel.hpp"
+#include "Random.hpp"
+#include "Quantizer.hpp"
+#include "ToneLut.hpp"
+#include "PerceptualHash.hpp"
+#include "Pyramid.hpp"
+#include "IntegralImage.hpp"
 
 using namespace SWBitmaps;
 
+// Generations are unique across all bitmaps
+static std::atomic<uint64_t> s_uGenerationCounter = 0;
+static std::mutex s_CacheMutex;
+
 
 // Bitmap ----------------------------------------------------------------------
 
 // -----------------------------------------------------------------------------
 void Bitmap::Initialize(IN const std::wstring& path)
 {
+    Destroy();
     m_Path = path;
 
     LoadFromPath();
@@ -20,36 +32,285 @@ void Bitmap::Initialize(IN const std::wstring& path)
         return;
 
     MapImage();
+    m_uLoadedGeneration = m_uGeneration;
+}
+
+// -----------------------------------------------------------------------------
+void Bitmap::Initialize(IN const int32_t& width, IN const int32_t& height)
+{
+    Destroy();
+    m_Path = L"";
+
+    if (width <= 0 || height == 0)
+    {
+        m_Header.Valid = false;
+        return;
+    }
+
+    m_Header = {};
+    m_Header.SizeOfHeader = BITMAPINFOHEADER - 14;
+    m_Header.Width = width;
+    m_Header.Height = height;
+    m_Header.ColorPlanes = 1;
+    m_Header.ColorDepth = 24;
+    // 72 DPI
+    m_Header.HorizontalResolution = 2835;
+    m_Header.VerticalResolution = 2835;
+    m_Header.FileBeginOffset = BITMAPINFOHEADER;
+    m_Header.ImageSize = static_cast<uint32_t>(GetPitch() * GetHeight());
+    m_Header.FileSize = m_Header.ImageSize + m_Header.FileBeginOffset;
+
+    m_uSizeOfBuff = sizeof(char) * m_Header.FileSize;
+    m_ImageBuff = BufferPool::Get().Acquire(m_uSizeOfBuff, true);
+
+    MakeHeader();
+    m_Header.Valid = true;
+
+    MapImage();
+}
+
+// -----------------------------------------------------------------------------
+void Bitmap::Initialize(IN const std::wstring& path, 
+    IN const BitmapRegion& region, 
+    IN const uint32_t& stepX, 
+    IN const uint32_t& stepY)
+{
+    Destroy();
+    m_Path = path;
+
+    LoadRegionFromPath(region, stepX, stepY);
+    if (!m_Header.Valid)
+        return;
+
+    MapImage();
 }
 
 // -----------------------------------------------------------------------------
 void Bitmap::Destroy()
 {
+    MarkModified();
     m_MappedImage.Clear();
 
     if (m_ImageBuff != nullptr)
     {
-        free(m_ImageBuff);
+        ReleaseBuffer(m_ImageBuff, m_uSizeOfBuff, m_bSharedBuffer);
         m_ImageBuff = nullptr;
+        m_bSharedBuffer = false;
     }
 }
 
 // -----------------------------------------------------------------------------
-void Bitmap::SaveToFile(IN const std::wstring& path)
+bool Bitmap::InitializeFromSharedMemory(IN const std::string& name, IN const bool& inPlace)
+{
+#ifndef _WIN32
+    const int fd = shm_open(name.c_str(), inPlace ? O_RDWR : O_RDONLY, 0);
+    if (fd < 0)
+        return false;
+
+    // The mapping keeps the segment alive
+    const bool bResult = InitializeFromFd(fd, inPlace);
+    close(fd);
+
+    return bResult;
+#else
+    return false;
+#endif // _WIN32
+}
+
+// -----------------------------------------------------------------------------
+bool Bitmap::InitializeFromFd(IN const int& fd, IN const bool& inPlace)
+{
+    Destroy();
+    m_Path.clear();
+    m_Header = {};
+
+#ifndef _WIN32
+    struct stat info = {};
+    if (fstat(fd, &info) != 0 ||
+        info.st_size < BITMAPINFOHEADER)
+        return false;
+
+    // A private mapping needs only read access, written pages become our own
+    void* pages = mmap(nullptr, info.st_size, PROT_READ | PROT_WRITE, inPlace ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+    if (pages == MAP_FAILED)
+        return false;
+
+    m_ImageBuff = (char*)pages;
+    m_uSizeOfBuff = info.st_size;
+    m_bSharedBuffer = true;
+    m_bWritesThrough = inPlace;
+    m_uSharedDevice = info.st_dev;
+    m_uSharedInode = info.st_ino;
+
+    ReadHeader();
+
+    // The other side can hand over anything, only uncompressed 24-bit and 
+    // 32-bit images (BGRA bit fields too) can be mapped and the pixels have 
+    // to fit the mapping
+    if (!m_Header.Valid ||
+        m_Header.Width <= 0 ||
+        m_Header.Height == 0 ||
+        m_Header.Height == std::numeric_limits<int32_t>::min() ||
+        !HasBgrLayout(m_Header) ||
+        m_Header.FileBeginOffset < BITMAPINFOHEADER ||
+        m_Header.FileBeginOffset + (GetPitch() * GetHeight()) > m_uSizeOfBuff)
+    {
+        Destroy();
+        m_Header.Valid = false;
+        return false;
+    }
+
+    MapImage();
+    return true;
+#else
+    return false;
+#endif // _WIN32
+}
+
+// -----------------------------------------------------------------------------
+bool Bitmap::SaveToFile(IN const std::wstring& path)
 {
-    std::ofstream file(path,
+    std::ofstream file(std::filesystem::path(path),
         std::ios_base::binary | std::ios_base::out);
 
     if (!file.is_open())
     {
         m_Header.Valid = false;
-        return;
+        return false;
     }
 
     for (uint64_t i = 0; i < m_uSizeOfBuff; i += BITMAP_CHUNK)
-        file.write((m_ImageBuff + i), BITMAP_CHUNK);
+        file.write((m_ImageBuff + i), std::min<uint64_t>(BITMAP_CHUNK, m_uSizeOfBuff - i));
 
     file.close();
+    return file.good();
+}
+
+// -----------------------------------------------------------------------------
+bool Bitmap::SaveToFile(IN const std::wstring& path, 
+    IN const SaveFormat& format, 
+    IN const LumaWeights& weights)
+{
+    switch (format)
+    {
+    case Native:
+        return SaveToFile(path);
+
+    case Gray8:
+    {
+        if (m_Header.ColorDepth != 24)
+            return false;
+
+        std::vector<Color> palette(256);
+        for (uint16_t v = 0; v < 256; v++)
+            palette[v] = { (uint8_t)v, (uint8_t)v, (uint8_t)v };
+
+        const uint64_t uWidth = GetWidth();
+        return SaveIndexed(path, 8, palette, [&](uint64_t i, uint8_t* dst) {
+            ComputeLumaRow(GetRow(i), dst, uWidth, weights);
+            });
+    }
+
+    case Mono1:
+    {
+        if (m_Header.ColorDepth != 24)
+            return false;
+
+        const std::vector<Color> palette = { SWBITMAPS_COLOR_BLACK, SWBITMAPS_COLOR_WHITE };
+        const uint64_t uWidth = GetWidth();
+
+        return SaveIndexed(path, 1, palette, [&](uint64_t i, uint8_t* dst) {
+            uint8_t luma[256];
+            const uint8_t* src = GetRow(i);
+
+            // Eight pixels per byte, the first one in the high bit
+            for (uint64_t k = 0; k < uWidth; k += sizeof(luma))
+            {
+                const uint64_t uCount = std::min<uint64_t>(sizeof(luma), uWidth - k);
+                ComputeLumaRow(src + (k * 3), luma, uCount, weights);
+
+                for (uint64_t j = 0; j < uCount; j++)
+                    dst[(k + j) / 8] |= (luma[j] >> 7) << (7 - ((k + j) & 7));
+            }
+            });
+    }
+
+    case Palette8:
+    case Palette4:
+        return SaveToFile(path, format, NoDither);
+
+    default:
+        throw;
+    }
+}
+
+// -----------------------------------------------------------------------------
+bool Bitmap::SaveToFile(IN const std::wstring& path,
+    IN const SaveFormat& format,
+    IN const DitherMode& dither)
+{
+    switch (format)
+    {
+    case Palette8:
+        return SaveQuantized(path, 8, dither);
+
+    case Palette4:
+        return SaveQuantized(path, 4, dither);
+
+    default:
+        return SaveToFile(path, format, BT601);
+    }
+}
+
+// -----------------------------------------------------------------------------
+bool Bitmap::SaveToSharedMemory(IN const std::string& name)
+{
+#ifndef _WIN32
+    const int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0600);
+    if (fd < 0)
+        return false;
+
+    const bool bResult = SaveToFd(fd);
+    close(fd);
+
+    return bResult;
+#else
+    return false;
+#endif // _WIN32
+}
+
+// -----------------------------------------------------------------------------
+bool Bitmap::SaveToFd(IN const int& fd)
+{
+#ifndef _WIN32
+    struct stat info = {};
+    if (!m_ImageBuff ||
+        fstat(fd, &info) != 0)
+        return false;
+
+    // Ops already wrote the shared pages
+    if (m_bSharedBuffer &&
+        m_bWritesThrough &&
+        (uint64_t)info.st_dev == m_uSharedDevice &&
+        (uint64_t)info.st_ino == m_uSharedInode &&
+        (uint64_t)info.st_size == m_uSizeOfBuff)
+        return true;
+
+    if (ftruncate(fd, m_uSizeOfBuff) != 0)
+        return false;
+
+    for (uint64_t i = 0; i < m_uSizeOfBuff; )
+    {
+        const ssize_t written = pwrite(fd, m_ImageBuff + i, m_uSizeOfBuff - i, i);
+        if (written <= 0)
+            return false;
+        i += written;
+    }
+
+    return true;
+#else
+    return false;
+#endif // _WIN32
 }
 
 // Image manipulation ----------------------------------------------------------
@@ -66,28 +327,36 @@ for (uint64_t i = 0; i < m_MappedImage.GetHeight(); i++)        \
 // -----------------------------------------------------------------------------
 void SWBitmaps::Bitmap::ScaleTo(uint32_t width, uint32_t height)
 {
+    if (width == 0 || !m_Header.Valid)
+        return;
+
+    MarkModified();
+
     char* originalBuf = m_ImageBuff;
+    const uint64_t uOriginalSize = m_uSizeOfBuff;
+    const bool bWasShared = m_bSharedBuffer;
+    m_bSharedBuffer = false;
     PixelMapWrapper originalMap = m_MappedImage;
     m_MappedImage.Clear();
 
-    // If no height than scale with aspect ratio
+    // If no height than scale with aspect ratio, at least one row
     if (!height)
-        height = (width * ((long double)m_Header.Height / m_Header.Width));
+        height = std::max<uint32_t>(1, static_cast<uint32_t>(((uint64_t)width * GetHeight()) / GetWidth()));
 
     // Pre calculate
-    const long double fNewHeightRatio = (long double)m_Header.Height / height;
+    const long double fNewHeightRatio = (long double)GetHeight() / height;
     const long double fNewWidthRatio = (long double)m_Header.Width / width;
 
+    // Top-down images stay top-down
     m_Header.Width = width;
-    m_Header.Height = height;
-#pragma warning ( push )
-#pragma warning ( disable : 4244 )
-    const uint64_t calcWidth = std::floorl((((m_Header.ColorDepth * m_Header.Width) + 31) / 32)) * 4;
-#pragma warning ( pop )
-    m_Header.FileSize = (calcWidth * m_Header.Height) + m_Header.FileBeginOffset;
-    m_Header.ImageSize = (calcWidth * m_Header.Height);
+    m_Header.Height = m_Header.Height < 0 ? -static_cast<int32_t>(height) : height;
+    m_Header.ImageSize = static_cast<uint32_t>(GetPitch() * height);
+    m_Header.FileSize = m_Header.ImageSize + m_Header.FileBeginOffset;
     m_uSizeOfBuff = sizeof(char) * m_Header.FileSize;
-    m_ImageBuff = (char*)malloc(m_uSizeOfBuff);
+    m_ImageBuff = BufferPool::Get().Acquire(m_uSizeOfBuff, false);
+
+    // Everything before the pixels, palette or extra header fields included
+    memcpy(m_ImageBuff, originalBuf, m_Header.FileBeginOffset);
     MakeHeader();
     MapImage();
 
@@ -104,13 +373,65 @@ void SWBitmaps::Bitmap::ScaleTo(uint32_t width, uint32_t height)
         }
     }
 
-    free(originalBuf);
-    originalMap.~PixelMapWrapper();
+    ReleaseBuffer(originalBuf, uOriginalSize, bWasShared);
+}
+
+// -----------------------------------------------------------------------------
+void Bitmap::ScaleTo(IN const uint32_t& width, IN const uint32_t& height, IN const ScaleFilter& filter)
+{
+    if (filter == Nearest || 
+        m_Header.ColorDepth != 24)
+    {
+        ScaleTo(width, height);
+        return;
+    }
+
+    if (width == 0 || !m_Header.Valid)
+        return;
+
+    MarkModified();
+
+    const uint32_t uHeight = height ? height : std::max<uint32_t>(1, static_cast<uint32_t>(((uint64_t)width * GetHeight()) / GetWidth()));
+
+    char* originalBuf = m_ImageBuff;
+    const uint64_t uOriginalSize = m_uSizeOfBuff;
+    const bool bWasShared = m_bSharedBuffer;
+    m_bSharedBuffer = false;
+    const BitmapHeader originalHeader = m_Header;
+    const uint64_t uOriginalPitch = GetPitch();
+    m_MappedImage.Clear();
+
+    // Top-down images stay top-down
+    m_Header.Width = width;
+    m_Header.Height = originalHeader.Height < 0 ? -static_cast<int32_t>(uHeight) : uHeight;
+    m_Header.ImageSize = static_cast<uint32_t>(GetPitch() * uHeight);
+    m_Header.FileSize = m_Header.ImageSize + m_Header.FileBeginOffset;
+    m_uSizeOfBuff = sizeof(char) * m_Header.FileSize;
+    m_ImageBuff = BufferPool::Get().Acquire(m_uSizeOfBuff, true);
+
+    // Everything before the pixels, palette or extra header fields included
+    memcpy(m_ImageBuff, originalBuf, m_Header.FileBeginOffset);
+    MakeHeader();
+
+    ResampleBgr((const uint8_t*)originalBuf + originalHeader.FileBeginOffset, 
+        originalHeader.Width, 
+        std::abs(originalHeader.Height), 
+        uOriginalPitch, 
+        GetRow(0), 
+        width, 
+        uHeight, 
+        GetPitch(), 
+        filter);
+
+    ReleaseBuffer(originalBuf, uOriginalSize, bWasShared);
+    MapImage();
 }
 
 // -----------------------------------------------------------------------------
 void Bitmap::ColorWhole(IN Color c)
 {
+    MarkModified();
+
     SWB_FOR_WHOLE_IMAGE_I_K;
         if (MappedPixel::IsInvalid(m_MappedImage.Pixel(i, k)))
             continue;
@@ -126,6 +447,8 @@ void Bitmap::ColorWhole(IN Color c)
 // -----------------------------------------------------------------------------
 void SWBitmaps::Bitmap::ColorHalf(IN Color c)
 {
+    MarkModified();
+
     for (uint64_t i = 0; i < m_MappedImage.GetHeight() / 2; i++)
     {
         for (uint64_t k = 0; k < m_MappedImage.GetWidth(i); k++)
@@ -145,52 +468,279 @@ void SWBitmaps::Bitmap::ColorHalf(IN Color c)
 // -----------------------------------------------------------------------------
 void Bitmap::MakeItRainbow()
 {
-#pragma warning ( push )
-#pragma warning ( disable : 4244 )
-    srand(time(NULL));
-#pragma warning ( pop )
+    MakeItRainbow(static_cast<uint64_t>(time(NULL)));
+}
+
+// -----------------------------------------------------------------------------
+void Bitmap::MakeItRainbow(IN const uint64_t& seed)
+{
+    if (!m_Header.Valid ||
+        m_Header.ColorDepth != 24)
+        return;
 
-    SWB_FOR_WHOLE_IMAGE_I_K
-        if (MappedPixel::IsInvalid(m_MappedImage.Pixel(i, k)))
-            continue;
-        
-        auto& p = m_MappedImage.Pixel(i, k);
-        
-        p.Red() = std::rand() % 256;
-        p.Green() = std::rand() % 256;
-        p.Blue() = std::rand() % 256;
-    SWB_FOR_WHOLE_IMAGE_I_K_END
+    MarkModified();
+
+    const Philox random(seed);
+    const uint64_t uRowBytes = GetWidth() * 3;
+    const uint64_t uBlocksPerRow = Philox::BlocksFor(uRowBytes);
+
+    ParallelFor(0, GetHeight(), [&](uint64_t first, uint64_t last) {
+        for (uint64_t i = first; i < last; i++)
+            random.Fill(i * uBlocksPerRow, GetRow(i), uRowBytes);
+        });
+}
+
+// -----------------------------------------------------------------------------
+void Bitmap::AddNoise(IN const NoiseType& type, IN const float& amount, IN const uint64_t& seed)
+{
+    if (!m_Header.Valid ||
+        m_Header.ColorDepth != 24)
+        return;
+
+    MarkModified();
+
+    const Philox random(seed);
+    const uint64_t uRowBytes = GetWidth() * 3;
+    // Uniform noise takes a byte per channel, gaussian takes 
+    // two 32-bit words per pair of channels
+    const uint64_t uNoiseBytes = type == Uniform ? uRowBytes : ((uRowBytes + 1) / 2) * 8;
+    const uint64_t uBlocksPerRow = Philox::BlocksFor(uNoiseBytes);
+
+    ParallelFor(0, GetHeight(), [&](uint64_t first, uint64_t last) {
+        std::vector<uint8_t> noise(uBlocksPerRow * 16);
+
+        for (uint64_t i = first; i < last; i++)
+        {
+            uint8_t* row = GetRow(i);
+            random.Fill(i * uBlocksPerRow, noise.data(), noise.size());
+
+            if (type == Uniform)
+            {
+                const float fScale = amount / 127.5f;
+
+                for (uint64_t k = 0; k < uRowBytes; k++)
+                {
+                    const float fValue = row[k] + ((noise[k] - 127.5f) * fScale);
+                    row[k] = static_cast<uint8_t>(std::clamp(fValue + 0.5f, 0.f, 255.f));
+                }
+                continue;
+            }
+
+            // Box-Muller, every pair of words gives two samples
+            const uint32_t* words = (const uint32_t*)noise.data();
+            for (uint64_t k = 0; k < uRowBytes; k += 2)
+            {
+                const float u1 = (words[k] + 1.f) / 4294967296.f;
+                const float u2 = words[k + 1] / 4294967296.f;
+                const float fRadius = std::sqrt(-2.f * std::log(u1)) * amount;
+                const float fAngle = 6.2831853f * u2;
+
+                const float fFirst = row[k] + (fRadius * std::cos(fAngle));
+                row[k] = static_cast<uint8_t>(std::clamp(fFirst + 0.5f, 0.f, 255.f));
+
+                if (k + 1 < uRowBytes)
+                {
+                    const float fSecond = row[k + 1] + (fRadius * std::sin(fAngle));
+                    row[k + 1] = static_cast<uint8_t>(std::clamp(fSecond + 0.5f, 0.f, 255.f));
+                }
+            }
+        }
+        });
 }
 
 // -----------------------------------------------------------------------------
 void Bitmap::MakeItNegative()
 {
-    SWB_FOR_WHOLE_IMAGE_I_K
-        if (MappedPixel::IsInvalid(m_MappedImage.Pixel(i, k)))
-            continue;
-        
-        auto& p = m_MappedImage.Pixel(i, k);
-        
-        p.Red() = 255 - p.Red();
-        p.Green() = 255 - p.Green();
-        p.Blue() = 255 - p.Blue();
-    SWB_FOR_WHOLE_IMAGE_I_K_END
+    ApplyLut(ToneLut::Negative());
 }
 
 // -----------------------------------------------------------------------------
-void SWBitmaps::Bitmap::MakeItGrayScale()
+void SWBitmaps::Bitmap::MakeItGrayScale(IN const LumaWeights& weights)
 {
-    SWB_FOR_WHOLE_IMAGE_I_K;
-        if (MappedPixel::IsInvalid(m_MappedImage.Pixel(i, k)))
-            continue;
+    if (!m_Header.Valid ||
+        m_Header.ColorDepth != 24)
+        return;
 
-        auto& p = m_MappedImage.Pixel(i, k);
-        uint8_t average = (static_cast<uint32_t>(p.Red()) + p.Green() + p.Blue()) / 3;
+    MarkModified();
 
-        p.Red() = average;
-        p.Green() = average;
-        p.Blue() = average;
-    SWB_FOR_WHOLE_IMAGE_I_K_END;
+    const uint64_t uWidth = GetWidth();
+
+    ParallelFor(0, GetHeight(), [&](uint64_t first, uint64_t last) {
+        std::vector<uint8_t> luma(uWidth);
+
+        for (uint64_t i = first; i < last; i++)
+        {
+            ComputeLumaRow(GetRow(i), luma.data(), uWidth, weights);
+            ExpandLumaRow(luma.data(), GetRow(i), uWidth);
+        }
+        });
+}
+
+// -----------------------------------------------------------------------------
+void Bitmap::ApplyLut(IN const ToneLut& lut)
+{
+    if (!m_Header.Valid ||
+        m_Header.ColorDepth != 24)
+        return;
+
+    MarkModified();
+
+    const uint64_t uWidth = GetWidth();
+
+    ParallelFor(0, GetHeight(), [&](uint64_t first, uint64_t last) {
+        for (uint64_t i = first; i < last; i++)
+            lut.ApplyRow(GetRow(i), uWidth);
+        });
+}
+
+// -----------------------------------------------------------------------------
+void Bitmap::BoxBlur(IN const uint32_t& radius)
+{
+    if (!m_Header.Valid ||
+        m_Header.ColorDepth != 24 ||
+        radius == 0)
+        return;
+
+    // Not the cached one, the blur changes every pixel it was built from,
+    // and only sums are needed
+    IntegralImage sat;
+    sat.Build(*this, false);
+    const uint64_t uWidth = GetWidth();
+    const uint64_t uHeight = GetHeight();
+
+    // Windows are clipped at the edges, every pixel is a single table lookup
+    ParallelFor(0, uHeight, [&](uint64_t first, uint64_t last) {
+        for (uint64_t i = first; i < last; i++)
+        {
+            const uint64_t y = i > radius ? i - radius : 0;
+            const uint64_t h = std::min<uint64_t>(i + radius + 1, uHeight) - y;
+            uint8_t* row = GetRow(i);
+
+            for (uint64_t k = 0; k < uWidth; k++)
+            {
+                const uint64_t x = k > radius ? k - radius : 0;
+                const uint64_t w = std::min<uint64_t>(k + radius + 1, uWidth) - x;
+                const uint64_t uArea = w * h;
+
+                for (uint8_t c = 0; c < 3; c++)
+                    row[(k * 3) + c] = static_cast<uint8_t>((sat.Sum(2 - c, x, y, w, h) + (uArea / 2)) / uArea);
+            }
+        }
+        });
+
+    MarkModified();
+}
+
+// -----------------------------------------------------------------------------
+void Bitmap::DetectEdges(IN const EdgeOperator& op)
+{
+    if (!m_Header.Valid ||
+        m_Header.ColorDepth != 24)
+        return;
+
+    const uint64_t uWidth = GetWidth();
+    const uint64_t uStride = uWidth + 2;
+    const std::vector<uint8_t> luma = ComputeLumaPlane(1, BT601);
+
+    MarkModified();
+
+    ParallelFor(0, GetHeight(), [&](uint64_t first, uint64_t last) {
+        std::vector<uint8_t> magnitude(uWidth);
+
+        for (uint64_t i = first; i < last; i++)
+        {
+            // Row i of the image is row i + 1 of the plane
+            const uint8_t* row = &luma[((i + 1) * uStride) + 1];
+
+            EdgeMagnitudeRow(row - uStride, row, row + uStride, magnitude.data(), uWidth, op);
+            ExpandLumaRow(magnitude.data(), GetRow(i), uWidth);
+        }
+        });
+}
+
+// -----------------------------------------------------------------------------
+uint8_t Bitmap::ThresholdOtsu(IN const LumaWeights& weights)
+{
+    if (!m_Header.Valid ||
+        m_Header.ColorDepth != 24)
+        return 0;
+
+    const uint64_t uWidth = GetWidth();
+    const std::vector<uint8_t> luma = ComputeLumaPlane(0, weights);
+
+    std::mutex mutex;
+    uint64_t histogram[256] = {};
+
+    ParallelFor(0, luma.size(), [&](uint64_t first, uint64_t last) {
+        uint64_t local[256] = {};
+        for (uint64_t k = first; k < last; k++)
+            local[luma[k]]++;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        for (uint16_t v = 0; v < 256; v++)
+            histogram[v] += local[v];
+        }, 1 << 16);
+
+    const uint8_t uThreshold = OtsuThreshold(histogram);
+
+    MarkModified();
+
+    ParallelFor(0, GetHeight(), [&](uint64_t first, uint64_t last) {
+        std::vector<uint8_t> binary(uWidth);
+
+        for (uint64_t i = first; i < last; i++)
+        {
+            const uint8_t* src = &luma[i * uWidth];
+            for (uint64_t k = 0; k < uWidth; k++)
+                binary[k] = src[k] > uThreshold ? 255 : 0;
+
+            ExpandLumaRow(binary.data(), GetRow(i), uWidth);
+        }
+        });
+
+    return uThreshold;
+}
+
+// -----------------------------------------------------------------------------
+void Bitmap::ThresholdAdaptive(IN const uint32_t& radius, 
+    IN const int32_t& offset, 
+    IN const LumaWeights& weights)
+{
+    if (!m_Header.Valid ||
+        m_Header.ColorDepth != 24)
+        return;
+
+    const uint64_t uWidth = GetWidth();
+    const uint64_t uHeight = GetHeight();
+    const std::vector<uint8_t> luma = ComputeLumaPlane(0, weights);
+
+    MarkModified();
+
+    // Every chunk sets up its column sums once, then slides them down a row at a time
+    ParallelFor(0, uHeight, [&](uint64_t first, uint64_t last) {
+        std::vector<uint32_t> sums(uWidth, 0);
+        std::vector<uint8_t> binary(uWidth);
+
+        // One row above the window, the first step drops it
+        uint64_t uTop = first > radius ? first - radius - 1 : 0;
+        uint64_t uBottom = std::min<uint64_t>(first + radius, uHeight);
+
+        for (uint64_t y = uTop; y < uBottom; y++)
+            AccumulateColumns(sums.data(), &luma[y * uWidth], uWidth, false);
+
+        for (uint64_t i = first; i < last; i++)
+        {
+            // Window is rows [i - radius, i + radius]
+            if (i + radius < uHeight)
+                AccumulateColumns(sums.data(), &luma[uBottom++ * uWidth], uWidth, false);
+
+            if (i > radius)
+                AccumulateColumns(sums.data(), &luma[uTop++ * uWidth], uWidth, true);
+
+            AdaptiveThresholdRow(&luma[i * uWidth], sums.data(), binary.data(), uWidth, uBottom - uTop, radius, offset);
+            ExpandLumaRow(binary.data(), GetRow(i), uWidth);
+        }
+        });
 }
 
 // -----------------------------------------------------------------------------
@@ -199,21 +749,125 @@ void SWBitmaps::Bitmap::DeleteShadows()
     
 }
 
-// Private ---------------------------------------------------------------------
+// -----------------------------------------------------------------------------
+void Bitmap::MarkModified()
+{
+    m_uGeneration = ++s_uGenerationCounter;
+}
 
 // -----------------------------------------------------------------------------
-void Bitmap::LoadFromPath()
+ImagePyramid& Bitmap::GetPyramid() const
+{
+    std::lock_guard<std::mutex> lock(s_CacheMutex);
+
+    if (!m_pPyramid)
+        m_pPyramid = std::make_shared<ImagePyramid>(*this);
+
+    return *m_pPyramid;
+}
+
+// -----------------------------------------------------------------------------
+std::shared_ptr<const IntegralImage> Bitmap::GetIntegralImage(IN const bool& squares) const
 {
-    if (m_Path.find(L'.') != std::wstring::npos)
+    auto usable = [&](const std::shared_ptr<const IntegralImage>& sat) {
+        return sat &&
+            sat->IsValid() &&
+            sat->GetGeneration() == m_uGeneration &&
+            (!squares || sat->HasSquares());
+        };
+
     {
-        wchar_t fileExt[8];
-        wcscpy_s(fileExt, m_Path.substr(m_Path.find_last_of('.')).c_str());
-        _wcslwr_s(fileExt);
-        if (!wcscmp(fileExt, L"bmp"))
-            return;
+        std::lock_guard<std::mutex> lock(s_CacheMutex);
+
+        if (usable(m_pIntegralImage))
+            return m_pIntegralImage;
     }
 
-    std::ifstream file(m_Path,
+    // Built outside of the lock, other bitmaps don't wait for it. 
+    // Two threads can both build one, either result is right
+    auto sat = std::make_shared<IntegralImage>();
+    sat->Build(*this, squares);
+
+    std::lock_guard<std::mutex> lock(s_CacheMutex);
+
+    if (!usable(m_pIntegralImage))
+        m_pIntegralImage = sat;
+
+    return sat;
+}
+
+// -----------------------------------------------------------------------------
+uint64_t Bitmap::ComputeHash(IN const HashKind& kind) const
+{
+    return ComputePerceptualHash(*this, kind);
+}
+
+// -----------------------------------------------------------------------------
+bool Bitmap::CopyPixels(IN const Bitmap& source)
+{
+    // The sign of the height is the row order, it has to match too
+    if (!m_Header.Valid ||
+        !source.m_Header.Valid ||
+        m_Header.Width != source.m_Header.Width ||
+        m_Header.Height != source.m_Header.Height ||
+        m_Header.ColorDepth != source.m_Header.ColorDepth ||
+        m_Header.CompressionMethod != source.m_Header.CompressionMethod)
+        return false;
+
+    MarkModified();
+    memcpy(GetRow(0), source.GetRow(0), GetPitch() * GetHeight());
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+bool Bitmap::HasBgrLayout(IN const BitmapHeader& header)
+{
+    if (header.CompressionMethod == 0)
+        return header.ColorDepth == 24 || header.ColorDepth == 32;
+
+    return header.ColorDepth == 32 &&
+        header.CompressionMethod == 3 &&
+        header.BlueMask == 0x000000FF &&
+        header.GreenMask == 0x0000FF00 &&
+        header.RedMask == 0x00FF0000 &&
+        (header.AlphaMask == 0 || header.AlphaMask == 0xFF000000);
+}
+
+// -----------------------------------------------------------------------------
+bool Bitmap::HasAlpha(IN const BitmapHeader& header)
+{
+    return HasBgrLayout(header) && header.CompressionMethod == 3 && header.AlphaMask == 0xFF000000;
+}
+
+// -----------------------------------------------------------------------------
+BitmapHeader Bitmap::PeekHeader(IN const std::wstring& path)
+{
+    std::ifstream file(std::filesystem::path(path), std::ios_base::binary | std::ios_base::in);
+    if (!file.is_open())
+        return {};
+
+    char buffer[BITMAPMASKSEND] = {};
+    file.read(buffer, BITMAPMASKSEND);
+    if (file.gcount() < 14)
+        return {};
+
+    Bitmap peek;
+    peek.m_ImageBuff = buffer;
+    peek.m_uSizeOfBuff = file.gcount();
+    peek.ReadHeader();
+    peek.m_ImageBuff = nullptr;
+    peek.m_uSizeOfBuff = 0;
+
+    return peek.m_Header;
+}
+
+// Private ---------------------------------------------------------------------
+
+// -----------------------------------------------------------------------------
+void Bitmap::LoadFromPath()
+{
+    std::ifstream file(std::filesystem::path(m_Path),
         std::ios_base::binary | std::ios_base::in | std::ios_base::ate);
 
     if (!file.is_open())
@@ -225,7 +879,7 @@ void Bitmap::LoadFromPath()
     uint64_t endOfFile = file.tellg();
 
     m_uSizeOfBuff = sizeof(char) * endOfFile;
-    m_ImageBuff = (char*) malloc(m_uSizeOfBuff);
+    m_ImageBuff = BufferPool::Get().Acquire(m_uSizeOfBuff, false);
 
     file.seekg(std::ios_base::beg);
 
@@ -241,6 +895,139 @@ void Bitmap::LoadFromPath()
     m_Header.Valid = true;
 }
 
+// -----------------------------------------------------------------------------
+void Bitmap::LoadRegionFromPath(IN BitmapRegion region, 
+    IN const uint32_t& stepX, 
+    IN const uint32_t& stepY)
+{
+    m_Header.Valid = false;
+
+    if (stepX == 0 || stepY == 0)
+        return;
+
+    std::ifstream file(std::filesystem::path(m_Path),
+        std::ios_base::binary | std::ios_base::in | std::ios_base::ate);
+
+    if (!file.is_open())
+        return;
+
+    const uint64_t endOfFile = file.tellg();
+    if (endOfFile < BITMAPINFOHEADER)
+        return;
+
+    // Only the headers are read up front, bit field masks included
+    m_uSizeOfBuff = std::min<uint64_t>(endOfFile, BITMAPMASKSEND);
+    m_ImageBuff = (char*) malloc(m_uSizeOfBuff);
+    if (!m_ImageBuff)
+        throw std::bad_alloc();
+
+    file.seekg(0, std::ios_base::beg);
+    file.read(m_ImageBuff, m_uSizeOfBuff);
+
+    ReadHeader();
+    free(m_ImageBuff);
+    m_ImageBuff = nullptr;
+    m_uSizeOfBuff = 0;
+
+    // Pixels start at FileBeginOffset, whatever header and palette come before them.
+    // Bit fields are uncompressed too, rows of less than a byte per pixel aren't cut
+    if (!m_Header.Valid ||
+        m_Header.SizeOfHeader < BITMAPINFOHEADER - 14 ||
+        m_Header.FileBeginOffset < 14 + m_Header.SizeOfHeader ||
+        m_Header.FileBeginOffset > endOfFile ||
+        m_Header.Width <= 0 ||
+        m_Header.Height == std::numeric_limits<int32_t>::min() ||
+        (m_Header.CompressionMethod != 0 && m_Header.CompressionMethod != 3) ||
+        m_Header.ColorDepth == 0 ||
+        m_Header.ColorDepth % 8 != 0)
+    {
+        m_Header.Valid = false;
+        return;
+    }
+
+    const int64_t uImageHeight = std::abs(m_Header.Height);
+    const uint64_t uBytesPerPixel = m_Header.ColorDepth / 8;
+    const uint64_t uSourcePitch = GetPitch();
+
+    // Clamp the region to the image
+    region.X = std::clamp<int32_t>(region.X, 0, m_Header.Width);
+    region.Y = std::clamp<int32_t>(region.Y, 0, static_cast<int32_t>(uImageHeight));
+    if (region.Width <= 0 || (int64_t)region.X + region.Width > m_Header.Width)
+        region.Width = m_Header.Width - region.X;
+    if (region.Height <= 0 || (int64_t)region.Y + region.Height > uImageHeight)
+        region.Height = static_cast<int32_t>(uImageHeight - region.Y);
+
+    // Region is counted from the top, rows of a bottom-up file go the other way
+    const bool bBottomUp = m_Header.Height > 0;
+    const uint64_t uLastFileRow = bBottomUp ? uImageHeight - region.Y : region.Y + region.Height;
+
+    if (region.Width <= 0 || region.Height <= 0 ||
+        m_Header.FileBeginOffset + uLastFileRow * uSourcePitch > endOfFile)
+    {
+        m_Header.Valid = false;
+        return;
+    }
+
+    // New header --------------------
+
+    const int32_t uNewWidth = (region.Width + stepX - 1) / stepX;
+    const int32_t uNewHeight = (region.Height + stepY - 1) / stepY;
+
+    m_Header.Width = uNewWidth;
+    m_Header.Height = m_Header.Height < 0 ? -uNewHeight : uNewHeight;
+
+    const uint64_t uPitch = GetPitch();
+    m_Header.ImageSize = static_cast<uint32_t>(uPitch * uNewHeight);
+    m_Header.FileSize = m_Header.ImageSize + m_Header.FileBeginOffset;
+
+    m_uSizeOfBuff = sizeof(char) * m_Header.FileSize;
+    m_ImageBuff = BufferPool::Get().Acquire(m_uSizeOfBuff, true);
+
+    // Everything before the pixels, palette or extra header fields included
+    file.seekg(0, std::ios_base::beg);
+    file.read(m_ImageBuff, m_Header.FileBeginOffset);
+    MakeHeader();
+
+    // Rows ---------------------------
+
+    // Only the bytes between the first and the last needed pixel of a row
+    const uint64_t uSpan = ((uint64_t)(uNewWidth - 1) * stepX + 1) * uBytesPerPixel;
+    std::vector<char> rowBuff(stepX == 1 ? 0 : uSpan);
+
+    for (int64_t i = 0; i < uNewHeight; i++)
+    {
+        const uint64_t uViewedRow = region.Y + ((bBottomUp ? uNewHeight - 1 - i : i) * stepY);
+        const uint64_t uSourceRow = bBottomUp ? uImageHeight - 1 - uViewedRow : uViewedRow;
+        char* dst = m_ImageBuff + m_Header.FileBeginOffset + (i * uPitch);
+
+        file.seekg(m_Header.FileBeginOffset 
+            + (uSourceRow * uSourcePitch) 
+            + (region.X * uBytesPerPixel), std::ios_base::beg);
+
+        if (stepX == 1)
+        {
+            file.read(dst, uSpan);
+            continue;
+        }
+
+        file.read(rowBuff.data(), uSpan);
+        for (int64_t k = 0; k < uNewWidth; k++)
+        {
+            memcpy(dst + (k * uBytesPerPixel), 
+                &rowBuff[k * stepX * uBytesPerPixel], 
+                uBytesPerPixel);
+        }
+    }
+
+    if (!file)
+    {
+        m_Header.Valid = false;
+        return;
+    }
+
+    file.close();
+}
+
 #define CAST_READ_JUMP(loadTo, dataType, buffer, jumpVal)   \
 loadTo = *((dataType*)&buffer[jumpVal]);                    \
 jumpVal += sizeof(dataType);
@@ -259,7 +1046,9 @@ void Bitmap::ReadHeader()
     m_Header.FileSize = *((uint32_t*)(&m_ImageBuff[2]));
     m_Header.FileBeginOffset = *((uint32_t*)&m_ImageBuff[10]);
 
-    if (m_Header.FileBeginOffset == BITMAPINFOHEADER)
+    // BITMAPV4HEADER and BITMAPV5HEADER start the same way, 32-bit images with alpha use them
+    if (m_uSizeOfBuff >= BITMAPINFOHEADER &&
+        *((uint32_t*)&m_ImageBuff[14]) >= BITMAPINFOHEADER - 14)
     {
         uint8_t jump = 14;
         CAST_READ_JUMP(m_Header.SizeOfHeader, uint32_t, m_ImageBuff, jump);
@@ -273,8 +1062,35 @@ void Bitmap::ReadHeader()
         CAST_READ_JUMP(m_Header.VerticalResolution, int32_t, m_ImageBuff, jump);
         CAST_READ_JUMP(m_Header.ColorsInPalete, uint32_t, m_ImageBuff, jump);
         CAST_READ_JUMP(m_Header.ImportantColorsUsed, uint32_t, m_ImageBuff, jump);
+
+        if (m_Header.CompressionMethod == 3 && m_uSizeOfBuff >= BITMAPMASKSEND - 4)
+        {
+            CAST_READ_JUMP(m_Header.RedMask, uint32_t, m_ImageBuff, jump);
+            CAST_READ_JUMP(m_Header.GreenMask, uint32_t, m_ImageBuff, jump);
+            CAST_READ_JUMP(m_Header.BlueMask, uint32_t, m_ImageBuff, jump);
+
+            // The macro is two statements
+            if (m_Header.SizeOfHeader >= 56 && m_uSizeOfBuff >= BITMAPMASKSEND)
+            {
+                CAST_READ_JUMP(m_Header.AlphaMask, uint32_t, m_ImageBuff, jump);
+            }
+        }
+        return;
+    }
+}
+
+// -----------------------------------------------------------------------------
+void Bitmap::ReleaseBuffer(IN char* buffer, IN const uint64_t& size, IN const bool& shared)
+{
+    if (!shared)
+    {
+        BufferPool::Get().Release(buffer, size);
         return;
     }
+
+#ifndef _WIN32
+    munmap(buffer, size);
+#endif // _WIN32
 }
 
 // -----------------------------------------------------------------------------
@@ -284,13 +1100,9 @@ void Bitmap::MapImage()
     const uint8_t countDownNullVal = -1;
     uint8_t countDown = countDownNullVal;
     
-    // https://en.wikipedia.org/wiki/BMP_file_format#Pixel_storage
-
-    // 'Possible loss of data' is my second name
-#pragma warning ( push )
-#pragma warning ( disable : 4244 )
-    const uint64_t calcWidth = std::floorl((((m_Header.ColorDepth * m_Header.Width) + 31) / 32)) * 4;
-#pragma warning ( pop )
+    const uint64_t calcWidth = GetPitch();
+    // Alpha of 32-bit pixels isn't mapped
+    const uint8_t uBytesPerPixel = m_Header.ColorDepth == 32 ? 4 : 3;
 
     uint64_t row = 0;
     for (uint64_t i = m_Header.FileBeginOffset; 
@@ -304,7 +1116,7 @@ void Bitmap::MapImage()
             countDown = countDownNullVal;
         }
 
-        if (countDown >= 3)
+        if (countDown >= uBytesPerPixel)
         {
             m_MappedImage.PushBackPixel();
             countDown = 0;
@@ -323,6 +1135,9 @@ void Bitmap::MapImage()
             m_MappedImage.LastPixel().SetRedRef((uint8_t&)m_ImageBuff[i]);
             break;
 
+        case 3:
+            break;
+
         default:
             throw;
         }
@@ -336,27 +1151,153 @@ jumpVal += sizeof(dataType);
 // -----------------------------------------------------------------------------
 void SWBitmaps::Bitmap::MakeHeader()
 {
-    m_ImageBuff[0] = 'B';
-    m_ImageBuff[1] = 'M';
+    MakeHeader(m_Header, m_ImageBuff);
+}
+
+// -----------------------------------------------------------------------------
+void SWBitmaps::Bitmap::MakeHeader(IN const BitmapHeader& header, IN char* buffer)
+{
+    buffer[0] = 'B';
+    buffer[1] = 'M';
 
-    *(uint32_t*)(&m_ImageBuff[2]) = m_Header.FileSize;
-    *(uint32_t*)(&m_ImageBuff[6]) = 0;
-    *(uint32_t*)(&m_ImageBuff[10]) = m_Header.FileBeginOffset;
+    *(uint32_t*)(&buffer[2]) = header.FileSize;
+    *(uint32_t*)(&buffer[6]) = 0;
+    *(uint32_t*)(&buffer[10]) = header.FileBeginOffset;
 
-    if (m_Header.FileBeginOffset == BITMAPINFOHEADER)
+    // Palettized images keep the palette between the header and the pixels.
+    // V4 and V5 headers start like the 40-byte one, the rest of them stays
+    if (header.FileBeginOffset >= BITMAPINFOHEADER &&
+        header.SizeOfHeader >= BITMAPINFOHEADER - 14)
     {
         uint8_t jump = 14;
-        CAST_WRITE_JUMP(m_Header.SizeOfHeader, uint32_t, m_ImageBuff, jump);
-        CAST_WRITE_JUMP(m_Header.Width, int32_t, m_ImageBuff, jump);
-        CAST_WRITE_JUMP(m_Header.Height, int32_t, m_ImageBuff, jump);
-        CAST_WRITE_JUMP(m_Header.ColorPlanes, uint16_t, m_ImageBuff, jump);
-        CAST_WRITE_JUMP(m_Header.ColorDepth, uint16_t, m_ImageBuff, jump);
-        CAST_WRITE_JUMP(m_Header.CompressionMethod, uint32_t, m_ImageBuff, jump);
-        CAST_WRITE_JUMP(m_Header.ImageSize, uint32_t, m_ImageBuff, jump);
-        CAST_WRITE_JUMP(m_Header.HorizontalResolution, int32_t, m_ImageBuff, jump);
-        CAST_WRITE_JUMP(m_Header.VerticalResolution, int32_t, m_ImageBuff, jump);
-        CAST_WRITE_JUMP(m_Header.ColorsInPalete, uint32_t, m_ImageBuff, jump);
-        CAST_WRITE_JUMP(m_Header.ImportantColorsUsed, uint32_t, m_ImageBuff, jump);
+        CAST_WRITE_JUMP(header.SizeOfHeader, uint32_t, buffer, jump);
+        CAST_WRITE_JUMP(header.Width, int32_t, buffer, jump);
+        CAST_WRITE_JUMP(header.Height, int32_t, buffer, jump);
+        CAST_WRITE_JUMP(header.ColorPlanes, uint16_t, buffer, jump);
+        CAST_WRITE_JUMP(header.ColorDepth, uint16_t, buffer, jump);
+        CAST_WRITE_JUMP(header.CompressionMethod, uint32_t, buffer, jump);
+        CAST_WRITE_JUMP(header.ImageSize, uint32_t, buffer, jump);
+        CAST_WRITE_JUMP(header.HorizontalResolution, int32_t, buffer, jump);
+        CAST_WRITE_JUMP(header.VerticalResolution, int32_t, buffer, jump);
+        CAST_WRITE_JUMP(header.ColorsInPalete, uint32_t, buffer, jump);
+        CAST_WRITE_JUMP(header.ImportantColorsUsed, uint32_t, buffer, jump);
         return;
     }
 }
+
+// -----------------------------------------------------------------------------
+std::vector<uint8_t> Bitmap::ComputeLumaPlane(IN const uint64_t& padding, IN const LumaWeights& weights) const
+{
+    const uint64_t uWidth = GetWidth();
+    const uint64_t uHeight = GetHeight();
+    const uint64_t uStride = uWidth + (2 * padding);
+
+    std::vector<uint8_t> plane(uStride * (uHeight + (2 * padding)));
+
+    ParallelFor(0, uHeight, [&](uint64_t first, uint64_t last) {
+        for (uint64_t i = first; i < last; i++)
+        {
+            uint8_t* row = &plane[((i + padding) * uStride) + padding];
+            ComputeLumaRow(GetRow(i), row, uWidth, weights);
+
+            for (uint64_t p = 1; p <= padding; p++)
+            {
+                row[-static_cast<int64_t>(p)] = row[0];
+                row[uWidth - 1 + p] = row[uWidth - 1];
+            }
+        }
+        });
+
+    // Top and bottom padding repeat the outer rows
+    for (uint64_t p = 0; p < padding; p++)
+    {
+        memcpy(&plane[p * uStride], &plane[padding * uStride], uStride);
+        memcpy(&plane[(uHeight + padding + p) * uStride], &plane[(uHeight + padding - 1) * uStride], uStride);
+    }
+
+    return plane;
+}
+
+// -----------------------------------------------------------------------------
+bool SWBitmaps::Bitmap::SaveQuantized(IN const std::wstring& path, 
+    IN const uint16_t& colorDepth, 
+    IN const DitherMode& dither)
+{
+    if (!m_Header.Valid ||
+        m_Header.ColorDepth != 24)
+        return false;
+
+    Quantizer quantizer;
+    quantizer.Initialize(*this, 1 << colorDepth);
+
+    std::vector<uint8_t> indices;
+    quantizer.Map(*this, dither, indices);
+    if (indices.empty())
+        return false;
+
+    const uint64_t uWidth = GetWidth();
+    return SaveIndexed(path, colorDepth, quantizer.GetPalette(), [&](uint64_t i, uint8_t* dst) {
+        const uint8_t* src = &indices[i * uWidth];
+
+        if (colorDepth == 8)
+        {
+            memcpy(dst, src, uWidth);
+            return;
+        }
+
+        // Two pixels per byte, the first one in the high nibble
+        for (uint64_t k = 0; k < uWidth; k++)
+            dst[k / 2] |= (k & 1) ? src[k] : (src[k] << 4);
+        });
+}
+
+// -----------------------------------------------------------------------------
+bool SWBitmaps::Bitmap::SaveIndexed(IN const std::wstring& path,
+    IN const uint16_t& colorDepth,
+    IN const std::vector<Color>& palette,
+    IN const std::function<void(uint64_t i, uint8_t* dst)>& packRow)
+{
+    if (!m_Header.Valid)
+        return false;
+
+    const uint64_t uHeight = GetHeight();
+    const uint64_t uPitch = CalcPitch(colorDepth, m_Header.Width);
+
+    BitmapHeader header = m_Header;
+    header.SizeOfHeader = BITMAPINFOHEADER - 14;
+    header.ColorPlanes = 1;
+    header.ColorDepth = colorDepth;
+    header.CompressionMethod = 0;
+    header.ColorsInPalete = static_cast<uint32_t>(palette.size());
+    header.ImportantColorsUsed = 0;
+    header.FileBeginOffset = static_cast<uint32_t>(BITMAPINFOHEADER + (palette.size() * 4));
+    header.ImageSize = static_cast<uint32_t>(uPitch * uHeight);
+    header.FileSize = header.FileBeginOffset + header.ImageSize;
+
+    std::vector<char> output(header.FileSize, 0);
+    MakeHeader(header, output.data());
+
+    // Palette entries are stored as BGRA
+    for (size_t i = 0; i < palette.size(); i++)
+    {
+        output[BITMAPINFOHEADER + (i * 4)] = palette[i].Blue;
+        output[BITMAPINFOHEADER + (i * 4) + 1] = palette[i].Green;
+        output[BITMAPINFOHEADER + (i * 4) + 2] = palette[i].Red;
+    }
+
+    uint8_t* pixels = (uint8_t*)output.data() + header.FileBeginOffset;
+    ParallelFor(0, uHeight, [&](uint64_t first, uint64_t last) {
+        for (uint64_t i = first; i < last; i++)
+            packRow(i, pixels + (i * uPitch));
+        });
+
+    std::ofstream file(std::filesystem::path(path),
+        std::ios_base::binary | std::ios_base::out);
+
+    if (!file.is_open())
+        return false;
+
+    file.write(output.data(), output.size());
+    file.close();
+    return file.good();
+}
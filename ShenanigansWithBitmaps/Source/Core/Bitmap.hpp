@@ -1,5 +1,10 @@
 #pragma once
 
+#include "Luma.hpp"
+#include "Edges.hpp"
+#include "Resample.hpp"
+#include "BufferPool.hpp"
+
 #define BITMAP_CHUNK 4096
 
 #pragma region Predeclarations
@@ -9,6 +14,13 @@ namespace SWHexEditor
     class Session;
 }
 
+namespace SWBitmaps
+{
+    class ToneLut;
+    class ImagePyramid;
+    class IntegralImage;
+}
+
 #pragma endregion
 
 
@@ -212,8 +224,52 @@ namespace SWBitmaps
     
 #pragma region Headers types 
     #define BITMAPINFOHEADER (14 + 40)
+    // BI_BITFIELDS masks follow the first 40 bytes of the info header, 
+    // inside a V4 or V5 header or right after a 40-byte one
+    #define BITMAPMASKSEND (BITMAPINFOHEADER + 16)
 #pragma endregion
 
+    enum NoiseType
+    {
+        // Every channel moves by up to +-amount
+        Uniform,
+        // Every channel moves by a normal distribution with sigma = amount
+        Gaussian
+    };
+
+    enum SaveFormat
+    {
+        // Same layout as the loaded image
+        Native,
+        // 8-bit palettized grayscale
+        Gray8,
+        // Palettized with a computed palette of 256 colors
+        Palette8,
+        // Palettized with a computed palette of 16 colors
+        Palette4,
+        // 1-bit black and white, luma from 128 up is white
+        Mono1
+    };
+
+    enum DitherMode
+    {
+        NoDither,
+        // 8x8 Bayer matrix
+        Ordered,
+        // Error diffusion, rows run in parallel as a wavefront
+        FloydSteinberg
+    };
+
+    enum HashKind
+    {
+        // Brighter than the mean of 8x8
+        AHash,
+        // Brighter than the right neighbour in 9x8
+        DHash,
+        // Low frequencies of a 32x32 DCT
+        PHash
+    };
+
     struct BitmapHeader
     {
         bool Valid = false;
@@ -230,6 +286,22 @@ namespace SWBitmaps
         int32_t VerticalResolution = 0;
         uint32_t ColorsInPalete = 0;
         uint32_t ImportantColorsUsed = 0;
+        // Only for BI_BITFIELDS, alpha only with a header of at least 56 bytes
+        uint32_t RedMask = 0;
+        uint32_t GreenMask = 0;
+        uint32_t BlueMask = 0;
+        uint32_t AlphaMask = 0;
+    };
+
+    // X and Y count from the top left corner as the image is viewed, no matter the row order.
+    // Width or Height equal to 0 means "up to the end of the image", a region left
+    // empty after clamping to the image loads nothing and the bitmap is invalid.
+    struct BitmapRegion
+    {
+        int32_t X = 0;
+        int32_t Y = 0;
+        int32_t Width = 0;
+        int32_t Height = 0;
     };
 
     class Bitmap
@@ -241,6 +313,9 @@ namespace SWBitmaps
 
         Bitmap() = default;
 
+        // Buffers and caches that point back at the bitmap can't be shared
+        Bitmap(const Bitmap&) = delete;
+
         ~Bitmap()
         {
             Destroy();
@@ -253,21 +328,60 @@ namespace SWBitmaps
             m_Header = b.m_Header;
             m_uSizeOfBuff = b.m_uSizeOfBuff;
 
-            m_ImageBuff = (char*)malloc(sizeof(char) * m_uSizeOfBuff);
-            _memccpy(m_ImageBuff, b.m_ImageBuff, sizeof(char), m_uSizeOfBuff);
+            m_ImageBuff = BufferPool::Get().Acquire(m_uSizeOfBuff, false);
+            m_bSharedBuffer = false;
+            memcpy(m_ImageBuff, b.m_ImageBuff, m_uSizeOfBuff);
 
             m_MappedImage = b.m_MappedImage;
+
+            MarkModified();
         }
 
     public:
 
         void Initialize(IN const std::wstring& path);
 
+        // Blank 24-bit image, negative height gives top-down rows
+        void Initialize(IN const int32_t& width, IN const int32_t& height);
+
+        // Reads only the rows and columns of the region, every stepX-th column 
+        // and stepY-th row, the rest of the file is never touched. Headers and
+        // the palette are kept, pixels of less than a byte aren't supported
+        void Initialize(IN const std::wstring& path, 
+            IN const BitmapRegion& region, 
+            IN const uint32_t& stepX = 1, 
+            IN const uint32_t& stepY = 1);
+
+        // Maps a whole .bmp from a shm_open() segment or a descriptor like a memfd,
+        // the header is read in place. With 'inPlace' ops write straight to the 
+        // shared pages, otherwise the pages are copied on write and the source 
+        // stays as it was. Ops that change the size move the image to a private buffer.
+        bool InitializeFromSharedMemory(IN const std::string& name, IN const bool& inPlace = false);
+
+        bool InitializeFromFd(IN const int& fd, IN const bool& inPlace = false);
+
         void Destroy();
 
     public:
 
-        void SaveToFile(IN const std::wstring& path);
+        // False when nothing or only part of the file was written, a file 
+        // that can't be opened also invalidates the bitmap
+        bool SaveToFile(IN const std::wstring& path);
+
+        // Formats other than Native need a 24-bit image, false without writing anything otherwise
+        bool SaveToFile(IN const std::wstring& path, 
+            IN const SaveFormat& format, 
+            IN const LumaWeights& weights = BT601);
+
+        bool SaveToFile(IN const std::wstring& path,
+            IN const SaveFormat& format,
+            IN const DitherMode& dither);
+
+        // Nothing is written when the image is still mapped in place from the same 
+        // pages, otherwise the segment is resized to the image and overwritten
+        bool SaveToSharedMemory(IN const std::string& name);
+
+        bool SaveToFd(IN const int& fd);
 
     public:
 
@@ -275,6 +389,9 @@ namespace SWBitmaps
 
         void ScaleTo(uint32_t width, uint32_t height);
 
+        // Height of 0 keeps the aspect ratio, filters other than Nearest need a 24-bit image
+        void ScaleTo(IN const uint32_t& width, IN const uint32_t& height, IN const ScaleFilter& filter);
+
         void ColorWhole(IN Color c);
 
         void ColorHalf(IN Color c);
@@ -291,18 +408,105 @@ namespace SWBitmaps
 
         void MakeItRainbow();
 
+        // The same seed gives the same image, no matter the thread count
+        void MakeItRainbow(IN const uint64_t& seed);
+
+        void AddNoise(IN const NoiseType& type, IN const float& amount, IN const uint64_t& seed);
+
         void MakeItNegative();
 
-        void MakeItGrayScale();
+        void MakeItGrayScale(IN const LumaWeights& weights = Average);
+
+        void ApplyLut(IN const ToneLut& lut);
+
+        // Mean of a (2 * radius + 1) square window, read from the integral image
+        void BoxBlur(IN const uint32_t& radius);
+
+        // Gray gradient magnitude of the luma, edges of the image are replicated
+        void DetectEdges(IN const EdgeOperator& op = Sobel);
+
+        // Black and white split at the Otsu level of the luma histogram, returns the level
+        uint8_t ThresholdOtsu(IN const LumaWeights& weights = BT601);
+
+        // Black and white against the mean luma of a (2 * radius + 1) square window,
+        // clipped at the edges. Positive 'offset' turns more of the flat areas white.
+        void ThresholdAdaptive(IN const uint32_t& radius, 
+            IN const int32_t& offset, 
+            IN const LumaWeights& weights = BT601);
 
         void DeleteShadows();
 
+        uint64_t ComputeHash(IN const HashKind& kind) const;
+
+        // Copies the pixels of 'source' over these when both have the same size
+        // and depth, a buffer mapped in place stays mapped
+        bool CopyPixels(IN const Bitmap& source);
+
+        // Anything that writes pixels through GetRow() or the raw buffer 
+        // has to call this, cached data derived from pixels is keyed by generation
+        void MarkModified();
+
+        // Created on first use and lives as long as the bitmap, it reads the 
+        // bitmap, so it's never handed out on its own. Levels follow the generation
+        ImagePyramid& GetPyramid() const;
+
+        // Rebuilt on first use after the generation changes, into a new 
+        // table, so one that is still held elsewhere is never touched.
+        // Sums of squares only when asked for, a cached table without them is rebuilt
+        std::shared_ptr<const IntegralImage> GetIntegralImage(IN const bool& squares = false) const;
+
     public:
 
         // Getters -------------------------------------------------------------
 
         const bool& IsValid() const { return m_Header.Valid; }
 
+        const BitmapHeader& GetHeader() const { return m_Header; }
+
+        const std::wstring& GetPath() const { return m_Path; }
+
+        const uint64_t& GetGeneration() const { return m_uGeneration; }
+
+        // Pixels are exactly what is in the file at GetPath()
+        bool IsAsLoaded() const { return m_Header.Valid && m_uGeneration == m_uLoadedGeneration; }
+
+        // Pixels live in pages shared with another process
+        bool IsShared() const { return m_bSharedBuffer; }
+
+        // Ops change the pages of the other process, not a copy of them
+        bool IsWritingThrough() const { return m_bSharedBuffer && m_bWritesThrough; }
+
+        uint64_t GetWidth() const { return m_Header.Width; }
+
+        uint64_t GetHeight() const { return std::abs(m_Header.Height); }
+
+        // Rows are in file order
+        uint8_t* GetRow(IN const uint64_t& i) { return (uint8_t*)m_ImageBuff + m_Header.FileBeginOffset + (i * GetPitch()); }
+
+        const uint8_t* GetRow(IN const uint64_t& i) const { return (const uint8_t*)m_ImageBuff + m_Header.FileBeginOffset + (i * GetPitch()); }
+
+        uint64_t GetPitch() const { return CalcPitch(m_Header.ColorDepth, m_Header.Width); }
+
+        // Reads only the headers, nothing is kept
+        static BitmapHeader PeekHeader(IN const std::wstring& path);
+
+        // 24-bit BI_RGB, or 32-bit pixels of B, G, R and a fourth byte, 
+        // either BI_RGB or bit fields in that order
+        static bool HasBgrLayout(IN const BitmapHeader& header);
+
+        // The fourth byte of 32-bit pixels is alpha only when the bit fields say so,
+        // BI_RGB leaves it reserved and it's commonly 0
+        static bool HasAlpha(IN const BitmapHeader& header);
+
+        // Writes the file header and BITMAPINFOHEADER of 'header' to the start of 'buffer'
+        static void MakeHeader(IN const BitmapHeader& header, IN char* buffer);
+
+        // https://en.wikipedia.org/wiki/BMP_file_format#Pixel_storage
+        static uint64_t CalcPitch(IN const uint16_t& colorDepth, IN const int64_t& width)
+        {
+            return (((colorDepth * width) + 31) / 32) * 4;
+        }
+
     private:
 
         // Private, for friend class -------------------------------------------
@@ -315,20 +519,54 @@ namespace SWBitmaps
 
         void LoadFromPath();
 
+        void LoadRegionFromPath(IN BitmapRegion region, 
+            IN const uint32_t& stepX, 
+            IN const uint32_t& stepY);
+
         void ReadHeader();
 
+        // Unmaps shared buffers, everything else goes back to the pool
+        void ReleaseBuffer(IN char* buffer, IN const uint64_t& size, IN const bool& shared);
+
         void MapImage();
 
         void MakeHeader();
 
+        // Luma of all rows with 'padding' replicated pixels around, 
+        // rows of the plane are (width + 2 * padding) long
+        std::vector<uint8_t> ComputeLumaPlane(IN const uint64_t& padding, IN const LumaWeights& weights) const;
+
+        bool SaveQuantized(IN const std::wstring& path, 
+            IN const uint16_t& colorDepth, 
+            IN const DitherMode& dither);
+
+        // Writes a palettized bitmap, 'packRow' fills a zeroed row 
+        // of the output with packed palette indices of the row 'i'
+        bool SaveIndexed(IN const std::wstring& path,
+            IN const uint16_t& colorDepth,
+            IN const std::vector<Color>& palette,
+            IN const std::function<void(uint64_t i, uint8_t* dst)>& packRow);
+
     private:
 
         std::wstring m_Path = L"";
 
         uint64_t m_uSizeOfBuff = 0;
         char* m_ImageBuff = nullptr;
+
+        // File behind a mapped buffer, to spot saves into the same pages.
+        // Only a shared mapping writes through to it
+        bool m_bSharedBuffer = false;
+        bool m_bWritesThrough = false;
+        uint64_t m_uSharedDevice = 0;
+        uint64_t m_uSharedInode = 0;
         
         BitmapHeader m_Header = {};
         PixelMapWrapper m_MappedImage = {};
+
+        uint64_t m_uGeneration = 0;
+        uint64_t m_uLoadedGeneration = std::numeric_limits<uint64_t>::max();
+        mutable std::shared_ptr<ImagePyramid> m_pPyramid = nullptr;
+        mutable std::shared_ptr<const IntegralImage> m_pIntegralImage = nullptr;
     };
 }
@@ -0,0 +1,115 @@
+#include "Pch.h"
+
+#include "BufferPool.hpp"
+
+#define BUFFER_POOL_GRANULARITY (64 * 1024)
+
+// -----------------------------------------------------------------------------
+SWBitmaps::BufferPool& SWBitmaps::BufferPool::Get()
+{
+    static BufferPool pool;
+    return pool;
+}
+
+// -----------------------------------------------------------------------------
+SWBitmaps::BufferPool::~BufferPool()
+{
+    for (auto& sizeClass : m_Free)
+        for (auto& buffer : sizeClass.second)
+            free(buffer);
+}
+
+// -----------------------------------------------------------------------------
+char* SWBitmaps::BufferPool::Acquire(IN const uint64_t& size, IN const bool& zero)
+{
+    const uint64_t uClass = SizeClass(size);
+    char* buffer = nullptr;
+
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        auto it = m_Free.find(uClass);
+        if (it != m_Free.end() && !it->second.empty())
+        {
+            buffer = it->second.back();
+            it->second.pop_back();
+            m_uPooledBytes -= uClass;
+        }
+    }
+
+    if (buffer)
+    {
+        m_uHits++;
+        if (zero)
+            memset(buffer, 0, size);
+        return buffer;
+    }
+
+    m_uMisses++;
+    buffer = (char*)(zero ? calloc(uClass, sizeof(char)) : malloc(uClass));
+    if (!buffer)
+        throw std::bad_alloc();
+
+    return buffer;
+}
+
+// -----------------------------------------------------------------------------
+void SWBitmaps::BufferPool::Release(IN char* buffer, IN const uint64_t& size)
+{
+    if (!buffer)
+        return;
+
+    const uint64_t uClass = SizeClass(size);
+
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        if (m_uPooledBytes + uClass <= m_uCapacity.load())
+        {
+            m_Free[uClass].push_back(buffer);
+            m_uPooledBytes += uClass;
+            return;
+        }
+    }
+
+    free(buffer);
+}
+
+// -----------------------------------------------------------------------------
+uint64_t SWBitmaps::BufferPool::GetPooledBytes() const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    return m_uPooledBytes;
+}
+
+// -----------------------------------------------------------------------------
+void SWBitmaps::BufferPool::SetCapacity(IN const uint64_t& bytes)
+{
+    m_uCapacity.store(bytes);
+    Trim();
+}
+
+// Private ---------------------------------------------------------------------
+
+// -----------------------------------------------------------------------------
+uint64_t SWBitmaps::BufferPool::SizeClass(IN const uint64_t& size)
+{
+    return std::max<uint64_t>(1, (size + BUFFER_POOL_GRANULARITY - 1) / BUFFER_POOL_GRANULARITY) * BUFFER_POOL_GRANULARITY;
+}
+
+// -----------------------------------------------------------------------------
+void SWBitmaps::BufferPool::Trim()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    for (auto& sizeClass : m_Free)
+    {
+        while (m_uPooledBytes > m_uCapacity.load() && !sizeClass.second.empty())
+        {
+            free(sizeClass.second.back());
+            sizeClass.second.pop_back();
+            m_uPooledBytes -= sizeClass.first;
+        }
+    }
+}
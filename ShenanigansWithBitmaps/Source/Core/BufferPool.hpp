@@ -0,0 +1,63 @@
+#pragma once
+
+namespace SWBitmaps
+{
+    // Pixel buffers of every Bitmap, released ones are kept up to the 
+    // capacity so the next image of the same size skips the page faults.
+    // Capacity starts at 0, which frees everything right away.
+    class BufferPool
+    {
+    public:
+
+        static BufferPool& Get();
+
+    public:
+
+        // At least 'size' bytes, 'zero' clears them
+        char* Acquire(IN const uint64_t& size, IN const bool& zero);
+
+        // 'size' is the one the buffer was acquired with
+        void Release(IN char* buffer, IN const uint64_t& size);
+
+    public:
+
+        // Getters -------------------------------------------------------------
+
+        uint64_t GetCapacity() const { return m_uCapacity.load(); }
+
+        uint64_t GetPooledBytes() const;
+
+        uint64_t GetHits() const { return m_uHits.load(); }
+
+        uint64_t GetMisses() const { return m_uMisses.load(); }
+
+    public:
+
+        // Setters -------------------------------------------------------------
+
+        // Frees pooled buffers over the new capacity
+        void SetCapacity(IN const uint64_t& bytes);
+
+    private:
+
+        BufferPool() = default;
+
+        ~BufferPool();
+
+        // Sizes are rounded up, so any buffer of a class fits every request of it
+        static uint64_t SizeClass(IN const uint64_t& size);
+
+        void Trim();
+
+    private:
+
+        mutable std::mutex m_Mutex;
+        std::unordered_map<uint64_t, std::vector<char*>> m_Free;
+        uint64_t m_uPooledBytes = 0;
+
+        std::atomic<uint64_t> m_uCapacity = 0;
+        std::atomic<uint64_t> m_uHits = 0;
+        std::atomic<uint64_t> m_uMisses = 0;
+
+    };
+}
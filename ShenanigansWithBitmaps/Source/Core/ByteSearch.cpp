@@ -0,0 +1,144 @@
+#include "Pch.h"
+
+#include "ByteSearch.hpp"
+
+#define SEARCH_CHUNK (4 * 1024 * 1024)
+
+// -----------------------------------------------------------------------------
+// Reports every match that starts in [first, last), 
+// last + pattern.size() - 1 can't go past the data
+static void ScanRange(IN const uint8_t* data, 
+    IN uint64_t first, 
+    IN const uint64_t& last,
+    IN const std::vector<uint8_t>& pattern,
+    IN const std::function<void(uint64_t offset)>& onHit)
+{
+    const uint64_t uLength = pattern.size();
+    const uint8_t* p = pattern.data();
+
+    if (uLength == 1)
+    {
+        while (first < last)
+        {
+            const void* hit = memchr(data + first, p[0], last - first);
+            if (!hit)
+                return;
+
+            first = (const uint8_t*)hit - data;
+            onHit(first++);
+        }
+        return;
+    }
+
+    auto verify = [&](uint64_t i) {
+        if (uLength <= 2 || 
+            memcmp(data + i + 1, p + 1, uLength - 2) == 0)
+            onHit(i);
+    };
+
+#if defined(SWB_AVX2)
+    const __m256i firstByte = _mm256_set1_epi8((char)p[0]);
+    const __m256i lastByte = _mm256_set1_epi8((char)p[uLength - 1]);
+
+    for (; first + 32 <= last; first += 32)
+    {
+        const __m256i a = _mm256_loadu_si256((const __m256i*)(data + first));
+        const __m256i b = _mm256_loadu_si256((const __m256i*)(data + first + uLength - 1));
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, firstByte), _mm256_cmpeq_epi8(b, lastByte)));
+
+        while (mask)
+        {
+            verify(first + std::countr_zero(mask));
+            mask &= mask - 1;
+        }
+    }
+#elif defined(SWB_SSE2)
+    const __m128i firstByte = _mm_set1_epi8((char)p[0]);
+    const __m128i lastByte = _mm_set1_epi8((char)p[uLength - 1]);
+
+    for (; first + 16 <= last; first += 16)
+    {
+        const __m128i a = _mm_loadu_si128((const __m128i*)(data + first));
+        const __m128i b = _mm_loadu_si128((const __m128i*)(data + first + uLength - 1));
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, firstByte), _mm_cmpeq_epi8(b, lastByte)));
+
+        while (mask)
+        {
+            verify(first + std::countr_zero(mask));
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    for (; first < last; first++)
+    {
+        if (data[first] == p[0] && 
+            data[first + uLength - 1] == p[uLength - 1])
+            verify(first);
+    }
+}
+
+// -----------------------------------------------------------------------------
+bool SWHexEditor::ParseHexPattern(IN const std::string& text, IN std::vector<uint8_t>& pattern)
+{
+    pattern.clear();
+
+    int16_t high = -1;
+    for (auto& c : text)
+    {
+        if (c == ' ')
+            continue;
+
+        int16_t digit;
+        if (c >= '0' && c <= '9')
+            digit = c - '0';
+        else if (c >= 'a' && c <= 'f')
+            digit = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            digit = c - 'A' + 10;
+        else
+            return false;
+
+        if (high < 0)
+        {
+            high = digit;
+            continue;
+        }
+
+        pattern.push_back(static_cast<uint8_t>((high << 4) | digit));
+        high = -1;
+    }
+
+    return high < 0 && !pattern.empty();
+}
+
+// -----------------------------------------------------------------------------
+bool SWHexEditor::FindAll(IN const uint8_t* data, 
+    IN const uint64_t& size, 
+    IN const std::vector<uint8_t>& pattern,
+    IN const std::function<void(uint64_t offset)>& onHit,
+    IN const std::function<void(uint64_t scanned)>& onProgress,
+    IN const std::atomic_bool& cancel)
+{
+    if (pattern.empty() || 
+        pattern.size() > size)
+    {
+        onProgress(size);
+        return true;
+    }
+
+    // Last offset a match can start at, plus one
+    const uint64_t uStarts = size - pattern.size() + 1;
+
+    for (uint64_t i = 0; i < uStarts; i += SEARCH_CHUNK)
+    {
+        if (cancel.load(std::memory_order_relaxed))
+            return false;
+
+        ScanRange(data, i, std::min<uint64_t>(i + SEARCH_CHUNK, uStarts), pattern, onHit);
+        onProgress(std::min<uint64_t>(i + SEARCH_CHUNK, size));
+    }
+
+    onProgress(size);
+    return true;
+}
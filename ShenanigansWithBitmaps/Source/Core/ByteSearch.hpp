@@ -0,0 +1,19 @@
+#pragma once
+
+namespace SWHexEditor
+{
+    // Hex digits with optional spaces, "4D 42" or "4d42"
+    bool ParseHexPattern(IN const std::string& text, IN std::vector<uint8_t>& pattern);
+
+    // Calls onHit() with the offset of every occurrence, overlapping ones too, 
+    // in increasing order. Candidates are filtered by the first and the last byte 
+    // of the pattern a whole vector at a time, only those are compared in full.
+    // The data is scanned in chunks, after each one onProgress() gets the number 
+    // of bytes done and 'cancel' is checked. False if it was cancelled.
+    bool FindAll(IN const uint8_t* data, 
+        IN const uint64_t& size, 
+        IN const std::vector<uint8_t>& pattern,
+        IN const std::function<void(uint64_t offset)>& onHit,
+        IN const std::function<void(uint64_t scanned)>& onProgress,
+        IN const std::atomic_bool& cancel);
+}
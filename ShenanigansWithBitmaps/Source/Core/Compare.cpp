@@ -0,0 +1,339 @@
+#include "Pch.h"
+
+#include "Compare.hpp"
+#include "Parallel.hpp"
+#include "Simd.hpp"
+
+using namespace SWBitmaps;
+
+#define COMPARE_SSIM_WINDOW 8
+#define COMPARE_SSIM_C1 (0.01 * 255 * 0.01 * 255)
+#define COMPARE_SSIM_C2 (0.03 * 255 * 0.03 * 255)
+
+// Per thread partial results, channels in memory order BGR
+struct ErrorSums
+{
+    uint8_t Max[3] = { 0, 0, 0 };
+    uint64_t Squares[3] = { 0, 0, 0 };
+};
+
+// Sums of one SSIM window
+struct WindowSums
+{
+    uint32_t A = 0;
+    uint32_t B = 0;
+    uint32_t AA = 0;
+    uint32_t BB = 0;
+    uint32_t AB = 0;
+};
+
+// -----------------------------------------------------------------------------
+// Row 'v' as the image is viewed, from the top, to the row in file order
+static inline const uint8_t* ViewedRow(IN const Bitmap& bitmap, IN const uint64_t& v)
+{
+    return bitmap.GetRow(bitmap.GetHeader().Height > 0 ? bitmap.GetHeight() - 1 - v : v);
+}
+
+// -----------------------------------------------------------------------------
+// Black -> red -> yellow -> white
+static Color HeatColor(IN const uint8_t& v)
+{
+    const int32_t scaled = v * 3;
+
+    return {
+        static_cast<uint8_t>(std::min(scaled, 255)),
+        static_cast<uint8_t>(std::clamp(scaled - 255, 0, 255)),
+        static_cast<uint8_t>(std::clamp(scaled - 510, 0, 255)) };
+}
+
+#ifdef SWB_SSSE3
+// -----------------------------------------------------------------------------
+static inline __m128i AbsDiff(IN const __m128i& a, IN const __m128i& b)
+{
+    return _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+}
+
+// -----------------------------------------------------------------------------
+static inline __m128i SquareSum(IN const __m128i& d)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i lo = _mm_unpacklo_epi8(d, zero);
+    const __m128i hi = _mm_unpackhi_epi8(d, zero);
+
+    return _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi));
+}
+
+// -----------------------------------------------------------------------------
+static inline uint64_t HorizontalSum(IN const __m128i& v)
+{
+    alignas(16) uint32_t lanes[4];
+    _mm_store_si128((__m128i*) lanes, v);
+
+    return (uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+// -----------------------------------------------------------------------------
+static inline uint8_t HorizontalMax(IN const __m128i& v)
+{
+    alignas(16) uint8_t lanes[16];
+    _mm_store_si128((__m128i*) lanes, v);
+
+    return *std::max_element(std::begin(lanes), std::end(lanes));
+}
+#endif // SWB_SSSE3
+
+// -----------------------------------------------------------------------------
+static void CompareRow(IN const uint8_t* a, 
+    IN const uint8_t* b, 
+    IN const uint64_t& width, 
+    IN ErrorSums& sums, 
+    IN uint8_t* heat)
+{
+    uint64_t k = 0;
+
+#ifdef SWB_SSSE3
+    // Every iteration adds up to 4 * 255^2 per lane, 
+    // flush before the 32-bit lanes can overflow
+    const uint64_t uFlushEvery = 4096;
+
+    while (k + 16 <= width)
+    {
+        __m128i maxB = _mm_setzero_si128(), maxG = _mm_setzero_si128(), maxR = _mm_setzero_si128();
+        __m128i sqB = _mm_setzero_si128(), sqG = _mm_setzero_si128(), sqR = _mm_setzero_si128();
+
+        for (uint64_t n = 0; n < uFlushEvery && k + 16 <= width; n++, k += 16)
+        {
+            __m128i ab, ag, ar, bb, bg, br;
+            Simd::LoadBgr16(&a[k * 3], ab, ag, ar);
+            Simd::LoadBgr16(&b[k * 3], bb, bg, br);
+
+            const __m128i dB = AbsDiff(ab, bb);
+            const __m128i dG = AbsDiff(ag, bg);
+            const __m128i dR = AbsDiff(ar, br);
+
+            maxB = _mm_max_epu8(maxB, dB);
+            maxG = _mm_max_epu8(maxG, dG);
+            maxR = _mm_max_epu8(maxR, dR);
+
+            sqB = _mm_add_epi32(sqB, SquareSum(dB));
+            sqG = _mm_add_epi32(sqG, SquareSum(dG));
+            sqR = _mm_add_epi32(sqR, SquareSum(dR));
+
+            if (heat)
+                _mm_storeu_si128((__m128i*) &heat[k], _mm_max_epu8(_mm_max_epu8(dB, dG), dR));
+        }
+
+        sums.Max[0] = std::max(sums.Max[0], HorizontalMax(maxB));
+        sums.Max[1] = std::max(sums.Max[1], HorizontalMax(maxG));
+        sums.Max[2] = std::max(sums.Max[2], HorizontalMax(maxR));
+
+        sums.Squares[0] += HorizontalSum(sqB);
+        sums.Squares[1] += HorizontalSum(sqG);
+        sums.Squares[2] += HorizontalSum(sqR);
+    }
+#endif // SWB_SSSE3
+
+    for (; k < width; k++)
+    {
+        uint8_t uMax = 0;
+        for (uint8_t c = 0; c < 3; c++)
+        {
+            const uint8_t d = static_cast<uint8_t>(std::abs(a[k * 3 + c] - b[k * 3 + c]));
+            sums.Max[c] = std::max(sums.Max[c], d);
+            sums.Squares[c] += static_cast<uint64_t>(d) * d;
+            uMax = std::max(uMax, d);
+        }
+
+        if (heat)
+            heat[k] = uMax;
+    }
+}
+
+// -----------------------------------------------------------------------------
+// Adds one luma row to the sums of consecutive windows
+static void AccumulateWindows(IN const uint8_t* a, 
+    IN const uint8_t* b, 
+    IN const uint64_t& windows, 
+    IN WindowSums* sums)
+{
+    uint64_t w = 0;
+
+#ifdef SWB_SSE2
+    // Two windows per 16 bytes, sad gives a sum for each 8 byte half
+    const __m128i zero = _mm_setzero_si128();
+
+    for (; w + 2 <= windows; w += 2)
+    {
+        const __m128i va = _mm_loadu_si128((const __m128i*) &a[w * COMPARE_SSIM_WINDOW]);
+        const __m128i vb = _mm_loadu_si128((const __m128i*) &b[w * COMPARE_SSIM_WINDOW]);
+
+        alignas(16) uint64_t sumA[2], sumB[2];
+        _mm_store_si128((__m128i*) sumA, _mm_sad_epu8(va, zero));
+        _mm_store_si128((__m128i*) sumB, _mm_sad_epu8(vb, zero));
+
+        const __m128i a0 = _mm_unpacklo_epi8(va, zero), a1 = _mm_unpackhi_epi8(va, zero);
+        const __m128i b0 = _mm_unpacklo_epi8(vb, zero), b1 = _mm_unpackhi_epi8(vb, zero);
+
+        alignas(16) uint32_t aa[2][4], bb[2][4], ab[2][4];
+        _mm_store_si128((__m128i*) aa[0], _mm_madd_epi16(a0, a0));
+        _mm_store_si128((__m128i*) aa[1], _mm_madd_epi16(a1, a1));
+        _mm_store_si128((__m128i*) bb[0], _mm_madd_epi16(b0, b0));
+        _mm_store_si128((__m128i*) bb[1], _mm_madd_epi16(b1, b1));
+        _mm_store_si128((__m128i*) ab[0], _mm_madd_epi16(a0, b0));
+        _mm_store_si128((__m128i*) ab[1], _mm_madd_epi16(a1, b1));
+
+        for (uint8_t h = 0; h < 2; h++)
+        {
+            WindowSums& s = sums[w + h];
+            s.A += static_cast<uint32_t>(sumA[h]);
+            s.B += static_cast<uint32_t>(sumB[h]);
+            s.AA += aa[h][0] + aa[h][1] + aa[h][2] + aa[h][3];
+            s.BB += bb[h][0] + bb[h][1] + bb[h][2] + bb[h][3];
+            s.AB += ab[h][0] + ab[h][1] + ab[h][2] + ab[h][3];
+        }
+    }
+#endif // SWB_SSE2
+
+    for (; w < windows; w++)
+    {
+        WindowSums& s = sums[w];
+        for (uint8_t k = 0; k < COMPARE_SSIM_WINDOW; k++)
+        {
+            const uint32_t va = a[(w * COMPARE_SSIM_WINDOW) + k];
+            const uint32_t vb = b[(w * COMPARE_SSIM_WINDOW) + k];
+
+            s.A += va;
+            s.B += vb;
+            s.AA += va * va;
+            s.BB += vb * vb;
+            s.AB += va * vb;
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+static double WindowSsim(IN const WindowSums& s)
+{
+    const double n = COMPARE_SSIM_WINDOW * COMPARE_SSIM_WINDOW;
+    const double meanA = s.A / n;
+    const double meanB = s.B / n;
+    const double varA = (s.AA / n) - (meanA * meanA);
+    const double varB = (s.BB / n) - (meanB * meanB);
+    const double covariance = (s.AB / n) - (meanA * meanB);
+
+    return (((2 * meanA * meanB) + COMPARE_SSIM_C1) * ((2 * covariance) + COMPARE_SSIM_C2)) /
+        (((meanA * meanA) + (meanB * meanB) + COMPARE_SSIM_C1) * (varA + varB + COMPARE_SSIM_C2));
+}
+
+// -----------------------------------------------------------------------------
+CompareResult SWBitmaps::Compare(IN const Bitmap& a, 
+    IN const Bitmap& b, 
+    IN Bitmap* heatmap)
+{
+    CompareResult result;
+
+    if (!a.IsValid() || !b.IsValid() ||
+        a.GetHeader().ColorDepth != 24 || b.GetHeader().ColorDepth != 24 ||
+        a.GetWidth() != b.GetWidth() || a.GetHeight() != b.GetHeight())
+        return result;
+
+    const uint64_t uWidth = a.GetWidth();
+    const uint64_t uHeight = a.GetHeight();
+
+    if (heatmap)
+    {
+        heatmap->Destroy();
+        heatmap->Initialize(static_cast<int32_t>(uWidth), static_cast<int32_t>(uHeight));
+    }
+
+    // Errors -------------------------
+
+    // Rows are paired as viewed, the inputs and the heatmap may each be stored either way up
+
+    ErrorSums total;
+    std::mutex totalMutex;
+
+    ParallelFor(0, uHeight, [&](uint64_t first, uint64_t last) {
+        ErrorSums local;
+        std::vector<uint8_t> heat(heatmap ? uWidth : 0);
+
+        for (uint64_t i = first; i < last; i++)
+        {
+            CompareRow(ViewedRow(a, i), ViewedRow(b, i), uWidth, local, heatmap ? heat.data() : nullptr);
+            if (!heatmap)
+                continue;
+
+            uint8_t* dst = heatmap->GetRow(heatmap->GetHeader().Height > 0 ? uHeight - 1 - i : i);
+            for (uint64_t k = 0; k < uWidth; k++)
+            {
+                const Color c = HeatColor(heat[k]);
+                dst[k * 3] = c.Blue;
+                dst[k * 3 + 1] = c.Green;
+                dst[k * 3 + 2] = c.Red;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(totalMutex);
+        for (uint8_t c = 0; c < 3; c++)
+        {
+            total.Max[c] = std::max(total.Max[c], local.Max[c]);
+            total.Squares[c] += local.Squares[c];
+        }
+        });
+
+    const double fPixels = static_cast<double>(uWidth * uHeight);
+    for (uint8_t c = 0; c < 3; c++)
+    {
+        // Sums are BGR, result is RGB
+        result.MaxAbsError[2 - c] = total.Max[c];
+        result.Mse[2 - c] = total.Squares[c] / fPixels;
+        result.Psnr[2 - c] = total.Squares[c] ? 
+            10.0 * std::log10((255.0 * 255.0) / result.Mse[2 - c]) : 
+            std::numeric_limits<double>::infinity();
+    }
+
+    // SSIM ---------------------------
+
+    const uint64_t uWindowsX = uWidth / COMPARE_SSIM_WINDOW;
+    const uint64_t uWindowsY = uHeight / COMPARE_SSIM_WINDOW;
+
+    if (!uWindowsX || !uWindowsY)
+    {
+        // Too small for a single window
+        result.Ssim = total.Squares[0] + total.Squares[1] + total.Squares[2] ? 0 : 1;
+        result.Valid = true;
+        return result;
+    }
+
+    double fSsimSum = 0;
+    std::mutex ssimMutex;
+
+    ParallelFor(0, uWindowsY, [&](uint64_t first, uint64_t last) {
+        std::vector<uint8_t> lumaA(uWidth), lumaB(uWidth);
+        std::vector<WindowSums> sums(uWindowsX);
+        double fLocal = 0;
+
+        for (uint64_t wy = first; wy < last; wy++)
+        {
+            std::fill(sums.begin(), sums.end(), WindowSums());
+
+            for (uint64_t i = wy * COMPARE_SSIM_WINDOW; i < (wy + 1) * COMPARE_SSIM_WINDOW; i++)
+            {
+                ComputeLumaRow(ViewedRow(a, i), lumaA.data(), uWidth, BT601);
+                ComputeLumaRow(ViewedRow(b, i), lumaB.data(), uWidth, BT601);
+                AccumulateWindows(lumaA.data(), lumaB.data(), uWindowsX, sums.data());
+            }
+
+            for (auto& s : sums)
+                fLocal += WindowSsim(s);
+        }
+
+        std::lock_guard<std::mutex> lock(ssimMutex);
+        fSsimSum += fLocal;
+        }, 1);
+
+    result.Ssim = fSsimSum / (uWindowsX * uWindowsY);
+    result.Valid = true;
+
+    return result;
+}
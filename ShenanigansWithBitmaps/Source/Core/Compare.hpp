@@ -0,0 +1,28 @@
+#pragma once
+
+#include "Bitmap.hpp"
+
+namespace SWBitmaps
+{
+    struct CompareResult
+    {
+        bool Valid = false;
+
+        // Channels are indexed the same way as in Color, 0 - Red, 1 - Green, 2 - Blue
+        uint8_t MaxAbsError[3] = { 0, 0, 0 };
+        double Mse[3] = { 0, 0, 0 };
+        // Infinity for identical channels
+        double Psnr[3] = { 0, 0, 0 };
+
+        // Mean SSIM of BT.601 luma over 8x8 windows
+        double Ssim = 0;
+    };
+
+    // Both images need the same size and must be 24-bit, padding is ignored.
+    // Pixels are matched as the images are viewed, bottom-up and top-down files compare equal.
+    // If 'heatmap' is given it's initialized with the largest channel 
+    // difference of every pixel, black - no difference, white - 255.
+    CompareResult Compare(IN const Bitmap& a, 
+        IN const Bitmap& b, 
+        IN Bitmap* heatmap = nullptr);
+}
@@ -0,0 +1,251 @@
+#include "Pch.h"
+
+#include "Composite.hpp"
+#include "Parallel.hpp"
+#include "Simd.hpp"
+
+using namespace SWBitmaps;
+
+// Alpha and opacity are in 1/256, so 256 is opaque and
+// d * (256 - a) + s * a never leaves unsigned 16 bits
+#define COMPOSITE_OPAQUE 256
+
+// -----------------------------------------------------------------------------
+// 0..255 to 0..256, 255 becomes exactly opaque
+static inline uint32_t ExpandAlpha(IN const uint32_t& a, IN const uint32_t& opacity)
+{
+    const uint32_t uAlpha = a + (a >> 7);
+    return opacity == COMPOSITE_OPAQUE ? uAlpha : (uAlpha * opacity + 128) >> 8;
+}
+
+// -----------------------------------------------------------------------------
+// s * d / 255, rounded
+static inline uint32_t MultiplyChannel(IN const uint32_t& s, IN const uint32_t& d)
+{
+    const uint32_t t = s * d + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+// -----------------------------------------------------------------------------
+template<BlendMode Mode>
+static inline uint32_t BlendChannel(IN const uint32_t& s, IN const uint32_t& d)
+{
+    if constexpr (Mode == BlendMultiply)
+        return MultiplyChannel(s, d);
+    else if constexpr (Mode == BlendScreen)
+        return s + d - MultiplyChannel(s, d);
+    else if constexpr (Mode == BlendAdd)
+        return std::min<uint32_t>(s + d, 255);
+    else
+        return s;
+}
+
+#ifdef SWB_SSSE3
+// -----------------------------------------------------------------------------
+static inline __m128i MultiplyChannels(IN const __m128i& s, IN const __m128i& d)
+{
+    const __m128i t = _mm_add_epi16(_mm_mullo_epi16(s, d), _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+// -----------------------------------------------------------------------------
+// The same formulas as BlendChannel(), on 8 channels in 16-bit lanes
+template<BlendMode Mode>
+static inline __m128i BlendChannels(IN const __m128i& s, IN const __m128i& d)
+{
+    if constexpr (Mode == BlendMultiply)
+        return MultiplyChannels(s, d);
+    else if constexpr (Mode == BlendScreen)
+        return _mm_sub_epi16(_mm_add_epi16(s, d), MultiplyChannels(s, d));
+    else if constexpr (Mode == BlendAdd)
+        return _mm_min_epi16(_mm_add_epi16(s, d), _mm_set1_epi16(255));
+    else
+        return s;
+}
+
+// -----------------------------------------------------------------------------
+// One plane of 16 pixels, alpha is in 16-bit lanes
+template<BlendMode Mode>
+static inline __m128i BlendPlane(IN const __m128i& s, IN const __m128i& d, IN const __m128i& aLo, IN const __m128i& aHi)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i opaque = _mm_set1_epi16(COMPOSITE_OPAQUE);
+    const __m128i half = _mm_set1_epi16(128);
+
+    const __m128i dLo = _mm_unpacklo_epi8(d, zero);
+    const __m128i dHi = _mm_unpackhi_epi8(d, zero);
+    const __m128i bLo = BlendChannels<Mode>(_mm_unpacklo_epi8(s, zero), dLo);
+    const __m128i bHi = BlendChannels<Mode>(_mm_unpackhi_epi8(s, zero), dHi);
+
+    const __m128i lo = _mm_add_epi16(_mm_add_epi16(
+        _mm_mullo_epi16(dLo, _mm_sub_epi16(opaque, aLo)), _mm_mullo_epi16(bLo, aLo)), half);
+    const __m128i hi = _mm_add_epi16(_mm_add_epi16(
+        _mm_mullo_epi16(dHi, _mm_sub_epi16(opaque, aHi)), _mm_mullo_epi16(bHi, aHi)), half);
+
+    return _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8));
+}
+#endif // SWB_SSSE3
+
+// -----------------------------------------------------------------------------
+template<BlendMode Mode>
+static void BlendRowOf(IN uint8_t* target,
+    IN const uint8_t* overlay,
+    IN const uint64_t& width,
+    IN const uint16_t& overlayDepth,
+    IN const bool& alpha,
+    IN const uint32_t& opacity)
+{
+    const uint64_t uStep = overlayDepth / 8;
+    const bool bAlpha = uStep == 4 && alpha;
+    uint64_t k = 0;
+
+#ifdef SWB_SSSE3
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i opacityLanes = _mm_set1_epi16(static_cast<int16_t>(opacity));
+
+    for (; k + 16 <= width; k += 16)
+    {
+        __m128i db, dg, dr, sb, sg, sr;
+        __m128i sa = _mm_setzero_si128();
+        __m128i aLo = opacityLanes;
+        __m128i aHi = opacityLanes;
+
+        Simd::LoadBgr16(&target[k * 3], db, dg, dr);
+
+        if (uStep == 4)
+            Simd::LoadBgra16(&overlay[k * 4], sb, sg, sr, sa);
+        else
+            Simd::LoadBgr16(&overlay[k * 3], sb, sg, sr);
+
+        if (bAlpha)
+        {
+            aLo = _mm_unpacklo_epi8(sa, zero);
+            aHi = _mm_unpackhi_epi8(sa, zero);
+            aLo = _mm_add_epi16(aLo, _mm_srli_epi16(aLo, 7));
+            aHi = _mm_add_epi16(aHi, _mm_srli_epi16(aHi, 7));
+
+            if (opacity != COMPOSITE_OPAQUE)
+            {
+                aLo = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(aLo, opacityLanes), _mm_set1_epi16(128)), 8);
+                aHi = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(aHi, opacityLanes), _mm_set1_epi16(128)), 8);
+            }
+        }
+
+        Simd::StoreBgr16(&target[k * 3],
+            BlendPlane<Mode>(sb, db, aLo, aHi),
+            BlendPlane<Mode>(sg, dg, aLo, aHi),
+            BlendPlane<Mode>(sr, dr, aLo, aHi));
+    }
+#endif // SWB_SSSE3
+
+    for (; k < width; k++)
+    {
+        const uint8_t* s = &overlay[k * uStep];
+        uint8_t* d = &target[k * 3];
+        const uint32_t uAlpha = bAlpha ? ExpandAlpha(s[3], opacity) : opacity;
+
+        for (uint8_t c = 0; c < 3; c++)
+        {
+            const uint32_t uBlended = BlendChannel<Mode>(s[c], d[c]);
+            d[c] = static_cast<uint8_t>((d[c] * (COMPOSITE_OPAQUE - uAlpha) + uBlended * uAlpha + 128) >> 8);
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+void SWBitmaps::BlendRow(IN uint8_t* target,
+    IN const uint8_t* overlay,
+    IN const uint64_t& width,
+    IN const uint16_t& overlayDepth,
+    IN const bool& alpha,
+    IN const uint32_t& opacity,
+    IN const BlendMode& mode)
+{
+    // Nothing to mix, the row is a plain copy
+    if (mode == BlendNormal && overlayDepth == 24 && opacity >= COMPOSITE_OPAQUE)
+    {
+        memcpy(target, overlay, width * 3);
+        return;
+    }
+
+    const uint32_t uOpacity = std::min<uint32_t>(opacity, COMPOSITE_OPAQUE);
+
+    switch (mode)
+    {
+    case BlendNormal:
+        BlendRowOf<BlendNormal>(target, overlay, width, overlayDepth, alpha, uOpacity);
+        return;
+
+    case BlendMultiply:
+        BlendRowOf<BlendMultiply>(target, overlay, width, overlayDepth, alpha, uOpacity);
+        return;
+
+    case BlendScreen:
+        BlendRowOf<BlendScreen>(target, overlay, width, overlayDepth, alpha, uOpacity);
+        return;
+
+    case BlendAdd:
+        BlendRowOf<BlendAdd>(target, overlay, width, overlayDepth, alpha, uOpacity);
+        return;
+
+    default:
+        throw;
+    }
+}
+
+// -----------------------------------------------------------------------------
+bool SWBitmaps::Composite(IN Bitmap& target,
+    IN const Bitmap& overlay,
+    IN const int64_t& x,
+    IN const int64_t& y,
+    IN const float& opacity,
+    IN const BlendMode& mode)
+{
+    // Targets of other depths or with compression 3 would have pixels of a different size
+    if (!target.IsValid() || !overlay.IsValid() ||
+        target.GetHeader().ColorDepth != 24 ||
+        target.GetHeader().CompressionMethod != 0 ||
+        !Bitmap::HasBgrLayout(overlay.GetHeader()))
+        return false;
+
+    const uint32_t uOpacity = static_cast<uint32_t>(std::lround(std::clamp(opacity, 0.f, 1.f) * COMPOSITE_OPAQUE));
+
+    const int64_t iTargetWidth = target.GetWidth();
+    const int64_t iTargetHeight = target.GetHeight();
+
+    // Visible part, in overlay coordinates
+    const int64_t iLeft = std::max<int64_t>(0, -x);
+    const int64_t iTop = std::max<int64_t>(0, -y);
+    const int64_t iRight = std::min<int64_t>(overlay.GetWidth(), iTargetWidth - x);
+    const int64_t iBottom = std::min<int64_t>(overlay.GetHeight(), iTargetHeight - y);
+
+    if (iLeft >= iRight || iTop >= iBottom || uOpacity == 0)
+        return true;
+
+    target.MarkModified();
+
+    const uint16_t uDepth = overlay.GetHeader().ColorDepth;
+    const bool bAlpha = Bitmap::HasAlpha(overlay.GetHeader());
+    const uint64_t uWidth = iRight - iLeft;
+    const bool bTargetBottomUp = target.GetHeader().Height > 0;
+    const bool bOverlayBottomUp = overlay.GetHeader().Height > 0;
+
+    ParallelFor(iTop, iBottom, [&](uint64_t first, uint64_t last) {
+        for (uint64_t v = first; v < last; v++)
+        {
+            // Viewed rows to file rows
+            const uint64_t uTargetRow = bTargetBottomUp ? iTargetHeight - 1 - (y + v) : y + v;
+            const uint64_t uOverlayRow = bOverlayBottomUp ? overlay.GetHeight() - 1 - v : v;
+
+            BlendRow(target.GetRow(uTargetRow) + (x + iLeft) * 3,
+                overlay.GetRow(uOverlayRow) + iLeft * (uDepth / 8),
+                uWidth,
+                uDepth,
+                bAlpha,
+                uOpacity,
+                mode);
+        }
+        });
+
+    return true;
+}
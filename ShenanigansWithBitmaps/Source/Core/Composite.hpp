@@ -0,0 +1,42 @@
+#pragma once
+
+#include "Bitmap.hpp"
+
+namespace SWBitmaps
+{
+    // Formulas of the overlay color s over the target color d,
+    // the result is then mixed with d by alpha
+    enum BlendMode
+    {
+        // s
+        BlendNormal,
+        // s * d / 255, only darkens
+        BlendMultiply,
+        // s + d - s * d / 255, only lightens
+        BlendScreen,
+        // s + d, saturated
+        BlendAdd
+    };
+
+    // Blends 'width' pixels of 'overlay' over the BGR row 'target'. 'overlayDepth' is 24,
+    // or 32 for BGRA pixels whose alpha is scaled by 'opacity', which is in 1/256.
+    // Without 'alpha' the fourth byte is skipped and the pixels are opaque.
+    void BlendRow(IN uint8_t* target,
+        IN const uint8_t* overlay,
+        IN const uint64_t& width,
+        IN const uint16_t& overlayDepth,
+        IN const bool& alpha,
+        IN const uint32_t& opacity,
+        IN const BlendMode& mode);
+
+    // Draws 'overlay' with its top left corner at x, y of 'target', both as the images
+    // are viewed no matter the row order. Parts outside of the target are clipped.
+    // Target must be 24-bit, overlay 24-bit or 32-bit BGR(A), opacity is in [0, 1].
+    // Only bit fields with an alpha mask give the overlay alpha.
+    bool Composite(IN Bitmap& target,
+        IN const Bitmap& overlay,
+        IN const int64_t& x,
+        IN const int64_t& y,
+        IN const float& opacity,
+        IN const BlendMode& mode);
+}
@@ -0,0 +1,185 @@
+#include "Pch.h"
+
+#include "Edges.hpp"
+
+using namespace SWBitmaps;
+
+// Scharr weights sum up to 16, Sobel ones to 4
+#define EDGES_SCHARR_SCALE 0.25f
+
+// -----------------------------------------------------------------------------
+void SWBitmaps::EdgeMagnitudeRow(IN const uint8_t* above,
+    IN const uint8_t* row,
+    IN const uint8_t* below,
+    IN uint8_t* magnitude,
+    IN const uint64_t& width,
+    IN const EdgeOperator& op)
+{
+    const int16_t iSide = op == Scharr ? 3 : 1;
+    const int16_t iCenter = op == Scharr ? 10 : 2;
+    const float fScale = op == Scharr ? EDGES_SCHARR_SCALE : 1.f;
+
+    uint64_t k = 0;
+
+#ifdef SWB_SSE2
+    // Gradients stay in 16 bits, the largest is 16 * 255
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i side = _mm_set1_epi16(iSide);
+    const __m128i center = _mm_set1_epi16(iCenter);
+    const __m128 scale = _mm_set1_ps(fScale);
+
+    auto load = [&](const uint8_t* src) {
+        return _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*) src), zero);
+    };
+
+    // side * a + center * b + side * c
+    auto weigh = [&](const __m128i& a, const __m128i& b, const __m128i& c) {
+        return _mm_add_epi16(_mm_mullo_epi16(_mm_add_epi16(a, c), side), _mm_mullo_epi16(b, center));
+    };
+
+    auto length = [&](const __m128i& x, const __m128i& y) {
+        const __m128 fx = _mm_cvtepi32_ps(x);
+        const __m128 fy = _mm_cvtepi32_ps(y);
+        return _mm_cvtps_epi32(_mm_mul_ps(_mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(fx, fx), _mm_mul_ps(fy, fy))), scale));
+    };
+
+    for (; k + 8 <= width; k += 8)
+    {
+        const __m128i a0 = load(&above[k - 1]), a1 = load(&above[k]), a2 = load(&above[k + 1]);
+        const __m128i r0 = load(&row[k - 1]), r2 = load(&row[k + 1]);
+        const __m128i b0 = load(&below[k - 1]), b1 = load(&below[k]), b2 = load(&below[k + 1]);
+
+        const __m128i gx = _mm_sub_epi16(weigh(a2, r2, b2), weigh(a0, r0, b0));
+        const __m128i gy = _mm_sub_epi16(weigh(b0, b1, b2), weigh(a0, a1, a2));
+
+        // Sign extension to 32 bits
+        const __m128i lo = length(_mm_srai_epi32(_mm_unpacklo_epi16(gx, gx), 16), _mm_srai_epi32(_mm_unpacklo_epi16(gy, gy), 16));
+        const __m128i hi = length(_mm_srai_epi32(_mm_unpackhi_epi16(gx, gx), 16), _mm_srai_epi32(_mm_unpackhi_epi16(gy, gy), 16));
+
+        _mm_storel_epi64((__m128i*) &magnitude[k], _mm_packus_epi16(_mm_packs_epi32(lo, hi), zero));
+    }
+#endif // SWB_SSE2
+
+    auto weigh1 = [&](int32_t a, int32_t b, int32_t c) {
+        return iSide * (a + c) + iCenter * b;
+    };
+
+    for (; k < width; k++)
+    {
+        const int32_t gx = weigh1(above[k + 1], row[k + 1], below[k + 1]) - weigh1(above[k - 1], row[k - 1], below[k - 1]);
+        const int32_t gy = weigh1(below[k - 1], below[k], below[k + 1]) - weigh1(above[k - 1], above[k], above[k + 1]);
+
+        // Same rounding as the vector path, to nearest even
+        const float fLength = std::sqrt(static_cast<float>(gx * gx + gy * gy)) * fScale;
+        magnitude[k] = static_cast<uint8_t>(std::min(255.f, std::nearbyint(fLength)));
+    }
+}
+
+// -----------------------------------------------------------------------------
+uint8_t SWBitmaps::OtsuThreshold(IN const uint64_t* histogram)
+{
+    uint64_t uTotal = 0;
+    double dSum = 0;
+
+    for (uint16_t v = 0; v < 256; v++)
+    {
+        uTotal += histogram[v];
+        dSum += static_cast<double>(v) * histogram[v];
+    }
+
+    if (uTotal == 0)
+        return 0;
+
+    uint64_t uDark = 0;
+    double dDarkSum = 0;
+    double dBest = -1;
+    uint8_t uThreshold = 0;
+
+    // Classes [0, t] and (t, 255]
+    for (uint16_t t = 0; t < 255; t++)
+    {
+        uDark += histogram[t];
+        dDarkSum += static_cast<double>(t) * histogram[t];
+
+        const uint64_t uBright = uTotal - uDark;
+        if (uDark == 0 || uBright == 0)
+            continue;
+
+        const double dDiff = dDarkSum / uDark - (dSum - dDarkSum) / uBright;
+        const double dBetween = static_cast<double>(uDark) * uBright * dDiff * dDiff;
+
+        if (dBetween > dBest)
+        {
+            dBest = dBetween;
+            uThreshold = static_cast<uint8_t>(t);
+        }
+    }
+
+    return uThreshold;
+}
+
+// -----------------------------------------------------------------------------
+void SWBitmaps::AccumulateColumns(IN uint32_t* sums,
+    IN const uint8_t* row,
+    IN const uint64_t& width,
+    IN const bool& subtract)
+{
+    uint64_t k = 0;
+
+#ifdef SWB_SSE2
+    const __m128i zero = _mm_setzero_si128();
+
+    for (; k + 16 <= width; k += 16)
+    {
+        const __m128i src = _mm_loadu_si128((const __m128i*) &row[k]);
+        const __m128i lo = _mm_unpacklo_epi8(src, zero);
+        const __m128i hi = _mm_unpackhi_epi8(src, zero);
+        const __m128i values[4] = {
+            _mm_unpacklo_epi16(lo, zero),
+            _mm_unpackhi_epi16(lo, zero),
+            _mm_unpacklo_epi16(hi, zero),
+            _mm_unpackhi_epi16(hi, zero) };
+
+        for (uint8_t j = 0; j < 4; j++)
+        {
+            __m128i* dst = (__m128i*) &sums[k + (j * 4)];
+            const __m128i sum = _mm_loadu_si128(dst);
+            _mm_storeu_si128(dst, subtract ? _mm_sub_epi32(sum, values[j]) : _mm_add_epi32(sum, values[j]));
+        }
+    }
+#endif // SWB_SSE2
+
+    for (; k < width; k++)
+        sums[k] = subtract ? sums[k] - row[k] : sums[k] + row[k];
+}
+
+// -----------------------------------------------------------------------------
+void SWBitmaps::AdaptiveThresholdRow(IN const uint8_t* luma,
+    IN const uint32_t* sums,
+    IN uint8_t* dst,
+    IN const uint64_t& width,
+    IN const uint64_t& rows,
+    IN const uint32_t& radius,
+    IN const int32_t& offset)
+{
+    // Running sum of columns [left, right)
+    uint64_t uLeft = 0;
+    uint64_t uRight = std::min<uint64_t>(radius, width);
+    uint64_t uSum = 0;
+
+    for (uint64_t k = 0; k < uRight; k++)
+        uSum += sums[k];
+
+    for (uint64_t k = 0; k < width; k++)
+    {
+        if (k + radius < width)
+            uSum += sums[uRight++];
+
+        if (k > radius)
+            uSum -= sums[uLeft++];
+
+        // luma > sum / area - offset, without the division
+        const int64_t iArea = static_cast<int64_t>((uRight - uLeft) * rows);
+        dst[k] = (static_cast<int64_t>(luma[k]) + offset) * iArea > static_cast<int64_t>(uSum) ? 255 : 0;
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+namespace SWBitmaps
+{
+    enum EdgeOperator
+    {
+        // [1 2 1] smoothing across the [-1 0 1] derivative
+        Sobel,
+        // [3 10 3], closer to rotation invariant, scaled to the range of Sobel
+        Scharr
+    };
+
+    // Gradient magnitude of the 3x3 neighbourhood of every pixel, clamped to 255. 
+    // Rows are padded, index -1 and 'width' of all three have to be readable.
+    void EdgeMagnitudeRow(IN const uint8_t* above,
+        IN const uint8_t* row,
+        IN const uint8_t* below,
+        IN uint8_t* magnitude,
+        IN const uint64_t& width,
+        IN const EdgeOperator& op);
+
+    // Level that best splits the histogram into two classes, the one
+    // maximizing the variance between them. Values above it are the bright class.
+    uint8_t OtsuThreshold(IN const uint64_t* histogram);
+
+    // Adds, or subtracts, a row of luma to per column sums of a sliding window
+    void AccumulateColumns(IN uint32_t* sums,
+        IN const uint8_t* row,
+        IN const uint64_t& width,
+        IN const bool& subtract);
+
+    // White where the luma is above the mean of its window less 'offset'. 'sums' are column
+    // sums over 'rows' rows, the window spans 'radius' columns to both sides, clipped at the edges.
+    void AdaptiveThresholdRow(IN const uint8_t* luma,
+        IN const uint32_t* sums,
+        IN uint8_t* dst,
+        IN const uint64_t& width,
+        IN const uint64_t& rows,
+        IN const uint32_t& radius,
+        IN const int32_t& offset);
+}
@@ -0,0 +1,97 @@
+#include "Pch.h"
+
+#include "FdPassing.hpp"
+
+// Upper bound of descriptors in one message
+#define FD_PASSING_MAX 16
+
+#ifndef _WIN32
+
+// -----------------------------------------------------------------------------
+bool SWBitmaps::SendWithFds(IN const int& socket, IN const std::string& data, IN const std::vector<int>& fds)
+{
+    if (fds.size() > FD_PASSING_MAX)
+        return false;
+
+    uint64_t i = 0;
+
+    if (!fds.empty())
+    {
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * FD_PASSING_MAX)] = {};
+        iovec io = { (void*)data.data(), data.size() };
+
+        msghdr message = {};
+        message.msg_iov = &io;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+
+        cmsghdr* header = CMSG_FIRSTHDR(&message);
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        header->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+        memcpy(CMSG_DATA(header), fds.data(), sizeof(int) * fds.size());
+
+        const ssize_t sent = sendmsg(socket, &message, MSG_NOSIGNAL);
+        if (sent <= 0)
+            return false;
+        i = sent;
+    }
+
+    for (; i < data.size(); )
+    {
+        const ssize_t sent = send(socket, data.data() + i, data.size() - i, MSG_NOSIGNAL);
+        if (sent <= 0)
+            return false;
+        i += sent;
+    }
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+int64_t SWBitmaps::ReceiveWithFds(IN const int& socket, IN char* buffer, IN const uint64_t& size, IN std::vector<int>& fds)
+{
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * FD_PASSING_MAX)] = {};
+    iovec io = { buffer, size };
+
+    msghdr message = {};
+    message.msg_iov = &io;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    const ssize_t received = recvmsg(socket, &message, MSG_CMSG_CLOEXEC);
+    if (received < 0)
+        return received;
+
+    for (cmsghdr* header = CMSG_FIRSTHDR(&message); header; header = CMSG_NXTHDR(&message, header))
+    {
+        if (header->cmsg_level != SOL_SOCKET ||
+            header->cmsg_type != SCM_RIGHTS)
+            continue;
+
+        const uint64_t uCount = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        const uint64_t uFirst = fds.size();
+        fds.resize(uFirst + uCount);
+        memcpy(fds.data() + uFirst, CMSG_DATA(header), sizeof(int) * uCount);
+    }
+
+    return received;
+}
+
+#else
+
+// -----------------------------------------------------------------------------
+bool SWBitmaps::SendWithFds(IN const int& socket, IN const std::string& data, IN const std::vector<int>& fds)
+{
+    return false;
+}
+
+// -----------------------------------------------------------------------------
+int64_t SWBitmaps::ReceiveWithFds(IN const int& socket, IN char* buffer, IN const uint64_t& size, IN std::vector<int>& fds)
+{
+    return -1;
+}
+
+#endif // _WIN32
@@ -0,0 +1,13 @@
+#pragma once
+
+namespace SWBitmaps
+{
+    // Descriptors sent over a Unix domain socket arrive with the bytes of 
+    // the same send, so a request line and its memfd travel together
+
+    // Sends all of 'data', 'fds' go with the first part of it
+    bool SendWithFds(IN const int& socket, IN const std::string& data, IN const std::vector<int>& fds);
+
+    // Like recv(), received descriptors are appended to 'fds' and owned by the caller
+    int64_t ReceiveWithFds(IN const int& socket, IN char* buffer, IN const uint64_t& size, IN std::vector<int>& fds);
+}
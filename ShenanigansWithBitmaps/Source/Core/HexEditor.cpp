@@ -2,16 +2,85 @@
 
 #include "HexEditor.hpp"
 #include "Bitmap.hpp"
+#include "TerminalRenderer.hpp"
+#include "ByteSearch.hpp"
+
+#define SEARCH_MAX_STORED_HITS (1 << 22)
+#define PAGE_ROWS 28
+#define PREVIEW_COLUMNS 48
+
+// Text of every byte value, space padded to 2 hex or 3 decimal digits
+struct ByteCells
+{
+    char Hex[256][2] = {};
+    char Dec[256][3] = {};
+
+    ByteCells()
+    {
+        const char digits[] = "0123456789ABCDEF";
+
+        for (uint16_t v = 0; v < 256; v++)
+        {
+            Hex[v][0] = v < 16 ? ' ' : digits[v >> 4];
+            Hex[v][1] = digits[v & 15];
+
+            Dec[v][0] = v < 100 ? ' ' : static_cast<char>('0' + (v / 100));
+            Dec[v][1] = v < 10 ? ' ' : static_cast<char>('0' + ((v / 10) % 10));
+            Dec[v][2] = static_cast<char>('0' + (v % 10));
+        }
+    }
+};
+
+static const ByteCells s_ByteCells;
 
 // -----------------------------------------------------------------------------
 void SWHexEditor::Session::Start()
 {
+    m_bRedraw = true;
+
     StartUserControls();
+    if (!m_UserControlThreadSwitch.load())
+        return;
+
+    // Whole image is read once here, edits only recompute the cells they touch
+    m_Preview.Build(*m_pTargetBitmap, PREVIEW_COLUMNS, PAGE_ROWS);
+
+    // Lines are drawn in place, so the cursor is hidden for the whole session
+    TerminalRenderer::Present("\x1b[?25l");
+    ClearScreen();
 }
 
 // -----------------------------------------------------------------------------
 void SWHexEditor::Session::UpdateSession()
 {
+    uint32_t uSeen = m_uSignal.load();
+    while (m_Commands.IsEmpty() && 
+        m_UserControlThreadSwitch.load() && 
+        !m_bSearchUpdated.load() &&
+        !m_bRedraw)
+    {
+        m_uSignal.wait(uSeen);
+        uSeen = m_uSignal.load();
+    }
+
+    if (m_bSearchUpdated.exchange(false))
+    {
+        OnSearchUpdate();
+        m_bRedraw = true;
+    }
+
+    // A burst of key repeats ends up in a single redraw
+    SessionCommand command;
+    while (m_Commands.TryPop(command))
+    {
+        ApplyCommand(command);
+        m_bRedraw = true;
+    }
+
+    if (!m_bRedraw)
+        return;
+
+    m_bRedraw = false;
     DrawOutput();
 }
 
@@ -19,6 +88,8 @@ void SWHexEditor::Session::UpdateSession()
 void SWHexEditor::Session::Stop()
 {
     StopUserControls();
+
+    TerminalRenderer::Present("\x1b[?25h");
 }
 
 // -----------------------------------------------------------------------------
@@ -33,65 +104,16 @@ void SWHexEditor::Session::PrintImgFromGrayScale()
 }
 
 // ----------------------------------------------------------------------------
-void SWHexEditor::Session::PrintImgFromGrayScale(IN std::shared_ptr<SWBitmaps::Bitmap> target, const uint8_t& width, const bool& clamp)
+void SWHexEditor::Session::PrintImgFromGrayScale(IN std::shared_ptr<SWBitmaps::Bitmap> target, const uint32_t& width, const bool& clamp)
 {
-    std::vector<uint8_t> uPixelsForConsole;
-
-    // Scale down the image -----------
-
-    const uint8_t uNewWidth = width;
-    // New height scaled to original aspect ratio
-    const uint8_t uNewHeight = static_cast<uint8_t>(uNewWidth * ((long double)target->m_Header.Height / target->m_Header.Width));
-
-    // Pre calculate
-    uPixelsForConsole.resize((size_t)uNewHeight * uNewWidth);
-    const long double fHeightRatio = (long double)target->m_Header.Height / uNewHeight;
-    const long double fWidthRatio = (long double)target->m_Header.Width / uNewWidth;
- 
-    // Global index for tracking std::vector uPixelsForConsole
-    uint64_t uGlobalIndex = 0;
-    // Goes from top to bottom, 
-    // because we print in console
-    // from top to bottom
-    for (int64_t i = uNewHeight - 1; i >= 0; i--)
-    {
-        for (int64_t k = 0; k < uNewWidth; k++)
-        {
-            auto p = target->m_MappedImage.Pixel(static_cast<size_t>(i * fHeightRatio),
-                static_cast<size_t>(k * fWidthRatio));
-
-            uPixelsForConsole[uGlobalIndex++] = ((uint32_t)p.Red() + p.Blue() + p.Green()) / 3;
-        }
-    }
-
-    // Print out ----------------------
+    TerminalRenderer::Present(TerminalRenderer::Render(*target, width, Ascii, clamp));
+}
 
-    const std::string colors = " .:-=o%@$";
-    long double fMin, fMax;
-    const uint8_t uIndexSizeOfColors = static_cast<uint8_t>(colors.size() - 1);
-    if (clamp)
-    {
-        fMin = *std::min_element(uPixelsForConsole.begin(), uPixelsForConsole.end());
-        fMax = *std::max_element(uPixelsForConsole.begin(), uPixelsForConsole.end());
-    }
-    else
-    {
-        fMin = 0;
-        fMax = 255;
-    }
-    // Reused global index for tracking width of the image
-    // Starting from 1 to not add additional '\n'
-    uGlobalIndex = 1;
-    for (auto& c : uPixelsForConsole)
-    {
-        uint8_t power = static_cast<uint8_t>(((c - fMin) / (fMax - fMin)) * uIndexSizeOfColors);
-        std::cout << colors[power] << " ";
-        
-        if (uGlobalIndex % uNewWidth == 0)
-            std::cout << '\n';
-        
-        uGlobalIndex++;
-    }
+// -----------------------------------------------------------------------------
+void SWHexEditor::Session::ReplayEditLog(IN std::shared_ptr<SWBitmaps::Bitmap> target, IN const RangeEditLog& log)
+{
+    log.Replay(target->GetRawPtr(), target->GetRawSize());
+    target->MarkModified();
 }
 
 // Setters ---------------------------------------------------------------------
@@ -116,6 +138,13 @@ void SWHexEditor::Session::StartUserControls()
     if (m_UserControlThreadSwitch.load())
         StopUserControls();
 
+    m_pInput = TerminalInput::Create();
+    if (!m_pInput->Open())
+    {
+        m_pInput.reset();
+        return;
+    }
+
     m_UserControlThreadSwitch.store(true);
     m_UserControlThread = std::thread(&SWHexEditor::Session::UserControlLoop, 
         this);
@@ -125,82 +154,595 @@ void SWHexEditor::Session::StartUserControls()
 void SWHexEditor::Session::StopUserControls()
 {
     m_UserControlThreadSwitch.store(false);
+    Signal();
+    StopSearch();
+
+    // Input thread sits in ReadKey(), it has to be woken up to see the switch
+    if (m_pInput)
+        m_pInput->Wake();
     
     if (m_UserControlThread.joinable())
         m_UserControlThread.join();
+
+    if (m_pInput)
+    {
+        m_pInput->Close();
+        m_pInput.reset();
+    }
 }
 
 // -----------------------------------------------------------------------------
 void SWHexEditor::Session::UserControlLoop()
 {
-    DWORD numberOfEvents;
-    INPUT_RECORD iRec;
-    HANDLE console = GetStdHandle(STD_INPUT_HANDLE);
-
-    // Console not found
-    if (console == NULL)
-        throw;
+    char key = 0;
+    bool bPrompt = false;
 
     while (m_UserControlThreadSwitch.load())
     {
-        ReadConsoleInput(console, &iRec, 1, &numberOfEvents);
+        if (!m_pInput->ReadKey(key))
+            continue;
 
-        if (iRec.EventType != KEY_EVENT
-            || !((KEY_EVENT_RECORD&)iRec.Event).bKeyDown)
+        // While a prompt is open every key is text, 
+        // the render side keeps the text, here it's only the mode
+        if (bPrompt)
         {
+            if (key == '\r' || key == '\n')
+            {
+                PushCommand({ PromptSubmit });
+                bPrompt = false;
+            }
+            else if (key == 0x1b)
+            {
+                PushCommand({ PromptCancel });
+                bPrompt = false;
+            }
+            else if (key == 0x08 || key == 0x7f)
+                PushCommand({ PromptErase });
+            else if (key >= ' ' && key <= '~')
+                PushCommand({ PromptChar, key });
+
             continue;
         }
 
-        if (((KEY_EVENT_RECORD&)iRec.Event).uChar.AsciiChar == 'q')
+        if (key == 'q')
         {
             m_UserControlThreadSwitch.store(false);
+            Signal();
+            return;
+        }
+
+        if (key == 'w')
+            PushCommand({ MoveUp });
+        if (key == 's')
+            PushCommand({ MoveDown });
+        if (key == 'd')
+            PushCommand({ MoveRight });
+        if (key == 'a')
+            PushCommand({ MoveLeft });
+        if (key == 'W')
+            PushCommand({ PageUp });
+        if (key == 'S')
+            PushCommand({ PageDown });
+        if (key == 'k')
+            PushCommand({ IncrementValue });
+        if (key == 'j')
+            PushCommand({ DecrementValue });
+        if (key == 'o')
+            PushCommand({ ToggleDisplayMode });
+        if (key == 'n')
+            PushCommand({ NextHit });
+        if (key == 'N')
+            PushCommand({ PreviousHit });
+        if (key == 0x1b)
+            PushCommand({ CancelSearch });
+        if (key == 'v')
+            PushCommand({ ToggleSelection });
+        if (key == 'y')
+            PushCommand({ CopySelection });
+        if (key == 'P')
+            PushCommand({ PasteClipboard });
+        if (key == 'z')
+            PushCommand({ ZeroRowPadding });
+        if (key == 'L')
+            PushCommand({ SaveEditLog });
+        if (key == 'i')
+            PushCommand({ TogglePreview });
+
+        PromptKind prompt = NoPrompt;
+        if (key == 'g')
+            prompt = GotoOffset;
+        if (key == 'p')
+            prompt = GotoPixel;
+        if (key == '/')
+            prompt = FindBytes;
+        if (key == 'c')
+            prompt = FindColor;
+        if (key == 'f')
+            prompt = FillRange;
+        if (key == 'x')
+            prompt = XorRange;
+        if (key == '+')
+            prompt = AddRange;
+
+        if (prompt != NoPrompt)
+        {
+            PushCommand({ BeginPrompt, static_cast<char>(prompt) });
+            bPrompt = true;
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+void SWHexEditor::Session::PushCommand(IN const SessionCommand& command)
+{
+    // The render side drains everything on each wake up, so a full ring only lasts for a moment
+    while (!m_Commands.TryPush(command))
+    {
+        if (!m_UserControlThreadSwitch.load())
             return;
+
+        std::this_thread::yield();
+    }
+
+    Signal();
+}
+
+// -----------------------------------------------------------------------------
+void SWHexEditor::Session::ApplyCommand(IN const SessionCommand& command)
+{
+    switch (command.Type)
+    {
+    case MoveUp:
+        IncreaseHeight();
+        return;
+    case MoveDown:
+        DecreaseHeight();
+        return;
+    case MoveLeft:
+        GoLeft();
+        return;
+    case MoveRight:
+        GoRight();
+        return;
+    case PageUp:
+        SetCursor(GetCursor() > PAGE_ROWS * m_uRowWidth ? GetCursor() - (PAGE_ROWS * m_uRowWidth) : m_uWidthIndx);
+        return;
+    case PageDown:
+        SetCursor(GetCursor() + (PAGE_ROWS * m_uRowWidth));
+        return;
+    case IncrementValue:
+        IncreaseValue();
+        return;
+    case DecrementValue:
+        DecreaseValue();
+        return;
+    case ToggleDisplayMode:
+        if (m_DisplayMode == Hex)
+            m_DisplayMode = Dec;
+        else
+            m_DisplayMode = Hex;
+        return;
+    case BeginPrompt:
+        m_Prompt = static_cast<PromptKind>(command.Argument);
+        m_PromptText.clear();
+        m_Message.clear();
+        return;
+    case PromptChar:
+        m_PromptText.push_back(command.Argument);
+        return;
+    case PromptErase:
+        if (!m_PromptText.empty())
+            m_PromptText.pop_back();
+        return;
+    case PromptSubmit:
+        SubmitPrompt();
+        m_Prompt = NoPrompt;
+        return;
+    case PromptCancel:
+        m_Prompt = NoPrompt;
+        return;
+    case NextHit:
+        JumpToHit(true);
+        return;
+    case PreviousHit:
+        JumpToHit(false);
+        return;
+    case CancelSearch:
+        if (m_bSearchActive && !m_bSearchDone.load())
+        {
+            StopSearch();
+            m_Message = "Search stopped";
         }
+        return;
+    case ToggleSelection:
+        m_bSelecting = !m_bSelecting;
+        m_uSelectionAnchor = GetCursor();
+        return;
+    case CopySelection:
+        GetSelection(m_uClipboardOffset, m_uClipboardSize);
+        m_bSelecting = false;
+        m_Message = "Copied " + std::to_string(m_uClipboardSize) + " bytes";
+        return;
+    case PasteClipboard:
+    {
+        if (m_uClipboardSize == 0)
+        {
+            m_Message = "Nothing to paste";
+            return;
+        }
+
+        RangeEdit edit;
+        edit.Operation = Copy;
+        edit.Offset = GetCursor();
+        edit.Size = m_uClipboardSize;
+        edit.Source = m_uClipboardOffset;
+        ApplyEdit(edit);
+        return;
+    }
+    case ZeroRowPadding:
+    {
+        const auto& header = m_pTargetBitmap->GetHeader();
+
+        // Without a selection all of the pixel data
+        RangeEdit edit;
+        edit.Operation = ZeroPadding;
+        edit.Offset = header.FileBeginOffset;
+        edit.Size = m_uTargetBufferSize > header.FileBeginOffset ? m_uTargetBufferSize - header.FileBeginOffset : 0;
+        if (m_bSelecting)
+            GetSelection(edit.Offset, edit.Size);
+
+        edit.Source = header.FileBeginOffset;
+        edit.Pitch = m_pTargetBitmap->GetPitch();
+        edit.RowBytes = (((uint64_t)header.Width * header.ColorDepth) + 7) / 8;
+        ApplyEdit(edit);
+        return;
+    }
+    case SaveEditLog:
+    {
+        // Never next to the source, it can be shared or read-only. 
+        // Images from shared memory or descriptors have no name
+        std::filesystem::path name = std::filesystem::path(m_pTargetBitmap->GetPath()).filename();
+        if (name.empty())
+            name = L"Untitled.bmp";
+
+        const std::wstring path = (std::filesystem::path(m_OutputDirectory) / name).wstring() + L".edits";
+        if (m_EditLog.SaveToFile(path))
+            m_Message = "Saved " + std::to_string(m_EditLog.GetEdits().size()) + " edits to " + std::filesystem::path(path).string();
+        else
+            m_Message = "Couldn't save the edit log";
+        return;
+    }
+    case TogglePreview:
+        m_bShowPreview = !m_bShowPreview;
+        if (!m_Preview.IsValid())
+            m_Message = "Preview is only for 24-bit images";
+        return;
+    default:
+        throw;
+    }
+}
 
-        if (((KEY_EVENT_RECORD&)iRec.Event).uChar.AsciiChar == 'w')
+// -----------------------------------------------------------------------------
+void SWHexEditor::Session::SubmitPrompt()
+{
+    m_Message.clear();
+
+    if (m_Prompt == GotoOffset)
+    {
+        // Decimal, or hex with 0x
+        char* end = nullptr;
+        const uint64_t uOffset = std::strtoull(m_PromptText.c_str(), &end, 0);
+        if (end == m_PromptText.c_str())
         {
-            IncreaseHeight();
-        }        
-        if (((KEY_EVENT_RECORD&)iRec.Event).uChar.AsciiChar == 's')
+            m_Message = "Invalid offset";
+            return;
+        }
+
+        SetCursor(uOffset);
+        return;
+    }
+
+    if (m_Prompt == GotoPixel)
+    {
+        const auto& header = m_pTargetBitmap->GetHeader();
+        int64_t x = -1, y = -1;
+        std::string text = m_PromptText;
+        std::replace(text.begin(), text.end(), ',', ' ');
+        std::istringstream(text) >> x >> y;
+
+        if (x < 0 || y < 0 ||
+            x >= header.Width || y >= std::abs(header.Height) ||
+            header.ColorDepth < 8)
         {
-            DecreaseHeight();
+            m_Message = "Invalid pixel";
+            return;
         }
-        if (((KEY_EVENT_RECORD&)iRec.Event).uChar.AsciiChar == 'd')
+
+        // Rows are stored bottom-up unless the height is negative
+        const uint64_t uRow = header.Height > 0 ? header.Height - 1 - y : y;
+        SetCursor(header.FileBeginOffset + (uRow * m_pTargetBitmap->GetPitch()) + (x * (header.ColorDepth / 8)));
+        return;
+    }
+
+    if (m_Prompt == FindBytes)
+    {
+        std::vector<uint8_t> pattern;
+        if (!ParseHexPattern(m_PromptText, pattern))
         {
-            GoRight();
+            m_Message = "Invalid hex pattern";
+            return;
         }
-        if (((KEY_EVENT_RECORD&)iRec.Event).uChar.AsciiChar == 'a')
+
+        StartSearch(pattern, false, m_PromptText);
+        return;
+    }
+
+    if (m_Prompt == FindColor)
+    {
+        std::vector<uint8_t> rgb;
+        if (!ParseHexPattern(m_PromptText, rgb) || 
+            rgb.size() != 3 ||
+            m_pTargetBitmap->GetHeader().ColorDepth != 24)
         {
-            GoLeft();
+            m_Message = "Invalid color, expected RRGGBB on a 24-bit image";
+            return;
         }
-        if (((KEY_EVENT_RECORD&)iRec.Event).uChar.AsciiChar == 'k')
+
+        // Pixels are stored as BGR
+        StartSearch({ rgb[2], rgb[1], rgb[0] }, true, "#" + m_PromptText);
+        return;
+    }
+
+    if (m_Prompt == FillRange ||
+        m_Prompt == XorRange ||
+        m_Prompt == AddRange)
+    {
+        RangeEdit edit;
+        if (!ParseHexPattern(m_PromptText, edit.Pattern) ||
+            (m_Prompt != FillRange && edit.Pattern.size() != 1))
         {
-            IncreaseValue();
+            m_Message = m_Prompt == FillRange ? "Invalid hex pattern" : "Invalid value, expected one hex byte";
+            return;
         }
-        if (((KEY_EVENT_RECORD&)iRec.Event).uChar.AsciiChar == 'j')
+
+        if (m_Prompt == FillRange)
+            edit.Operation = Fill;
+        else if (m_Prompt == XorRange)
+            edit.Operation = Xor;
+        else
+            edit.Operation = Add;
+
+        GetSelection(edit.Offset, edit.Size);
+        ApplyEdit(edit);
+        return;
+    }
+}
+
+// -----------------------------------------------------------------------------
+void SWHexEditor::Session::SetCursor(IN const uint64_t& offset)
+{
+    if (m_uTargetBufferSize == 0)
+        return;
+
+    const uint64_t uOffset = std::min(offset, m_uTargetBufferSize - 1);
+
+    m_uHeightIndx = uOffset / m_uRowWidth;
+    m_uWidthIndx = uOffset % m_uRowWidth;
+}
+
+// -----------------------------------------------------------------------------
+void SWHexEditor::Session::GetSelection(IN uint64_t& begin, IN uint64_t& size) const
+{
+    const uint64_t uCursor = GetCursor();
+
+    if (!m_bSelecting)
+    {
+        begin = uCursor;
+        size = uCursor < m_uTargetBufferSize ? 1 : 0;
+        return;
+    }
+
+    begin = std::min(uCursor, m_uSelectionAnchor);
+    size = std::max(uCursor, m_uSelectionAnchor) - begin + 1;
+}
+
+// -----------------------------------------------------------------------------
+void SWHexEditor::Session::ApplyEdit(IN const RangeEdit& edit)
+{
+    const bool bSearchStopped = StopSearchForEdit();
+
+    if (!ApplyRangeEdit(m_pTargetBuffer, m_uTargetBufferSize, edit))
+    {
+        m_Message = "Nothing to edit";
+        return;
+    }
+
+    m_EditLog.Record(edit);
+    m_pTargetBitmap->MarkModified();
+
+    // Padding isn't part of any pixel
+    if (edit.Operation != ZeroPadding)
+        m_Preview.Invalidate(*m_pTargetBitmap, edit.Offset, edit.Size);
+    m_bSelecting = false;
+
+    const char* names[] = { "Filled", "Xored", "Added to", "Pasted", "Zeroed padding in" };
+    m_Message = std::string(names[edit.Operation]) + " " + std::to_string(std::min(edit.Size, m_uTargetBufferSize - edit.Offset)) + " bytes";
+    if (bSearchStopped)
+        m_Message += ", search stopped";
+}
+
+// Search ----------------------------------------------------------------------
+
+// -----------------------------------------------------------------------------
+void SWHexEditor::Session::StartSearch(IN const std::vector<uint8_t>& pattern, 
+    IN const bool& pixelsOnly, 
+    IN const std::string& label)
+{
+    StopSearch();
+
+    m_SearchHits.clear();
+    m_SearchLabel = label;
+    m_bSearchCancel.store(false);
+    m_bSearchDone.store(false);
+    m_uSearchScanned.store(0);
+    m_uSearchHitCount.store(0);
+    m_bSearchActive = true;
+    m_bJumpOnDone = true;
+
+    const auto& header = m_pTargetBitmap->GetHeader();
+    const uint64_t uBegin = header.FileBeginOffset;
+    const uint64_t uPitch = m_pTargetBitmap->GetPitch();
+    const uint64_t uRowBytes = (uint64_t)header.Width * 3;
+
+    // Edits stop it first, see StopSearchForEdit()
+    m_SearchThread = std::thread([this, pattern, pixelsOnly, uBegin, uPitch, uRowBytes]() {
+        auto onHit = [&](uint64_t offset) {
+            if (pixelsOnly)
+            {
+                if (offset < uBegin)
+                    return;
+
+                const uint64_t uInRow = (offset - uBegin) % uPitch;
+                if (uInRow % 3 != 0 || 
+                    uInRow + 3 > uRowBytes)
+                    return;
+            }
+
+            if (m_SearchHits.size() < SEARCH_MAX_STORED_HITS)
+                m_SearchHits.push_back(offset);
+            m_uSearchHitCount.fetch_add(1, std::memory_order_relaxed);
+        };
+
+        auto onProgress = [&](uint64_t scanned) {
+            m_uSearchScanned.store(scanned, std::memory_order_relaxed);
+            m_bSearchUpdated.store(true);
+            Signal();
+        };
+
+        if (FindAll((const uint8_t*)m_pTargetBuffer, m_uTargetBufferSize, pattern, onHit, onProgress, m_bSearchCancel))
         {
-            DecreaseValue();
+            m_bSearchDone.store(true, std::memory_order_release);
+            m_bSearchUpdated.store(true);
+            Signal();
         }
-        if (((KEY_EVENT_RECORD&)iRec.Event).uChar.AsciiChar == 'o')
+        });
+}
+
+// -----------------------------------------------------------------------------
+void SWHexEditor::Session::StopSearch()
+{
+    m_bSearchCancel.store(true);
+
+    if (m_SearchThread.joinable())
+        m_SearchThread.join();
+
+    m_bSearchActive = m_bSearchDone.load();
+    m_bJumpOnDone = false;
+}
+
+// -----------------------------------------------------------------------------
+bool SWHexEditor::Session::StopSearchForEdit()
+{
+    if (!m_bSearchActive || 
+        m_bSearchDone.load(std::memory_order_acquire))
+        return false;
+
+    StopSearch();
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+void SWHexEditor::Session::OnSearchUpdate()
+{
+    if (!m_bSearchActive ||
+        !m_bSearchDone.load(std::memory_order_acquire))
+        return;
+
+    if (m_SearchThread.joinable())
+        m_SearchThread.join();
+
+    if (m_bJumpOnDone)
+    {
+        m_bJumpOnDone = false;
+
+        // The first hit at or after the cursor
+        if (!m_SearchHits.empty())
         {
-            if (m_DisplayMode == Hex)
-                m_DisplayMode = Dec;
-            else
-                m_DisplayMode = Hex;
+            auto it = std::lower_bound(m_SearchHits.begin(), m_SearchHits.end(), GetCursor());
+            SetCursor(it == m_SearchHits.end() ? m_SearchHits.front() : *it);
         }
     }
 }
 
 // -----------------------------------------------------------------------------
-void SWHexEditor::Session::ClearScreen()
+void SWHexEditor::Session::JumpToHit(IN const bool& forward)
 {
-#ifdef _WIN32
-    system("cls");
+    if (!m_bSearchActive ||
+        !m_bSearchDone.load(std::memory_order_acquire) ||
+        m_SearchHits.empty())
+        return;
 
-    return;
-#endif // _WIN32
+    const uint64_t uCursor = GetCursor();
+
+    // Both directions wrap around
+    if (forward)
+    {
+        auto it = std::upper_bound(m_SearchHits.begin(), m_SearchHits.end(), uCursor);
+        SetCursor(it == m_SearchHits.end() ? m_SearchHits.front() : *it);
+        return;
+    }
 
-    throw;
+    auto it = std::lower_bound(m_SearchHits.begin(), m_SearchHits.end(), uCursor);
+    SetCursor(it == m_SearchHits.begin() ? m_SearchHits.back() : *(it - 1));
+}
+
+// -----------------------------------------------------------------------------
+std::string SWHexEditor::Session::GetStatusLine() const
+{
+    if (m_Prompt != NoPrompt)
+    {
+        const char* labels[] = { "", "Offset: ", "Pixel x,y: ", "Find bytes: ", "Find color RRGGBB: ", "Fill with bytes: ", "Xor with byte: ", "Add byte: " };
+        return labels[m_Prompt] + m_PromptText + "_";
+    }
+
+    if (!m_Message.empty())
+        return m_Message;
+
+    if (m_bSelecting)
+    {
+        uint64_t uBegin = 0, uSize = 0;
+        GetSelection(uBegin, uSize);
+        return "Selected " + std::to_string(uSize) + " bytes from " + std::to_string(uBegin);
+    }
+
+    if (!m_bSearchActive)
+        return "";
+
+    const uint64_t uHits = m_uSearchHitCount.load(std::memory_order_relaxed);
+    std::string status = "Search " + m_SearchLabel + ": " + std::to_string(uHits) + " hits";
+
+    if (!m_bSearchDone.load(std::memory_order_acquire))
+    {
+        const uint64_t uPercent = m_uTargetBufferSize ? (m_uSearchScanned.load(std::memory_order_relaxed) * 100) / m_uTargetBufferSize : 100;
+        return status + ", " + std::to_string(uPercent) + "% scanned";
+    }
+
+    if (uHits > m_SearchHits.size())
+        status += ", first " + std::to_string(m_SearchHits.size()) + " kept";
+
+    // Position of the cursor among the hits
+    auto it = std::lower_bound(m_SearchHits.begin(), m_SearchHits.end(), GetCursor());
+    if (it != m_SearchHits.end() && *it == GetCursor())
+        status += " (" + std::to_string((it - m_SearchHits.begin()) + 1) + " of " + std::to_string(uHits) + ")";
+
+    return status;
+}
+
+// -----------------------------------------------------------------------------
+void SWHexEditor::Session::ClearScreen()
+{
+    TerminalRenderer::Present("\x1b[2J\x1b[H");
+    m_LastFrame.clear();
 }
 
 // -----------------------------------------------------------------------------
@@ -227,33 +769,34 @@ std::string SWHexEditor::Session::PrintBufferRow(IN const uint64_t& i)
     else
         result += "    ";
 
-    std::string tmp;
+    uint64_t uSelectionBegin = 0, uSelectionSize = 0;
+    if (m_bSelecting)
+        GetSelection(uSelectionBegin, uSelectionSize);
+
     for (uint64_t i = startingIndex; i < startingIndex + m_uRowWidth; i++)
     {
-        if (isSelected &&
-            i == startingIndex + m_uWidthIndx)
-            tmp = " >";
-        else
-            tmp = " ";
-
-        if (m_DisplayMode == Hex)
-            tmp += std::format("{:2x}", (uint8_t)m_pTargetBuffer[i]);
+        const bool isCursor = isSelected && i == startingIndex + m_uWidthIndx;
+        const bool isInRange = i >= uSelectionBegin && i < uSelectionBegin + uSelectionSize;
+        result += isCursor ? " >" : " ";
+
+        // Selected bytes are in reverse video
+        if (isInRange)
+            result += "\x1b[7m";
+
+        // Last row can be shorter than the rest
+        if (i >= m_uTargetBufferSize)
+            result.append(m_DisplayMode == Hex ? 2 : 3, ' ');
+        else if (m_DisplayMode == Hex)
+            result.append(s_ByteCells.Hex[(uint8_t)m_pTargetBuffer[i]], 2);
         else if (m_DisplayMode == Dec)
-            tmp += std::format("{:3d}", (uint8_t)m_pTargetBuffer[i]);
+            result.append(s_ByteCells.Dec[(uint8_t)m_pTargetBuffer[i]], 3);
 
-        if (isSelected && 
-            i == startingIndex + m_uWidthIndx)
-            tmp += "< ";
-        else
-            tmp += " ";
+        if (isInRange)
+            result += "\x1b[27m";
 
-        result += tmp;
+        result += isCursor ? "< " : " ";
     }
 
-    std::for_each(result.begin(), result.end(), [](char& c) {
-        c = std::toupper(c);
-        });
-
     if (isSelected)
         result += "---";
     else
@@ -263,7 +806,6 @@ std::string SWHexEditor::Session::PrintBufferRow(IN const uint64_t& i)
     }
 
     result += " | ";
-    result += "\n";
 
     return result;
 }
@@ -271,9 +813,7 @@ std::string SWHexEditor::Session::PrintBufferRow(IN const uint64_t& i)
 // -----------------------------------------------------------------------------
 void SWHexEditor::Session::DrawOutput()
 {
-    using namespace std::chrono_literals;
-
-    std::string output = {};
+    std::vector<std::string> frame;
     const uint8_t offsetUpAndDown = 14;
     uint64_t upIndex;
     uint64_t downIndex = (m_uHeightIndx + offsetUpAndDown);
@@ -289,17 +829,38 @@ void SWHexEditor::Session::DrawOutput()
         upIndex = m_uHeightIndx - offsetUpAndDown;
     }
 
-    for (uint64_t& i = upIndex;
-        i < downIndex;
-        i++)
-    { 
-        output += PrintBufferRow(i);
+    // Preview starts in the same column on every line, past the widest hex row
+    const uint64_t uPreviewColumn = 32 + (m_uRowWidth * (m_DisplayMode == Hex ? 4 : 5));
+
+    for (uint64_t i = upIndex; i < downIndex; i++)
+    {
+        frame.push_back(PrintBufferRow(i));
+
+        if (m_bShowPreview && m_Preview.IsValid())
+            frame.back() += "\x1b[" + std::to_string(uPreviewColumn) + "G" + m_Preview.GetLine(i - upIndex);
     }
-    
-    std::cout << output;
-    std::cout << std::endl << SWBytesManipulation_FOOTER;
-    std::this_thread::sleep_for(11ms);
-    ClearScreen();
+
+    frame.push_back("");
+    frame.push_back(SWBytesManipulation_FOOTER);
+    frame.push_back(SWBytesManipulation_FOOTER_NAVIGATION);
+    frame.push_back(SWBytesManipulation_FOOTER_RANGE);
+    frame.push_back(GetStatusLine());
+
+    // Only the lines that differ from the screen are rewritten
+    std::string output;
+    for (uint64_t i = 0; i < frame.size(); i++)
+    {
+        if (i < m_LastFrame.size() && 
+            m_LastFrame[i] == frame[i])
+            continue;
+
+        output += "\x1b[" + std::to_string(i + 1) + ";1H";
+        output += frame[i];
+        output += "\x1b[K";
+    }
+
+    TerminalRenderer::Present(output);
+    m_LastFrame = std::move(frame);
 }
 
 // -----------------------------------------------------------------------------
@@ -350,14 +911,32 @@ void SWHexEditor::Session::GoLeft()
     m_uWidthIndx--;
 }
 
+// -----------------------------------------------------------------------------
+void SWHexEditor::Session::Signal()
+{
+    m_uSignal.fetch_add(1);
+    m_uSignal.notify_all();
+}
+
 // -----------------------------------------------------------------------------
 void SWHexEditor::Session::IncreaseValue()
 {
-    m_pTargetBuffer[(m_uHeightIndx * m_uRowWidth) + m_uWidthIndx]++;
+    // Through the log like any other edit, so a replay gives the same bytes
+    RangeEdit edit;
+    edit.Operation = Add;
+    edit.Offset = GetCursor();
+    edit.Size = 1;
+    edit.Pattern = { 0x01 };
+    ApplyEdit(edit);
 }
 
 // -----------------------------------------------------------------------------
 void SWHexEditor::Session::DecreaseValue()
 {
-    m_pTargetBuffer[(m_uHeightIndx * m_uRowWidth) + m_uWidthIndx]--;
+    RangeEdit edit;
+    edit.Operation = Add;
+    edit.Offset = GetCursor();
+    edit.Size = 1;
+    edit.Pattern = { 0xFF };
+    ApplyEdit(edit);
 }
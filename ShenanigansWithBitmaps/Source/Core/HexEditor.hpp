@@ -1,9 +1,19 @@
 #pragma once
 
 #include "Bitmap.hpp"
+#include "TerminalInput.hpp"
+#include "SpscQueue.hpp"
+#include "RangeEdit.hpp"
+#include "LivePreview.hpp"
 
 #define SWBytesManipulation_FOOTER \
-"W - up; S - down; A - left; D - right; j - decrease value; k - increase value; o - change between Hex and Dec mode"
+"W - up; S - down; A - left; D - right; j - decrease value; k - increase value; o - change between Hex and Dec mode; i - image preview"
+
+#define SWBytesManipulation_FOOTER_NAVIGATION \
+"Shift+W/S - page; g - go to offset; p - go to pixel; / - find bytes; c - find color; n/N - next/previous hit; Esc - stop search"
+
+#define SWBytesManipulation_FOOTER_RANGE \
+"v - select range; f - fill; x - xor; + - add; y - copy; Shift+P - paste; z - zero row padding; Shift+L - save edit log"
 
 namespace SWHexEditor
 {
@@ -13,6 +23,60 @@ namespace SWHexEditor
         Dec
     };
 
+    // Everything the input thread can ask for, applied by the render side
+    enum CommandType
+    {
+        MoveUp,
+        MoveDown,
+        MoveLeft,
+        MoveRight,
+        PageUp,
+        PageDown,
+        IncrementValue,
+        DecrementValue,
+        ToggleDisplayMode,
+        // Argument is the PromptKind
+        BeginPrompt,
+        // Argument is the typed character
+        PromptChar,
+        PromptErase,
+        PromptSubmit,
+        PromptCancel,
+        NextHit,
+        PreviousHit,
+        CancelSearch,
+        // Starts a selection at the cursor, or drops the current one
+        ToggleSelection,
+        CopySelection,
+        PasteClipboard,
+        ZeroRowPadding,
+        SaveEditLog,
+        TogglePreview
+    };
+
+    enum PromptKind
+    {
+        NoPrompt,
+        GotoOffset,
+        // "x,y" from the top left corner
+        GotoPixel,
+        // Hex bytes
+        FindBytes,
+        // "RRGGBB", only whole pixels inside of rows match
+        FindColor,
+        // Hex bytes, repeated over the selection
+        FillRange,
+        // One hex byte
+        XorRange,
+        AddRange
+    };
+
+    struct SessionCommand
+    {
+        CommandType Type = MoveUp;
+        char Argument = 0;
+    };
+
     class Session
     {
     public:
@@ -28,13 +92,18 @@ namespace SWHexEditor
 
         void Start();
         
+        // Blocks until commands arrive, applies all of them 
+        // and redraws once, only the changed lines
         void UpdateSession();
 
         void Stop();
 
         void PrintImgFromGrayScale();
 
-        static void PrintImgFromGrayScale(IN std::shared_ptr<SWBitmaps::Bitmap> target, const uint8_t& width, const bool& clamp);
+        static void PrintImgFromGrayScale(IN std::shared_ptr<SWBitmaps::Bitmap> target, const uint32_t& width, const bool& clamp);
+
+        // Same edits as the session that saved the log, on the raw file bytes
+        static void ReplayEditLog(IN std::shared_ptr<SWBitmaps::Bitmap> target, IN const RangeEditLog& log);
 
 
     public:
@@ -49,6 +118,9 @@ namespace SWHexEditor
         
         void SetBuffer(IN std::shared_ptr<SWBitmaps::Bitmap> target);
 
+        // Edit logs go there as 'FILE.bmp.edits', the working directory without one
+        void SetOutputDirectory(IN const std::wstring& directory) { m_OutputDirectory = directory; }
+
     private:
 
         void StartUserControls();
@@ -61,6 +133,49 @@ namespace SWHexEditor
 
         std::string PrintBufferRow(IN const uint64_t& i);
 
+        // Input thread only
+        void PushCommand(IN const SessionCommand& command);
+
+        void ApplyCommand(IN const SessionCommand& command);
+
+        void SubmitPrompt();
+
+        uint64_t GetCursor() const { return (m_uHeightIndx * m_uRowWidth) + m_uWidthIndx; }
+
+        void SetCursor(IN const uint64_t& offset);
+
+        // The selection, or the byte under the cursor without one
+        void GetSelection(IN uint64_t& begin, IN uint64_t& size) const;
+
+        // Applies the edit to the buffer and records it in the log
+        void ApplyEdit(IN const RangeEdit& edit);
+
+    private:
+
+        // Search --------------------------------------------------------------
+
+        // Scans the whole buffer on a background thread, the cursor 
+        // jumps to the first hit after it once the scan is done
+        void StartSearch(IN const std::vector<uint8_t>& pattern, 
+            IN const bool& pixelsOnly, 
+            IN const std::string& label);
+
+        void StopSearch();
+
+        // The scan reads the buffer on its own thread, so an unfinished 
+        // one stops before anything writes it, true if one was stopped
+        bool StopSearchForEdit();
+
+        // Called when the search thread reports progress
+        void OnSearchUpdate();
+
+        void JumpToHit(IN const bool& forward);
+
+        std::string GetStatusLine() const;
+
+        // Wakes UpdateSession()
+        void Signal();
+
         void DrawOutput();
 
     private:
@@ -83,8 +198,10 @@ namespace SWHexEditor
 
         std::atomic_bool m_UserControlThreadSwitch = false;
         std::thread m_UserControlThread;
+        std::unique_ptr<TerminalInput> m_pInput = nullptr;
 
         std::shared_ptr<SWBitmaps::Bitmap> m_pTargetBitmap = std::shared_ptr<SWBitmaps::Bitmap>(nullptr);
+        std::wstring m_OutputDirectory = L"";
         uint64_t m_uTargetBufferSize = 0;
         char* m_pTargetBuffer = nullptr;
 
@@ -94,5 +211,41 @@ namespace SWHexEditor
 
         DisplayMode m_DisplayMode = Hex;
 
+        // Session state is only touched by the thread calling UpdateSession(),
+        // the input thread goes through the queue
+        SWBitmaps::SpscQueue<SessionCommand, 256> m_Commands;
+        std::atomic<uint32_t> m_uSignal = 0;
+        bool m_bRedraw = true;
+
+        // Lines currently on the screen
+        std::vector<std::string> m_LastFrame;
+
+        PromptKind m_Prompt = NoPrompt;
+        std::string m_PromptText = "";
+        std::string m_Message = "";
+
+        std::thread m_SearchThread;
+        std::atomic_bool m_bSearchCancel = false;
+        std::atomic_bool m_bSearchUpdated = false;
+        std::atomic_bool m_bSearchDone = false;
+        std::atomic<uint64_t> m_uSearchScanned = 0;
+        std::atomic<uint64_t> m_uSearchHitCount = 0;
+        // Written by the search thread, read only after m_bSearchDone
+        std::vector<uint64_t> m_SearchHits;
+        std::string m_SearchLabel = "";
+        bool m_bSearchActive = false;
+        bool m_bJumpOnDone = false;
+
+        bool m_bSelecting = false;
+        uint64_t m_uSelectionAnchor = 0;
+        // Paste copies whatever is in the copied range at the time of pasting
+        uint64_t m_uClipboardOffset = 0;
+        uint64_t m_uClipboardSize = 0;
+        RangeEditLog m_EditLog;
+
+        // Drawn right of the hex rows, follows every edit
+        LivePreview m_Preview;
+        bool m_bShowPreview = true;
+
     };
 }
\ No newline at end of file
@@ -0,0 +1,634 @@
+#include "Pch.h"
+
+#include "ImageServer.hpp"
+#include "ScriptRunner.hpp"
+#include "BufferPool.hpp"
+#include "FdPassing.hpp"
+
+#define SERVER_RECENT_LATENCIES 1024
+#define SERVER_MAX_REQUEST 65536
+
+#ifndef _WIN32
+
+// A reader per connection, replies are written by the workers
+struct ImageServer::Connection
+{
+    // Closed by the reader under the connections mutex, when it sets Finished
+    int Socket = -1;
+    bool Finished = false;
+
+    std::mutex WriteMutex;
+
+    // Jobs submitted and not replied to yet
+    std::mutex PendingMutex;
+    std::condition_variable PendingDone;
+    uint64_t Pending = 0;
+
+    void Send(IN const std::string& line)
+    {
+        std::lock_guard<std::mutex> lock(WriteMutex);
+
+        const std::string data = line + "\n";
+        for (uint64_t i = 0; i < data.size(); )
+        {
+            const ssize_t sent = send(Socket, data.data() + i, data.size() - i, MSG_NOSIGNAL);
+            if (sent <= 0)
+                return;
+            i += sent;
+        }
+    }
+};
+
+// -----------------------------------------------------------------------------
+static bool MakeAddress(IN const std::string& path, IN sockaddr_un& address)
+{
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+
+    if (path.empty() || path.size() >= sizeof(address.sun_path))
+        return false;
+
+    memcpy(address.sun_path, path.c_str(), path.size());
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+// True when nothing is at 'path' anymore. Only a socket nobody listens on 
+// is removed, a file or the socket of a live server stays where it is
+static bool RemoveStaleSocket(IN const std::string& path, IN const sockaddr_un& address)
+{
+    struct stat info;
+    if (lstat(path.c_str(), &info) != 0)
+        return errno == ENOENT;
+
+    if (!S_ISSOCK(info.st_mode))
+        return false;
+
+    const int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe < 0)
+        return false;
+
+    const bool bRefused = connect(probe, (const sockaddr*)&address, sizeof(address)) != 0 && errno == ECONNREFUSED;
+    close(probe);
+
+    // A server that didn't exit cleanly
+    return bRefused && unlink(path.c_str()) == 0;
+}
+
+// -----------------------------------------------------------------------------
+static void CloseFds(IN std::vector<int>& fds)
+{
+    for (const int fd : fds)
+        close(fd);
+    fds.clear();
+}
+
+// Splits a socket stream into lines. A receive that picks up descriptors 
+// ends with the send they were attached to, and a client sends each line 
+// with its own, so they belong to the line of the last byte received
+struct LineReader
+{
+    int Socket = -1;
+    std::string Buffer = "";
+    // Stream offset of Buffer[0]
+    uint64_t Offset = 0;
+    // Received descriptors with the stream offset of their last byte
+    std::vector<std::pair<uint64_t, int>> Fds;
+
+    ~LineReader()
+    {
+        for (const auto& fd : Fds)
+            close(fd.second);
+    }
+
+    // Blocks until a whole line is buffered, false on end of stream
+    bool Read(IN std::string& line, IN std::vector<int>& fds)
+    {
+        while (true)
+        {
+            uint64_t uEnd = Buffer.find('\n');
+            if (uEnd == std::string::npos && Buffer.size() > SERVER_MAX_REQUEST)
+                return false;
+
+            if (uEnd == std::string::npos)
+            {
+                char chunk[4096];
+                std::vector<int> received;
+                const int64_t size = SWBitmaps::ReceiveWithFds(Socket, chunk, sizeof(chunk), received);
+
+                for (const int fd : received)
+                    Fds.emplace_back(Offset + Buffer.size() + std::max<int64_t>(size, 1) - 1, fd);
+
+                if (size > 0)
+                {
+                    Buffer.append(chunk, size);
+                    continue;
+                }
+
+                // Last line without a line break
+                if (Buffer.empty())
+                    return false;
+
+                uEnd = Buffer.size();
+            }
+
+            line = Buffer.substr(0, uEnd);
+            uEnd = std::min<uint64_t>(uEnd + 1, Buffer.size());
+            Buffer.erase(0, uEnd);
+            Offset += uEnd;
+
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+
+            fds.clear();
+            auto it = Fds.begin();
+            for (; it != Fds.end() && it->first < Offset; it++)
+                fds.push_back(it->second);
+            Fds.erase(Fds.begin(), it);
+
+            return true;
+        }
+    }
+};
+
+// -----------------------------------------------------------------------------
+bool ImageServer::Start(IN const std::string& socketPath, 
+    IN const uint32_t& workers, 
+    IN const uint64_t& queueCapacity, 
+    IN const uint64_t& poolBytes)
+{
+    sockaddr_un address;
+    if (!MakeAddress(socketPath, address))
+    {
+        m_Error = "invalid socket path";
+        return false;
+    }
+
+    if (!RemoveStaleSocket(socketPath, address))
+    {
+        m_Error = "can't listen on " + socketPath + ": address in use";
+        return false;
+    }
+
+    m_ListenSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (m_ListenSocket < 0)
+    {
+        m_Error = "can't create socket";
+        return false;
+    }
+
+    if (bind(m_ListenSocket, (sockaddr*)&address, sizeof(address)) != 0 ||
+        listen(m_ListenSocket, SOMAXCONN) != 0)
+    {
+        m_Error = "can't listen on " + socketPath + ": " + strerror(errno);
+        close(m_ListenSocket);
+        m_ListenSocket = -1;
+        return false;
+    }
+
+    m_SocketPath = socketPath;
+    SWBitmaps::BufferPool::Get().SetCapacity(poolBytes);
+    m_pWorkers = std::make_unique<SWBitmaps::WorkerPool>(workers, queueCapacity);
+    m_RecentLatencies.assign(SERVER_RECENT_LATENCIES, 0.0);
+    m_bRunning.store(true);
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+void ImageServer::Run()
+{
+    while (m_bRunning.load())
+    {
+        // Wakes up now and then to see the switch
+        pollfd fd = { m_ListenSocket, POLLIN, 0 };
+        if (poll(&fd, 1, 200) <= 0)
+            continue;
+
+        const int client = accept(m_ListenSocket, nullptr, nullptr);
+        if (client < 0)
+            continue;
+
+        auto connection = std::make_shared<Connection>();
+        connection->Socket = client;
+
+        std::lock_guard<std::mutex> lock(m_ConnectionsMutex);
+
+        for (auto it = m_Connections.begin(); it != m_Connections.end(); )
+        {
+            if (!it->second->Finished)
+            {
+                it++;
+                continue;
+            }
+
+            it->first.join();
+            it = m_Connections.erase(it);
+        }
+
+        m_Connections.emplace_back(std::thread(&ImageServer::ServeConnection, this, connection), connection);
+    }
+
+    Stop();
+}
+
+// -----------------------------------------------------------------------------
+void ImageServer::Stop()
+{
+    m_bRunning.store(false);
+
+    // Readers sit in recv(), shutting the read side down lets them see the end
+    std::vector<std::pair<std::thread, std::shared_ptr<Connection>>> connections;
+    {
+        std::lock_guard<std::mutex> lock(m_ConnectionsMutex);
+
+        for (auto& connection : m_Connections)
+            if (!connection.second->Finished)
+                shutdown(connection.second->Socket, SHUT_RD);
+
+        connections.swap(m_Connections);
+    }
+
+    for (auto& connection : connections)
+        if (connection.first.joinable())
+            connection.first.join();
+
+    if (m_pWorkers)
+    {
+        m_pWorkers->Stop();
+        m_pWorkers.reset();
+    }
+
+    if (m_ListenSocket >= 0)
+    {
+        close(m_ListenSocket);
+        m_ListenSocket = -1;
+        unlink(m_SocketPath.c_str());
+    }
+}
+
+// -----------------------------------------------------------------------------
+bool ImageServer::RunClient(IN const std::string& socketPath, 
+    IN std::istream& jobs, 
+    IN std::ostream& replies)
+{
+    sockaddr_un address;
+    if (!MakeAddress(socketPath, address))
+        return false;
+
+    const int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server < 0)
+        return false;
+
+    if (connect(server, (sockaddr*)&address, sizeof(address)) != 0)
+    {
+        close(server);
+        return false;
+    }
+
+    // Replies are read while the jobs still go out, so neither side can fill up
+    std::thread reader([&]() {
+        LineReader lines;
+        lines.Socket = server;
+
+        std::string line;
+        std::vector<int> fds;
+        while (lines.Read(line, fds))
+        {
+            CloseFds(fds);
+            replies << line << std::endl;
+        }
+        });
+
+    std::string line;
+    while (std::getline(jobs, line))
+    {
+        // "fd:PATH" as INPUT or OUTPUT sends the opened file along, 
+        // the server sees "fd:INDEX" into the descriptors of the line
+        std::istringstream stream(line);
+        std::string paths[2], ops;
+        std::vector<int> fds;
+        std::vector<std::string> opened;
+
+        stream >> std::quoted(paths[0], '"', '\0') >> std::quoted(paths[1], '"', '\0');
+        std::getline(stream, ops);
+
+        for (auto& path : paths)
+        {
+            if (path.rfind("fd:", 0) != 0)
+                continue;
+
+            // Only the output is created, the input is only read unless 
+            // it's the output too, then it's edited in place
+            const std::string file = path.substr(3);
+            const bool bOutput = &path == &paths[1] || paths[1] == "fd:" + file;
+            auto it = std::find(opened.begin(), opened.end(), file);
+            if (it == opened.end())
+            {
+                const int fd = open(file.c_str(), (bOutput ? O_RDWR | O_CREAT : O_RDONLY) | O_CLOEXEC, 0600);
+                if (fd < 0)
+                    continue;
+
+                fds.push_back(fd);
+                opened.push_back(file);
+                it = opened.end() - 1;
+            }
+
+            path = "fd:" + std::to_string(it - opened.begin());
+        }
+
+        // So does "overlay fd:PATH", that one is only read
+        std::istringstream opStream(ops);
+        std::string op, rewrittenOps;
+        while (std::getline(opStream, op, ';'))
+        {
+            std::istringstream words(op);
+            std::string command, target, rest;
+            words >> command >> std::quoted(target, '"', '\0');
+
+            if (command == "overlay" && target.rfind("fd:", 0) == 0)
+            {
+                const int fd = open(target.substr(3).c_str(), O_RDONLY | O_CLOEXEC);
+                if (fd >= 0)
+                {
+                    std::getline(words, rest);
+                    op = " overlay fd:" + std::to_string(fds.size()) + rest;
+                    fds.push_back(fd);
+                }
+            }
+
+            rewrittenOps += (rewrittenOps.empty() ? "" : ";") + op;
+        }
+        ops = rewrittenOps;
+
+        if (!fds.empty())
+        {
+            std::ostringstream rewritten;
+            rewritten << '"' << paths[0] << "\" \"" << paths[1] << '"' << ops;
+            line = rewritten.str();
+        }
+
+        // The descriptors in flight are the receiver's copies, ours can go
+        const bool bSent = SWBitmaps::SendWithFds(server, line + "\n", fds);
+        CloseFds(fds);
+
+        if (!bSent)
+            break;
+    }
+
+    // The server replies to everything, then closes
+    shutdown(server, SHUT_WR);
+    reader.join();
+    close(server);
+
+    return true;
+}
+
+// Private ---------------------------------------------------------------------
+
+// -----------------------------------------------------------------------------
+void ImageServer::ServeConnection(IN std::shared_ptr<Connection> connection)
+{
+    LineReader lines;
+    lines.Socket = connection->Socket;
+
+    std::string request;
+    std::vector<int> fds;
+    uint64_t uId = 0;
+
+    while (lines.Read(request, fds))
+    {
+        const auto received = std::chrono::steady_clock::now();
+
+        if (request.empty() || request == "stats" || request == "shutdown")
+            CloseFds(fds);
+
+        if (request.empty())
+            continue;
+
+        const uint64_t uRequestId = ++uId;
+
+        if (request == "stats")
+        {
+            connection->Send("stats " + std::to_string(uRequestId) + " " + GetStatsLine());
+            continue;
+        }
+
+        if (request == "shutdown")
+        {
+            connection->Send("ok " + std::to_string(uRequestId) + " shutting down");
+            m_bRunning.store(false);
+            break;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(connection->PendingMutex);
+            connection->Pending++;
+        }
+
+        // Blocks while the queue is full, that's the backpressure on clients
+        const bool bSubmitted = m_pWorkers->Submit([this, connection, request, fds, received, uRequestId]() {
+            std::string reply;
+            std::vector<int> jobFds = fds;
+            const bool bResult = RunJob(request, jobFds, received, reply);
+            CloseFds(jobFds);
+            connection->Send((bResult ? "ok " : "error ") + std::to_string(uRequestId) + " " + reply);
+
+            std::lock_guard<std::mutex> lock(connection->PendingMutex);
+            connection->Pending--;
+            connection->PendingDone.notify_all();
+            });
+
+        if (!bSubmitted)
+        {
+            CloseFds(fds);
+            connection->Send("error " + std::to_string(uRequestId) + " server is stopping");
+
+            std::lock_guard<std::mutex> lock(connection->PendingMutex);
+            connection->Pending--;
+            break;
+        }
+    }
+
+    // Every reply goes out before the connection closes
+    {
+        std::unique_lock<std::mutex> lock(connection->PendingMutex);
+        connection->PendingDone.wait(lock, [&]() { return connection->Pending == 0; });
+    }
+
+    std::lock_guard<std::mutex> lock(m_ConnectionsMutex);
+
+    shutdown(connection->Socket, SHUT_RDWR);
+    close(connection->Socket);
+    connection->Finished = true;
+}
+
+// -----------------------------------------------------------------------------
+bool ImageServer::RunJob(IN const std::string& request, 
+    IN const std::vector<int>& fds, 
+    IN const std::chrono::steady_clock::time_point& received, 
+    IN std::string& reply)
+{
+    const auto started = std::chrono::steady_clock::now();
+    const uint64_t uQueueDepth = m_pWorkers->GetQueueDepth();
+
+    std::istringstream stream(request);
+    std::string input, output;
+    // Quotes only group, backslashes of Windows paths stay
+    stream >> std::quoted(input, '"', '\0') >> std::quoted(output, '"', '\0');
+
+    std::string ops;
+    std::getline(stream, ops);
+
+    // "fd:K" is the K-th descriptor sent with the request, never one of ours
+    for (auto* path : { &input, &output })
+    {
+        if (path->rfind("fd:", 0) != 0)
+            continue;
+
+        const std::string index = path->substr(3);
+        const uint64_t uIndex = index.empty() || index.size() > 2 || !std::all_of(index.begin(), index.end(), ::isdigit) ? 
+            fds.size() : std::stoull(index);
+
+        if (uIndex >= fds.size())
+        {
+            reply = "no descriptor " + *path + " was sent with the request";
+            return false;
+        }
+
+        *path = "fd:" + std::to_string(fds[uIndex]);
+    }
+
+    // A quote can't be written into the script line, it would end the path there
+    if (input.find('"') != std::string::npos || output.find('"') != std::string::npos)
+    {
+        reply = "paths can't contain '\"'";
+        return false;
+    }
+
+    // Ops write straight into the input only when it's also the output
+    bool bInPlace = input.rfind("shm:", 0) == 0 && input == output;
+    if (input.rfind("fd:", 0) == 0 && output.rfind("fd:", 0) == 0)
+    {
+        struct stat in = {}, out = {};
+        bInPlace = fstat(std::stoi(input.substr(3)), &in) == 0 &&
+            fstat(std::stoi(output.substr(3)), &out) == 0 &&
+            in.st_dev == out.st_dev &&
+            in.st_ino == out.st_ino;
+    }
+
+    bool bResult = !input.empty() && !output.empty();
+    ScriptRunner runner;
+    runner.SetCache(m_pCache);
+    std::ostringstream report;
+
+    // The same commands a script would have, only load and save may touch 
+    // files or descriptors, the ops get no way to reach ours
+    bResult = bResult && runner.RunLine("load \"" + input + "\"" + (bInPlace ? " inplace" : ""), report);
+
+    std::replace(ops.begin(), ops.end(), ';', '\n');
+    std::istringstream lines(ops);
+    std::string line;
+
+    runner.SetOpsOnly(true, fds);
+    while (bResult && std::getline(lines, line))
+        bResult = runner.RunLine(line, report);
+    runner.SetOpsOnly(false);
+
+    bResult = bResult && runner.RunLine("save \"" + output + "\"", report);
+
+    const auto finished = std::chrono::steady_clock::now();
+    const double fLatency = std::chrono::duration<double, std::milli>(finished - received).count();
+    const double fWait = std::chrono::duration<double, std::milli>(started - received).count();
+
+    {
+        std::lock_guard<std::mutex> lock(m_StatsMutex);
+
+        m_uJobs++;
+        m_uFailedJobs += !bResult;
+        m_fLatencySum += fLatency;
+        m_fLatencyMax = std::max(m_fLatencyMax, fLatency);
+        m_RecentLatencies[m_uRecentNext++ % m_RecentLatencies.size()] = fLatency;
+    }
+
+    if (!bResult)
+    {
+        reply = input.empty() || output.empty() ? "expected INPUT OUTPUT [OPS]" : runner.GetError();
+        return false;
+    }
+
+    reply = std::format("latency_ms={:.3f} wait_ms={:.3f} queue={}", fLatency, fWait, uQueueDepth);
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+std::string ImageServer::GetStatsLine() const
+{
+    std::lock_guard<std::mutex> lock(m_StatsMutex);
+
+    std::vector<double> recent(m_RecentLatencies.begin(), 
+        m_RecentLatencies.begin() + std::min<uint64_t>(m_uRecentNext, m_RecentLatencies.size()));
+    std::sort(recent.begin(), recent.end());
+
+    auto percentile = [&](double p) {
+        return recent.empty() ? 0.0 : recent[std::min<uint64_t>(recent.size() - 1, static_cast<uint64_t>(p * recent.size()))];
+    };
+
+    const auto& pool = SWBitmaps::BufferPool::Get();
+
+    const std::string cache = !m_pCache ? "" : std::format(" cache_mb={:.1f} cache_hits={} cache_misses={} cache_evictions={}",
+        m_pCache->GetBytes() / (1024.0 * 1024.0),
+        m_pCache->GetHits(),
+        m_pCache->GetMisses(),
+        m_pCache->GetEvictions());
+
+    return std::format("jobs={} failed={} workers={} queue={} peak_queue={} avg_ms={:.3f} p50_ms={:.3f} p99_ms={:.3f} max_ms={:.3f} pool_mb={:.1f} pool_hits={} pool_misses={}",
+        m_uJobs,
+        m_uFailedJobs,
+        m_pWorkers->GetThreadCount(),
+        m_pWorkers->GetQueueDepth(),
+        m_pWorkers->GetPeakQueueDepth(),
+        m_uJobs ? m_fLatencySum / m_uJobs : 0.0,
+        percentile(0.5),
+        percentile(0.99),
+        m_fLatencyMax,
+        pool.GetPooledBytes() / (1024.0 * 1024.0),
+        pool.GetHits(),
+        pool.GetMisses()) + cache;
+}
+
+#else
+
+struct ImageServer::Connection
+{
+};
+
+// -----------------------------------------------------------------------------
+bool ImageServer::Start(IN const std::string& socketPath, 
+    IN const uint32_t& workers, 
+    IN const uint64_t& queueCapacity, 
+    IN const uint64_t& poolBytes)
+{
+    m_Error = "server mode needs Unix domain sockets, it's only built on POSIX";
+    return false;
+}
+
+// -----------------------------------------------------------------------------
+void ImageServer::Run()
+{
+}
+
+// -----------------------------------------------------------------------------
+void ImageServer::Stop()
+{
+}
+
+// -----------------------------------------------------------------------------
+bool ImageServer::RunClient(IN const std::string& socketPath, 
+    IN std::istream& jobs, 
+    IN std::ostream& replies)
+{
+    return false;
+}
+
+#endif // _WIN32
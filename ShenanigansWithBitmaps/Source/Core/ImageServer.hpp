@@ -0,0 +1,105 @@
+#pragma once
+
+#include "WorkerPool.hpp"
+#include "ResultCache.hpp"
+
+// Serves jobs over a Unix domain socket, one request per line:
+//   INPUT OUTPUT [OP ARGS; OP ARGS; ...]   load, run the ops, save
+//   stats                                  counters of the whole server
+//   shutdown                               stops accepting and exits
+// Ops are ScriptRunner commands other than load, save, atlas and cache,
+// overlay takes only "fd:K" of a descriptor sent with the line.
+// Jobs of one connection run concurrently, so every reply starts with the
+// number of its request on the connection:
+//   ok ID latency_ms=.. wait_ms=.. queue=..
+//   error ID MESSAGE
+// INPUT and OUTPUT can be "shm:NAME", or "fd:K" for the K-th descriptor 
+// passed with the line (SCM_RIGHTS), the client makes those of "fd:PATH",
+// overlays included. Either way the image is mapped, never copied, and 
+// only written in place when INPUT and OUTPUT are the same.
+// Paths with spaces go in double quotes and can't contain one themselves.
+class ImageServer
+{
+public:
+
+    ImageServer() = default;
+
+    ~ImageServer()
+    {
+        Stop();
+    }
+
+public:
+
+    // 'queueCapacity' jobs can wait for a worker before readers block, 
+    // 'poolBytes' of released image buffers are kept for reuse.
+    // Fails when 'socketPath' is a file or the socket of a running server
+    bool Start(IN const std::string& socketPath, 
+        IN const uint32_t& workers, 
+        IN const uint64_t& queueCapacity, 
+        IN const uint64_t& poolBytes);
+
+    // Accepts connections until a shutdown request or Stop()
+    void Run();
+
+    void Stop();
+
+    // Sends every line of 'jobs', then prints the replies as they come
+    static bool RunClient(IN const std::string& socketPath, 
+        IN std::istream& jobs, 
+        IN std::ostream& replies);
+
+public:
+
+    // Getters -----------------------------------------------------------------
+
+    const std::string& GetError() const { return m_Error; }
+
+public:
+
+    // Setters -----------------------------------------------------------------
+
+    // Every job looks its op chain up here, set before Run()
+    void SetCache(IN std::shared_ptr<SWBitmaps::ResultCache> cache) { m_pCache = cache; }
+
+private:
+
+    struct Connection;
+
+    void ServeConnection(IN std::shared_ptr<Connection> connection);
+
+    // Reply is the text after "ok ID" or "error ID"
+    bool RunJob(IN const std::string& request, 
+        IN const std::vector<int>& fds, 
+        IN const std::chrono::steady_clock::time_point& received, 
+        IN std::string& reply);
+
+    std::string GetStatsLine() const;
+
+private:
+
+    std::string m_SocketPath = "";
+    std::string m_Error = "";
+
+    int m_ListenSocket = -1;
+    std::atomic_bool m_bRunning = false;
+
+    std::unique_ptr<SWBitmaps::WorkerPool> m_pWorkers = nullptr;
+    std::shared_ptr<SWBitmaps::ResultCache> m_pCache = nullptr;
+
+    // Finished ones are joined by the accept loop
+    std::mutex m_ConnectionsMutex;
+    std::vector<std::pair<std::thread, std::shared_ptr<Connection>>> m_Connections;
+
+    // Stats ------------------------------------------------------------------
+
+    mutable std::mutex m_StatsMutex;
+    uint64_t m_uJobs = 0;
+    uint64_t m_uFailedJobs = 0;
+    double m_fLatencySum = 0.0;
+    double m_fLatencyMax = 0.0;
+    // Last latencies, for the percentiles
+    std::vector<double> m_RecentLatencies;
+    uint64_t m_uRecentNext = 0;
+
+};
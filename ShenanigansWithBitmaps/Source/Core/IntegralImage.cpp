@@ -0,0 +1,186 @@
+#include "Pch.h"
+
+#include "IntegralImage.hpp"
+#include "Parallel.hpp"
+
+using namespace SWBitmaps;
+
+// -----------------------------------------------------------------------------
+// Sums and, when 'squares' isn't nullptr, sums of squares in the same passes
+template<typename T>
+static void BuildTables(IN const Bitmap& source, 
+    IN std::vector<T>& sums, 
+    IN std::vector<uint64_t>* squares)
+{
+    const uint64_t uWidth = source.GetWidth();
+    const uint64_t uHeight = source.GetHeight();
+    const uint64_t uStride = (uWidth + 1) * 3;
+
+    sums.assign(uStride * (uHeight + 1), 0);
+    if (squares)
+        squares->assign(uStride * (uHeight + 1), 0);
+
+    // Prefix sums along every row
+    ParallelFor(0, uHeight, [&](uint64_t first, uint64_t last) {
+        for (uint64_t i = first; i < last; i++)
+        {
+            const uint8_t* src = source.GetRow(i);
+            T* sum = sums.data() + ((i + 1) * uStride);
+
+            for (uint64_t k = 0; k < uWidth * 3; k++)
+                sum[k + 3] = sum[k] + src[k];
+
+            if (!squares)
+                continue;
+
+            uint64_t* square = squares->data() + ((i + 1) * uStride);
+            for (uint64_t k = 0; k < uWidth * 3; k++)
+                square[k + 3] = square[k] + ((uint32_t)src[k] * src[k]);
+        }
+        }, 16);
+
+    // Then down every column, each thread walks its own stripe of columns
+    ParallelFor(3, uStride, [&](uint64_t first, uint64_t last) {
+        for (uint64_t i = 1; i < uHeight; i++)
+        {
+            const T* above = sums.data() + (i * uStride);
+            T* sum = sums.data() + ((i + 1) * uStride);
+
+            for (uint64_t k = first; k < last; k++)
+                sum[k] += above[k];
+
+            if (!squares)
+                continue;
+
+            const uint64_t* aboveSquare = squares->data() + (i * uStride);
+            uint64_t* square = squares->data() + ((i + 1) * uStride);
+            for (uint64_t k = first; k < last; k++)
+                square[k] += aboveSquare[k];
+        }
+        }, 256);
+}
+
+// -----------------------------------------------------------------------------
+void IntegralImage::Build(IN const Bitmap& source, IN const bool& squares)
+{
+    Clear();
+
+    if (!source.IsValid() ||
+        source.GetHeader().ColorDepth != 24 ||
+        source.GetWidth() == 0 ||
+        source.GetHeight() == 0)
+        return;
+
+    m_uGeneration = source.GetGeneration();
+    m_bWide = (source.GetWidth() * source.GetHeight() * 255) > std::numeric_limits<uint32_t>::max();
+    m_bSquares = squares;
+
+    if (m_bWide)
+        BuildTables(source, m_Sums64, squares ? &m_Squares : nullptr);
+    else
+        BuildTables(source, m_Sums32, squares ? &m_Squares : nullptr);
+
+    m_uWidth = source.GetWidth();
+    m_uHeight = source.GetHeight();
+}
+
+// -----------------------------------------------------------------------------
+void IntegralImage::Clear()
+{
+    m_uWidth = 0;
+    m_uHeight = 0;
+    m_uGeneration = 0;
+    m_bSquares = false;
+
+    m_Sums32 = {};
+    m_Sums64 = {};
+    m_Squares = {};
+}
+
+// -----------------------------------------------------------------------------
+uint64_t IntegralImage::Sum(IN const uint8_t& channel,
+    IN uint64_t x, IN uint64_t y,
+    IN uint64_t width, IN uint64_t height) const
+{
+    if (channel > 2 || 
+        !Clamp(x, y, width, height))
+        return 0;
+
+    const uint64_t uStride = (m_uWidth + 1) * 3;
+
+    // Tables are in BGR order
+    if (m_bWide)
+        return Corners(m_Sums64, uStride, 2 - channel, x, y, width, height);
+
+    return Corners(m_Sums32, uStride, 2 - channel, x, y, width, height);
+}
+
+// -----------------------------------------------------------------------------
+uint64_t IntegralImage::SumOfSquares(IN const uint8_t& channel,
+    IN uint64_t x, IN uint64_t y,
+    IN uint64_t width, IN uint64_t height) const
+{
+    if (channel > 2 || 
+        !m_bSquares ||
+        !Clamp(x, y, width, height))
+        return 0;
+
+    return Corners(m_Squares, (m_uWidth + 1) * 3, 2 - channel, x, y, width, height);
+}
+
+// -----------------------------------------------------------------------------
+double IntegralImage::Mean(IN const uint8_t& channel,
+    IN const uint64_t& x, IN const uint64_t& y,
+    IN const uint64_t& width, IN const uint64_t& height) const
+{
+    uint64_t cx = x, cy = y, cw = width, ch = height;
+    if (!Clamp(cx, cy, cw, ch))
+        return 0;
+
+    return static_cast<double>(Sum(channel, cx, cy, cw, ch)) / (cw * ch);
+}
+
+// -----------------------------------------------------------------------------
+double IntegralImage::Variance(IN const uint8_t& channel,
+    IN const uint64_t& x, IN const uint64_t& y,
+    IN const uint64_t& width, IN const uint64_t& height) const
+{
+    uint64_t cx = x, cy = y, cw = width, ch = height;
+    if (!Clamp(cx, cy, cw, ch))
+        return 0;
+
+    const double fArea = static_cast<double>(cw * ch);
+    const double fMean = Sum(channel, cx, cy, cw, ch) / fArea;
+
+    return std::max(0.0, (SumOfSquares(channel, cx, cy, cw, ch) / fArea) - (fMean * fMean));
+}
+
+// Private ---------------------------------------------------------------------
+
+// -----------------------------------------------------------------------------
+bool IntegralImage::Clamp(IN uint64_t& x, IN uint64_t& y, IN uint64_t& width, IN uint64_t& height) const
+{
+    if (x >= m_uWidth || y >= m_uHeight)
+        return false;
+
+    width = std::min(width, m_uWidth - x);
+    height = std::min(height, m_uHeight - y);
+
+    return width && height;
+}
+
+// -----------------------------------------------------------------------------
+template<typename T>
+uint64_t IntegralImage::Corners(IN const std::vector<T>& table, 
+    IN const uint64_t& stride,
+    IN const uint8_t& channel,
+    IN const uint64_t& x, IN const uint64_t& y,
+    IN const uint64_t& width, IN const uint64_t& height)
+{
+    const T* top = table.data() + (y * stride) + channel;
+    const T* bottom = table.data() + ((y + height) * stride) + channel;
+
+    // Unsigned, so the intermediate wrap around is harmless
+    const T sum = bottom[(x + width) * 3] - bottom[x * 3] - top[(x + width) * 3] + top[x * 3];
+    return sum;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "Bitmap.hpp"
+
+namespace SWBitmaps
+{
+    // Summed-area tables of every channel of a 24-bit bitmap, plus the sums 
+    // of squares. Any rectangle sum is four lookups. 
+    // Rows are counted in file order, channels the same way as in Color.
+    // Squares are only built when asked for, SumOfSquares() and Variance() 
+    // need them and are zero without.
+    class IntegralImage
+    {
+    public:
+
+        IntegralImage() = default;
+
+        ~IntegralImage() = default;
+
+    public:
+
+        void Build(IN const Bitmap& source, IN const bool& squares = false);
+
+        void Clear();
+
+        // Rectangle [x, x + width) x [y, y + height), clamped to the image
+        uint64_t Sum(IN const uint8_t& channel,
+            IN uint64_t x, IN uint64_t y,
+            IN uint64_t width, IN uint64_t height) const;
+
+        uint64_t SumOfSquares(IN const uint8_t& channel,
+            IN uint64_t x, IN uint64_t y,
+            IN uint64_t width, IN uint64_t height) const;
+
+        double Mean(IN const uint8_t& channel,
+            IN const uint64_t& x, IN const uint64_t& y,
+            IN const uint64_t& width, IN const uint64_t& height) const;
+
+        double Variance(IN const uint8_t& channel,
+            IN const uint64_t& x, IN const uint64_t& y,
+            IN const uint64_t& width, IN const uint64_t& height) const;
+
+    public:
+
+        // Getters -------------------------------------------------------------
+
+        bool IsValid() const { return m_uWidth != 0; }
+
+        bool HasSquares() const { return m_bSquares; }
+
+        const uint64_t& GetGeneration() const { return m_uGeneration; }
+
+        const uint64_t& GetWidth() const { return m_uWidth; }
+
+        const uint64_t& GetHeight() const { return m_uHeight; }
+
+    private:
+
+        // Clamps the rectangle, false if it's empty
+        bool Clamp(IN uint64_t& x, IN uint64_t& y, IN uint64_t& width, IN uint64_t& height) const;
+
+        template<typename T>
+        static uint64_t Corners(IN const std::vector<T>& table, 
+            IN const uint64_t& stride,
+            IN const uint8_t& channel,
+            IN const uint64_t& x, IN const uint64_t& y,
+            IN const uint64_t& width, IN const uint64_t& height);
+
+    private:
+
+        uint64_t m_uWidth = 0;
+        uint64_t m_uHeight = 0;
+        uint64_t m_uGeneration = 0;
+
+        // (width + 1) x (height + 1) entries of three channels in BGR order,
+        // the first row and column are zeros. Narrow sums are used 
+        // while the sum of the whole image fits in them
+        bool m_bWide = false;
+        std::vector<uint32_t> m_Sums32;
+        std::vector<uint64_t> m_Sums64;
+        bool m_bSquares = false;
+        std::vector<uint64_t> m_Squares;
+
+    };
+}
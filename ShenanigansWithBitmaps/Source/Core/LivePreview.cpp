@@ -0,0 +1,189 @@
+#include "Pch.h"
+
+#include "LivePreview.hpp"
+#include "TerminalRenderer.hpp"
+#include "Parallel.hpp"
+
+// Edits dirtying more cells than this are recomputed on all threads
+#define PREVIEW_PARALLEL_CELLS 64
+
+// -----------------------------------------------------------------------------
+bool SWHexEditor::LivePreview::Build(IN const SWBitmaps::Bitmap& target, 
+    IN const uint32_t& columns, 
+    IN const uint32_t& lines)
+{
+    m_Lines.clear();
+
+    const auto& header = target.GetHeader();
+    const uint64_t uWidth = target.GetWidth();
+    const uint64_t uHeight = target.GetHeight();
+
+    if (!target.IsValid() ||
+        header.ColorDepth != 24 ||
+        uWidth == 0 || uHeight == 0 ||
+        columns == 0 || lines == 0)
+        return false;
+
+    // Half blocks make the cells square, every cell covers at least one pixel
+    uint64_t uColumns = std::min<uint64_t>(columns, uWidth);
+    uint64_t uRows = std::max<uint64_t>(1, (uColumns * uHeight) / uWidth);
+    if (uRows > (uint64_t)lines * 2)
+    {
+        uRows = (uint64_t)lines * 2;
+        uColumns = std::clamp<uint64_t>((uRows * uWidth) / uHeight, 1, uColumns);
+    }
+    uRows = std::min(uRows, uHeight);
+
+    m_uColumns = static_cast<uint32_t>(uColumns);
+    m_uRows = static_cast<uint32_t>(uRows);
+
+    m_ColumnStarts.resize(m_uColumns + 1);
+    for (uint64_t i = 0; i <= m_uColumns; i++)
+        m_ColumnStarts[i] = (i * uWidth) / m_uColumns;
+
+    m_RowStarts.resize(m_uRows + 1);
+    for (uint64_t i = 0; i <= m_uRows; i++)
+        m_RowStarts[i] = (i * uHeight) / m_uRows;
+
+    // Odd row count leaves the lower half of the last line black
+    m_Cells.assign((uint64_t)m_uColumns * (m_uRows + (m_uRows & 1)) * 3, 0);
+    m_Lines.assign((m_uRows + 1) / 2, std::string());
+
+    SWBitmaps::ParallelFor(0, m_uRows, [&](uint64_t first, uint64_t last) {
+        for (uint64_t y = first; y < last; y++)
+            for (uint32_t x = 0; x < m_uColumns; x++)
+                UpdateCell(target, x, static_cast<uint32_t>(y));
+        }, 4);
+
+    for (uint64_t i = 0; i < m_Lines.size(); i++)
+        RenderLine(i);
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+bool SWHexEditor::LivePreview::Invalidate(IN const SWBitmaps::Bitmap& target, 
+    IN const uint64_t& offset, 
+    IN const uint64_t& size)
+{
+    if (!IsValid() || size == 0)
+        return false;
+
+    const auto& header = target.GetHeader();
+    const uint64_t uBegin = header.FileBeginOffset;
+    const uint64_t uPitch = target.GetPitch();
+    const uint64_t uHeight = target.GetHeight();
+    const uint64_t uRowBytes = target.GetWidth() * 3;
+
+    const uint64_t uFirst = std::max(offset, uBegin);
+    const uint64_t uLast = std::min(offset + size, uBegin + (uPitch * uHeight));
+    if (uFirst >= uLast)
+        return false;
+
+    std::vector<uint8_t> dirty((uint64_t)m_uColumns * m_uRows, 0);
+    uint64_t uDirtyCount = 0;
+
+    // File rows the range touches, only the first and the last one can be partial
+    const uint64_t uFirstRow = (uFirst - uBegin) / uPitch;
+    const uint64_t uLastRow = (uLast - 1 - uBegin) / uPitch;
+
+    for (uint64_t row = uFirstRow; row <= uLastRow; row++)
+    {
+        const uint64_t uRowBegin = uBegin + (row * uPitch);
+        const uint64_t uFrom = std::max(uFirst, uRowBegin) - uRowBegin;
+        const uint64_t uTo = std::min(uLast - uRowBegin, uRowBytes);
+
+        // Only the padding changed
+        if (uFrom >= uTo)
+            continue;
+
+        // Rows are stored bottom-up unless the height is negative
+        const uint64_t uImageRow = header.Height > 0 ? uHeight - 1 - row : row;
+        const uint32_t y = FindCell(m_RowStarts, uImageRow);
+        const uint32_t uFromCell = FindCell(m_ColumnStarts, uFrom / 3);
+        const uint32_t uToCell = FindCell(m_ColumnStarts, (uTo - 1) / 3);
+
+        for (uint32_t x = uFromCell; x <= uToCell; x++)
+        {
+            uint8_t& d = dirty[((uint64_t)y * m_uColumns) + x];
+            uDirtyCount += d == 0;
+            d = 1;
+        }
+    }
+
+    if (uDirtyCount == 0)
+        return false;
+
+    std::vector<uint8_t> dirtyLines(m_Lines.size(), 0);
+    for (uint32_t y = 0; y < m_uRows; y++)
+        for (uint32_t x = 0; x < m_uColumns; x++)
+            if (dirty[((uint64_t)y * m_uColumns) + x])
+                dirtyLines[y / 2] = 1;
+
+    SWBitmaps::ParallelFor(0, m_uRows, [&](uint64_t first, uint64_t last) {
+        for (uint64_t y = first; y < last; y++)
+            for (uint32_t x = 0; x < m_uColumns; x++)
+                if (dirty[(y * m_uColumns) + x])
+                    UpdateCell(target, x, static_cast<uint32_t>(y));
+        }, uDirtyCount > PREVIEW_PARALLEL_CELLS ? 4 : m_uRows);
+
+    for (uint64_t i = 0; i < m_Lines.size(); i++)
+        if (dirtyLines[i])
+            RenderLine(i);
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+const std::string& SWHexEditor::LivePreview::GetLine(IN const uint64_t& i) const
+{
+    static const std::string empty;
+
+    return i < m_Lines.size() ? m_Lines[i] : empty;
+}
+
+// Private ---------------------------------------------------------------------
+
+// -----------------------------------------------------------------------------
+void SWHexEditor::LivePreview::UpdateCell(IN const SWBitmaps::Bitmap& target, IN const uint32_t& x, IN const uint32_t& y)
+{
+    const uint64_t uHeight = target.GetHeight();
+    const bool bBottomUp = target.GetHeader().Height > 0;
+
+    const uint64_t uFirstColumn = m_ColumnStarts[x];
+    const uint64_t uLastColumn = m_ColumnStarts[x + 1];
+    uint64_t sums[3] = {};
+
+    for (uint64_t i = m_RowStarts[y]; i < m_RowStarts[y + 1]; i++)
+    {
+        const uint8_t* row = target.GetRow(bBottomUp ? uHeight - 1 - i : i);
+
+        for (uint64_t k = uFirstColumn * 3; k < uLastColumn * 3; k += 3)
+        {
+            sums[0] += row[k + 0];
+            sums[1] += row[k + 1];
+            sums[2] += row[k + 2];
+        }
+    }
+
+    const uint64_t uArea = (uLastColumn - uFirstColumn) * (m_RowStarts[y + 1] - m_RowStarts[y]);
+    uint8_t* dst = m_Cells.data() + ((((uint64_t)y * m_uColumns) + x) * 3);
+
+    for (uint8_t ch = 0; ch < 3; ch++)
+        dst[ch] = static_cast<uint8_t>((sums[ch] + (uArea / 2)) / uArea);
+}
+
+// -----------------------------------------------------------------------------
+void SWHexEditor::LivePreview::RenderLine(IN const uint64_t& i)
+{
+    const uint8_t* upper = m_Cells.data() + (i * 2 * m_uColumns * 3);
+
+    m_Lines[i].clear();
+    TerminalRenderer::AppendHalfBlockRow(m_Lines[i], upper, upper + ((uint64_t)m_uColumns * 3), m_uColumns);
+}
+
+// -----------------------------------------------------------------------------
+uint32_t SWHexEditor::LivePreview::FindCell(IN const std::vector<uint64_t>& starts, IN const uint64_t& pixel)
+{
+    return static_cast<uint32_t>(std::upper_bound(starts.begin(), starts.end(), pixel) - starts.begin() - 1);
+}
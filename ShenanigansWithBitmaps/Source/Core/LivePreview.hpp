@@ -0,0 +1,68 @@
+#pragma once
+
+#include "Bitmap.hpp"
+
+namespace SWHexEditor
+{
+    // Downsampled true color view of a 24-bit bitmap that follows byte edits,
+    // every cell is the average of the full resolution pixels it covers, 
+    // so an edit only has to recompute the cells its pixels fall in
+    class LivePreview
+    {
+    public:
+
+        LivePreview() = default;
+
+        ~LivePreview() = default;
+
+    public:
+
+        // At most 'columns' wide and 'lines' tall, two cells per line
+        bool Build(IN const SWBitmaps::Bitmap& target, 
+            IN const uint32_t& columns, 
+            IN const uint32_t& lines);
+
+        // Bytes [offset, offset + size) of the file changed, 
+        // false if no cell covers any of them
+        bool Invalidate(IN const SWBitmaps::Bitmap& target, 
+            IN const uint64_t& offset, 
+            IN const uint64_t& size);
+
+    public:
+
+        // Getters -------------------------------------------------------------
+
+        bool IsValid() const { return !m_Lines.empty(); }
+
+        uint32_t GetColumns() const { return m_uColumns; }
+
+        uint64_t GetLineCount() const { return m_Lines.size(); }
+
+        // Empty past the last line
+        const std::string& GetLine(IN const uint64_t& i) const;
+
+    private:
+
+        // Top row first
+        void UpdateCell(IN const SWBitmaps::Bitmap& target, IN const uint32_t& x, IN const uint32_t& y);
+
+        void RenderLine(IN const uint64_t& i);
+
+        // The cell covering 'pixel' out of 'starts'
+        static uint32_t FindCell(IN const std::vector<uint64_t>& starts, IN const uint64_t& pixel);
+
+    private:
+
+        uint32_t m_uColumns = 0;
+        uint32_t m_uRows = 0;
+
+        // Cell i covers pixels [starts[i], starts[i + 1]), rows counted from the top
+        std::vector<uint64_t> m_ColumnStarts;
+        std::vector<uint64_t> m_RowStarts;
+
+        // BGR, top row first
+        std::vector<uint8_t> m_Cells;
+        std::vector<std::string> m_Lines;
+
+    };
+}
@@ -0,0 +1,129 @@
+#include "Pch.h"
+
+#include "Luma.hpp"
+#include "Simd.hpp"
+
+using namespace SWBitmaps;
+
+// Fixed point weights in 1/256, every set sums up to 256
+struct FixedWeights
+{
+    uint16_t Red;
+    uint16_t Green;
+    uint16_t Blue;
+};
+
+// -----------------------------------------------------------------------------
+static FixedWeights GetFixedWeights(IN const LumaWeights& weights)
+{
+    switch (weights)
+    {
+    case BT601:
+        return { 77, 150, 29 };
+
+    case BT709:
+        return { 54, 183, 19 };
+
+    default:
+        throw;
+    }
+}
+
+// -----------------------------------------------------------------------------
+void SWBitmaps::ComputeLumaRow(IN const uint8_t* bgr,
+    IN uint8_t* luma,
+    IN const uint64_t& width,
+    IN const LumaWeights& weights)
+{
+    uint64_t k = 0;
+
+    if (weights == Average)
+    {
+#ifdef SWB_SSSE3
+        // (sum * 21846) >> 16 is exactly sum / 3 for every sum up to 765
+        const __m128i third = _mm_set1_epi16(21846);
+        const __m128i zero = _mm_setzero_si128();
+
+        for (; k + 16 <= width; k += 16)
+        {
+            __m128i b, g, r;
+            Simd::LoadBgr16(&bgr[k * 3], b, g, r);
+
+            const __m128i lo = _mm_add_epi16(_mm_add_epi16(
+                _mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(g, zero)), _mm_unpacklo_epi8(r, zero));
+            const __m128i hi = _mm_add_epi16(_mm_add_epi16(
+                _mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(g, zero)), _mm_unpackhi_epi8(r, zero));
+
+            _mm_storeu_si128((__m128i*) &luma[k], _mm_packus_epi16(
+                _mm_mulhi_epu16(lo, third), _mm_mulhi_epu16(hi, third)));
+        }
+#endif // SWB_SSSE3
+
+        for (; k < width; k++)
+            luma[k] = (static_cast<uint32_t>(bgr[k * 3]) + bgr[k * 3 + 1] + bgr[k * 3 + 2]) / 3;
+
+        return;
+    }
+
+    const FixedWeights w = GetFixedWeights(weights);
+
+#ifdef SWB_SSSE3
+    // Worst case is 256 * 255 + 128, so the sum never leaves unsigned 16 bits
+    const __m128i wRed = _mm_set1_epi16(w.Red);
+    const __m128i wGreen = _mm_set1_epi16(w.Green);
+    const __m128i wBlue = _mm_set1_epi16(w.Blue);
+    const __m128i half = _mm_set1_epi16(128);
+    const __m128i zero = _mm_setzero_si128();
+
+    for (; k + 16 <= width; k += 16)
+    {
+        __m128i b, g, r;
+        Simd::LoadBgr16(&bgr[k * 3], b, g, r);
+
+        __m128i lo = _mm_add_epi16(_mm_add_epi16(
+            _mm_mullo_epi16(_mm_unpacklo_epi8(r, zero), wRed),
+            _mm_mullo_epi16(_mm_unpacklo_epi8(g, zero), wGreen)),
+            _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), wBlue), half));
+        __m128i hi = _mm_add_epi16(_mm_add_epi16(
+            _mm_mullo_epi16(_mm_unpackhi_epi8(r, zero), wRed),
+            _mm_mullo_epi16(_mm_unpackhi_epi8(g, zero), wGreen)),
+            _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), wBlue), half));
+
+        lo = _mm_srli_epi16(lo, 8);
+        hi = _mm_srli_epi16(hi, 8);
+
+        _mm_storeu_si128((__m128i*) &luma[k], _mm_packus_epi16(lo, hi));
+    }
+#endif // SWB_SSSE3
+
+    for (; k < width; k++)
+    {
+        luma[k] = static_cast<uint8_t>(((w.Red * bgr[k * 3 + 2]) 
+            + (w.Green * bgr[k * 3 + 1]) 
+            + (w.Blue * bgr[k * 3]) 
+            + 128) >> 8);
+    }
+}
+
+// -----------------------------------------------------------------------------
+void SWBitmaps::ExpandLumaRow(IN const uint8_t* luma,
+    IN uint8_t* bgr,
+    IN const uint64_t& width)
+{
+    uint64_t k = 0;
+
+#ifdef SWB_SSSE3
+    for (; k + 16 <= width; k += 16)
+    {
+        const __m128i y = _mm_loadu_si128((const __m128i*) &luma[k]);
+        Simd::StoreBgr16(&bgr[k * 3], y, y, y);
+    }
+#endif // SWB_SSSE3
+
+    for (; k < width; k++)
+    {
+        bgr[k * 3] = luma[k];
+        bgr[k * 3 + 1] = luma[k];
+        bgr[k * 3 + 2] = luma[k];
+    }
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+namespace SWBitmaps
+{
+    enum LumaWeights
+    {
+        // (R + G + B) / 3
+        Average,
+        // 0.299 R + 0.587 G + 0.114 B
+        BT601,
+        // 0.2126 R + 0.7152 G + 0.0722 B
+        BT709
+    };
+
+    // Computes luma of 'width' BGR pixels into 'luma'
+    void ComputeLumaRow(IN const uint8_t* bgr,
+        IN uint8_t* luma,
+        IN const uint64_t& width,
+        IN const LumaWeights& weights);
+
+    // Writes every luma value three times, so the row stays BGR. 
+    // 'bgr' may be the same row the luma was computed from.
+    void ExpandLumaRow(IN const uint8_t* luma,
+        IN uint8_t* bgr,
+        IN const uint64_t& width);
+}
@@ -0,0 +1,385 @@
+#include "Pch.h"
+
+#include "Median.hpp"
+#include "Parallel.hpp"
+
+using namespace SWBitmaps;
+
+// Tiles are at least this big, the window histogram is rebuilt at the start of every row of a tile
+#define MEDIAN_TILE_WIDTH 256
+#define MEDIAN_TILE_HEIGHT 256
+
+// Compare-exchange pairs, the lower index ends up with the minimum. These are the
+// opt_med9 and opt_med25 networks of N. Devillard, they only place the middle element.
+static const uint8_t s_Network9[][2] = {
+    { 1, 2 }, { 4, 5 }, { 7, 8 }, { 0, 1 }, { 3, 4 }, { 6, 7 }, { 1, 2 }, { 4, 5 }, { 7, 8 }, { 0, 3 },
+    { 5, 8 }, { 4, 7 }, { 3, 6 }, { 1, 4 }, { 2, 5 }, { 4, 7 }, { 4, 2 }, { 6, 4 }, { 4, 2 } };
+
+static const uint8_t s_Network25[][2] = {
+    { 0, 1 }, { 3, 4 }, { 2, 4 }, { 2, 3 }, { 6, 7 }, { 5, 7 }, { 5, 6 }, { 9, 10 }, { 8, 10 }, { 8, 9 },
+    { 12, 13 }, { 11, 13 }, { 11, 12 }, { 15, 16 }, { 14, 16 }, { 14, 15 }, { 18, 19 }, { 17, 19 }, { 17, 18 }, { 21, 22 },
+    { 20, 22 }, { 20, 21 }, { 23, 24 }, { 2, 5 }, { 3, 6 }, { 0, 6 }, { 0, 3 }, { 4, 7 }, { 1, 7 }, { 1, 4 },
+    { 11, 14 }, { 8, 14 }, { 8, 11 }, { 12, 15 }, { 9, 15 }, { 9, 12 }, { 13, 16 }, { 10, 16 }, { 10, 13 }, { 20, 23 },
+    { 17, 23 }, { 17, 20 }, { 21, 24 }, { 18, 24 }, { 18, 21 }, { 19, 22 }, { 8, 17 }, { 9, 18 }, { 0, 18 }, { 0, 9 },
+    { 10, 19 }, { 1, 19 }, { 1, 10 }, { 11, 20 }, { 2, 20 }, { 2, 11 }, { 12, 21 }, { 3, 21 }, { 3, 12 }, { 13, 22 },
+    { 4, 22 }, { 4, 13 }, { 14, 23 }, { 5, 23 }, { 5, 14 }, { 15, 24 }, { 6, 24 }, { 6, 15 }, { 7, 16 }, { 7, 19 },
+    { 13, 21 }, { 15, 23 }, { 7, 13 }, { 7, 15 }, { 1, 9 }, { 3, 11 }, { 5, 17 }, { 11, 17 }, { 9, 17 }, { 4, 10 },
+    { 6, 12 }, { 7, 14 }, { 4, 6 }, { 4, 7 }, { 12, 14 }, { 10, 14 }, { 6, 7 }, { 10, 12 }, { 6, 10 }, { 6, 17 },
+    { 12, 17 }, { 7, 17 }, { 7, 10 }, { 12, 18 }, { 7, 12 }, { 10, 18 }, { 12, 20 }, { 10, 20 }, { 10, 12 } };
+
+// -----------------------------------------------------------------------------
+static inline void SortPair(IN uint8_t& a, IN uint8_t& b)
+{
+    const uint8_t t = std::min(a, b);
+    b = std::max(a, b);
+    a = t;
+}
+
+#ifdef SWB_SSE2
+// -----------------------------------------------------------------------------
+static inline void SortPair(IN __m128i& a, IN __m128i& b)
+{
+    const __m128i t = _mm_min_epu8(a, b);
+    b = _mm_max_epu8(a, b);
+    a = t;
+}
+#endif // SWB_SSE2
+
+// -----------------------------------------------------------------------------
+// Window values of one lane, or of 16 lanes at once, sorted far enough to know the middle one
+template<typename T, uint64_t Size, uint64_t Pairs>
+static inline T MedianOf(IN T* values, IN const uint8_t(&network)[Pairs][2])
+{
+    for (uint64_t i = 0; i < Pairs; i++)
+        SortPair(values[network[i][0]], values[network[i][1]]);
+
+    return values[Size / 2];
+}
+
+// -----------------------------------------------------------------------------
+// Copy of the pixels with 'radius' replicated pixels on every side
+static std::vector<uint8_t> MakePadded(IN const Bitmap& bitmap, IN const uint64_t& radius)
+{
+    const uint64_t uWidth = bitmap.GetWidth();
+    const uint64_t uHeight = bitmap.GetHeight();
+    const uint64_t uStride = (uWidth + (2 * radius)) * 3;
+
+    std::vector<uint8_t> padded(uStride * (uHeight + (2 * radius)));
+
+    ParallelFor(0, uHeight + (2 * radius), [&](uint64_t first, uint64_t last) {
+        for (uint64_t i = first; i < last; i++)
+        {
+            const uint64_t uSourceRow = std::clamp<int64_t>(static_cast<int64_t>(i) - radius, 0, uHeight - 1);
+            const uint8_t* src = bitmap.GetRow(uSourceRow);
+            uint8_t* dst = &padded[i * uStride];
+
+            memcpy(dst + (radius * 3), src, uWidth * 3);
+
+            for (uint64_t p = 0; p < radius; p++)
+            {
+                memcpy(dst + (p * 3), src, 3);
+                memcpy(dst + ((radius + uWidth + p) * 3), src + ((uWidth - 1) * 3), 3);
+            }
+        }
+        });
+
+    return padded;
+}
+
+// -----------------------------------------------------------------------------
+template<uint64_t Radius, uint64_t Pairs>
+static void MedianNetwork(IN Bitmap& bitmap, IN const uint8_t(&network)[Pairs][2])
+{
+    constexpr uint64_t uSide = (2 * Radius) + 1;
+    constexpr uint64_t uSize = uSide * uSide;
+
+    const std::vector<uint8_t> padded = MakePadded(bitmap, Radius);
+    const uint64_t uRowBytes = bitmap.GetWidth() * 3;
+    const uint64_t uStride = uRowBytes + (2 * Radius * 3);
+
+    ParallelFor(0, bitmap.GetHeight(), [&](uint64_t first, uint64_t last) {
+        for (uint64_t i = first; i < last; i++)
+        {
+            // Window of the output row starts at the same padded row, one channel is 3 bytes apart
+            const uint8_t* src = &padded[i * uStride];
+            uint8_t* dst = bitmap.GetRow(i);
+            uint64_t b = 0;
+
+#ifdef SWB_SSE2
+            for (; b + 16 <= uRowBytes; b += 16)
+            {
+                __m128i values[uSize];
+                for (uint64_t y = 0; y < uSide; y++)
+                    for (uint64_t x = 0; x < uSide; x++)
+                        values[(y * uSide) + x] = _mm_loadu_si128((const __m128i*) &src[(y * uStride) + b + (x * 3)]);
+
+                _mm_storeu_si128((__m128i*) &dst[b], MedianOf<__m128i, uSize>(values, network));
+            }
+#endif // SWB_SSE2
+
+            for (; b < uRowBytes; b++)
+            {
+                uint8_t values[uSize];
+                for (uint64_t y = 0; y < uSide; y++)
+                    for (uint64_t x = 0; x < uSide; x++)
+                        values[(y * uSide) + x] = src[(y * uStride) + b + (x * 3)];
+
+                dst[b] = MedianOf<uint8_t, uSize>(values, network);
+            }
+        }
+        });
+}
+
+// Histograms --------------------------------------------------------------------
+
+// Coarse bins count the high nibble, every one of them covers 16 fine bins
+struct MedianHistograms
+{
+    // Per padded column of the tile, 3 channels of 16 coarse and 256 fine bins
+    std::vector<uint16_t> ColumnCoarse;
+    std::vector<uint16_t> ColumnFine;
+
+    // The window, fine bins are only brought up to date when the median falls into them
+    uint16_t Coarse[3 * 16] = {};
+    uint16_t Fine[3 * 256] = {};
+    int64_t FineColumn[3 * 16] = {};
+};
+
+// -----------------------------------------------------------------------------
+template<uint64_t Count>
+static inline void AddBins(IN uint16_t* dst, IN const uint16_t* add)
+{
+    uint64_t k = 0;
+
+#ifdef SWB_SSE2
+    for (; k < Count; k += 8)
+    {
+        const __m128i d = _mm_loadu_si128((const __m128i*) &dst[k]);
+        _mm_storeu_si128((__m128i*) &dst[k], _mm_add_epi16(d, _mm_loadu_si128((const __m128i*) &add[k])));
+    }
+#endif // SWB_SSE2
+
+    for (; k < Count; k++)
+        dst[k] = static_cast<uint16_t>(dst[k] + add[k]);
+}
+
+// -----------------------------------------------------------------------------
+// dst += add - sub
+template<uint64_t Count>
+static inline void AddSubBins(IN uint16_t* dst, IN const uint16_t* add, IN const uint16_t* sub)
+{
+    uint64_t k = 0;
+
+#ifdef SWB_SSE2
+    for (; k < Count; k += 8)
+    {
+        const __m128i d = _mm_loadu_si128((const __m128i*) &dst[k]);
+        const __m128i a = _mm_loadu_si128((const __m128i*) &add[k]);
+        const __m128i s = _mm_loadu_si128((const __m128i*) &sub[k]);
+        _mm_storeu_si128((__m128i*) &dst[k], _mm_sub_epi16(_mm_add_epi16(d, a), s));
+    }
+#endif // SWB_SSE2
+
+    for (; k < Count; k++)
+        dst[k] = static_cast<uint16_t>(dst[k] + add[k] - sub[k]);
+}
+
+// -----------------------------------------------------------------------------
+// First of 16 bins where the running count passes 'rank', 'below' is the count before it
+static inline uint8_t FindBin(IN const uint16_t* bins, IN const uint32_t& rank, IN uint32_t& below)
+{
+#ifdef SWB_SSE2
+    // Running counts, without a branch per bin
+    __m128i lo = _mm_loadu_si128((const __m128i*) &bins[0]);
+    __m128i hi = _mm_loadu_si128((const __m128i*) &bins[8]);
+
+    lo = _mm_add_epi16(lo, _mm_slli_si128(lo, 2));
+    hi = _mm_add_epi16(hi, _mm_slli_si128(hi, 2));
+    lo = _mm_add_epi16(lo, _mm_slli_si128(lo, 4));
+    hi = _mm_add_epi16(hi, _mm_slli_si128(hi, 4));
+    lo = _mm_add_epi16(lo, _mm_slli_si128(lo, 8));
+    hi = _mm_add_epi16(hi, _mm_slli_si128(hi, 8));
+    hi = _mm_add_epi16(hi, _mm_unpackhi_epi64(_mm_shufflehi_epi16(lo, 0xFF), _mm_shufflehi_epi16(lo, 0xFF)));
+
+    // Counts go up to 65025, unsigned saturation keeps the comparison right
+    const __m128i limit = _mm_set1_epi16(static_cast<int16_t>(rank));
+    const __m128i zero = _mm_setzero_si128();
+    const uint32_t uMask = _mm_movemask_epi8(_mm_packs_epi16(
+        _mm_cmpeq_epi16(_mm_subs_epu16(lo, limit), zero),
+        _mm_cmpeq_epi16(_mm_subs_epu16(hi, limit), zero)));
+
+    // Running counts only grow, so the bins at or under 'rank' come first
+    const uint8_t b = static_cast<uint8_t>(std::popcount(uMask));
+
+    alignas(16) uint16_t counts[16];
+    _mm_store_si128((__m128i*) &counts[0], lo);
+    _mm_store_si128((__m128i*) &counts[8], hi);
+
+    below = b ? counts[b - 1] : 0;
+    return b;
+#else
+    uint8_t b = 0;
+    below = 0;
+
+    while (below + bins[b] <= rank)
+        below += bins[b++];
+
+    return b;
+#endif // SWB_SSE2
+}
+
+// -----------------------------------------------------------------------------
+static void MedianTile(IN Bitmap& bitmap,
+    IN const std::vector<uint8_t>& padded,
+    IN const uint64_t& radius,
+    IN const uint64_t& x0,
+    IN const uint64_t& x1,
+    IN const uint64_t& y0,
+    IN const uint64_t& y1,
+    IN MedianHistograms& state)
+{
+    const uint64_t uSide = (2 * radius) + 1;
+    const uint64_t uStride = (bitmap.GetWidth() + (2 * radius)) * 3;
+    const uint64_t uColumns = (x1 - x0) + (2 * radius);
+    const uint32_t uRank = static_cast<uint32_t>((uSide * uSide) / 2);
+
+    // Output columns [x0, x1) read padded columns [x0, x1 + 2 * radius)
+    state.ColumnCoarse.assign(uColumns * 3 * 16, 0);
+    state.ColumnFine.assign(uColumns * 3 * 256, 0);
+
+    auto coarse = [&](uint64_t column) { return &state.ColumnCoarse[(column - x0) * 3 * 16]; };
+    auto fine = [&](uint64_t column) { return &state.ColumnFine[(column - x0) * 3 * 256]; };
+
+    auto update = [&](uint64_t row, int16_t delta) {
+        const uint8_t* src = &padded[(row * uStride) + (x0 * 3)];
+
+        for (uint64_t j = 0; j < uColumns; j++)
+        {
+            uint16_t* pCoarse = &state.ColumnCoarse[j * 3 * 16];
+            uint16_t* pFine = &state.ColumnFine[j * 3 * 256];
+
+            for (uint8_t c = 0; c < 3; c++)
+            {
+                const uint8_t v = src[(j * 3) + c];
+                pCoarse[(c * 16) + (v >> 4)] += delta;
+                pFine[(c * 256) + v] += delta;
+            }
+        }
+    };
+
+    // Output row y reads padded rows [y, y + 2 * radius]
+    for (uint64_t r = y0; r < y0 + uSide; r++)
+        update(r, 1);
+
+    for (uint64_t y = y0; y < y1; y++)
+    {
+        if (y > y0)
+        {
+            update(y - 1, -1);
+            update(y + uSide - 1, 1);
+        }
+
+        memset(state.Coarse, 0, sizeof(state.Coarse));
+        for (uint64_t j = x0; j < x0 + uSide; j++)
+            AddBins<3 * 16>(state.Coarse, coarse(j));
+
+        std::fill(std::begin(state.FineColumn), std::end(state.FineColumn), std::numeric_limits<int64_t>::min());
+
+        uint8_t* dst = bitmap.GetRow(y);
+
+        for (uint64_t x = x0; x < x1; x++)
+        {
+            if (x > x0)
+                AddSubBins<3 * 16>(state.Coarse, coarse(x + uSide - 1), coarse(x - 1));
+
+            for (uint8_t c = 0; c < 3; c++)
+            {
+                // Coarse bin holding the median, then its fine bins
+                uint32_t uBelow = 0;
+                const uint8_t b = FindBin(&state.Coarse[c * 16], uRank, uBelow);
+
+                uint16_t* pFine = &state.Fine[(c * 256) + (b * 16)];
+                int64_t& iColumn = state.FineColumn[(c * 16) + b];
+                const uint64_t uOffset = (c * 256) + (b * 16);
+
+                // Slide from where it was last used while that is cheaper than a rebuild
+                if (iColumn >= static_cast<int64_t>(x0) && 2 * (x - iColumn) < uSide)
+                {
+                    for (uint64_t j = iColumn + 1; j <= x; j++)
+                        AddSubBins<16>(pFine, fine(j + uSide - 1) + uOffset, fine(j - 1) + uOffset);
+                }
+                else
+                {
+                    memset(pFine, 0, 16 * sizeof(uint16_t));
+                    for (uint64_t j = x; j < x + uSide; j++)
+                        AddBins<16>(pFine, fine(j) + uOffset);
+                }
+
+                iColumn = x;
+
+                uint32_t uFineBelow = 0;
+                const uint8_t f = FindBin(pFine, uRank - uBelow, uFineBelow);
+
+                dst[(x * 3) + c] = static_cast<uint8_t>((b * 16) + f);
+            }
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------
+static void MedianHistogram(IN Bitmap& bitmap, IN const uint64_t& radius)
+{
+    const std::vector<uint8_t> padded = MakePadded(bitmap, radius);
+    const uint64_t uWidth = bitmap.GetWidth();
+    const uint64_t uHeight = bitmap.GetHeight();
+
+    // Tiles much larger than the window keep rebuilding the histograms cheap
+    const uint64_t uTileWidth = std::max<uint64_t>(MEDIAN_TILE_WIDTH, 8 * radius);
+    const uint64_t uTileHeight = std::max<uint64_t>(MEDIAN_TILE_HEIGHT, 8 * radius);
+    const uint64_t uTilesX = (uWidth + uTileWidth - 1) / uTileWidth;
+    const uint64_t uTilesY = (uHeight + uTileHeight - 1) / uTileHeight;
+
+    ParallelFor(0, uTilesX * uTilesY, [&](uint64_t first, uint64_t last) {
+        MedianHistograms state;
+
+        for (uint64_t t = first; t < last; t++)
+        {
+            const uint64_t x0 = (t % uTilesX) * uTileWidth;
+            const uint64_t y0 = (t / uTilesX) * uTileHeight;
+
+            MedianTile(bitmap, padded, radius,
+                x0, std::min(x0 + uTileWidth, uWidth),
+                y0, std::min(y0 + uTileHeight, uHeight),
+                state);
+        }
+        }, 1);
+}
+
+// -----------------------------------------------------------------------------
+bool SWBitmaps::MedianFilter(IN Bitmap& bitmap, IN const uint32_t& radius)
+{
+    if (!bitmap.IsValid() ||
+        bitmap.GetHeader().ColorDepth != 24 ||
+        radius > MEDIAN_MAX_RADIUS)
+        return false;
+
+    if (radius == 0)
+        return true;
+
+    bitmap.MarkModified();
+
+    switch (radius)
+    {
+    case 1:
+        MedianNetwork<1>(bitmap, s_Network9);
+        return true;
+
+    case 2:
+        MedianNetwork<2>(bitmap, s_Network25);
+        return true;
+
+    default:
+        MedianHistogram(bitmap, radius);
+        return true;
+    }
+}
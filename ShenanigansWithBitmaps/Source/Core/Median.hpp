@@ -0,0 +1,14 @@
+#pragma once
+
+#include "Bitmap.hpp"
+
+// Kernel histograms count in 16 bits, (2 * 127 + 1)^2 still fits
+#define MEDIAN_MAX_RADIUS 127
+
+namespace SWBitmaps
+{
+    // Median of every channel over a (2 * radius + 1) square window, edges are replicated.
+    // Radius 1 and 2 run sorting networks on 16 bytes at once, larger ones keep histograms
+    // of columns and of the window (Perreault-Hebert), which cost the same for any radius.
+    bool MedianFilter(IN Bitmap& bitmap, IN const uint32_t& radius);
+}
@@ -0,0 +1,198 @@
+#include "Pch.h"
+
+#include "Morphology.hpp"
+#include "Parallel.hpp"
+
+using namespace SWBitmaps;
+
+// Bytes of a row filtered together by the column pass
+#define MORPH_STRIP 256
+
+// -----------------------------------------------------------------------------
+template<bool Max>
+static inline void Extremum(IN uint8_t* dst, IN const uint8_t* a, IN const uint8_t* b, IN const uint64_t& size)
+{
+    uint64_t k = 0;
+
+#ifdef SWB_SSE2
+    for (; k + 16 <= size; k += 16)
+    {
+        const __m128i x = _mm_loadu_si128((const __m128i*) &a[k]);
+        const __m128i y = _mm_loadu_si128((const __m128i*) &b[k]);
+        _mm_storeu_si128((__m128i*) &dst[k], Max ? _mm_max_epu8(x, y) : _mm_min_epu8(x, y));
+    }
+#endif // SWB_SSE2
+
+    for (; k < size; k++)
+        dst[k] = Max ? std::max(a[k], b[k]) : std::min(a[k], b[k]);
+}
+
+// -----------------------------------------------------------------------------
+// 'Lanes' other than 0 fixes the element size, so pixels of a row unroll
+template<bool Max, uint64_t Lanes>
+static void MorphLineOf(IN uint8_t* line,
+    IN const uint64_t& stride,
+    IN const uint64_t& count,
+    IN const uint64_t& laneCount,
+    IN const uint32_t& radius,
+    IN std::vector<uint8_t>& buffer)
+{
+    const uint64_t lanes = Lanes ? Lanes : laneCount;
+
+    // The line padded by 'radius' on both sides is cut into blocks of one window.
+    // 'g' runs forward from the start of every block, 'h' backward from its end,
+    // a window starting at j then is h[j] combined with g[j + 2 * radius].
+    const uint64_t uSize = (2 * static_cast<uint64_t>(radius)) + 1;
+    const uint64_t uPadded = (((count + (2 * radius)) + uSize - 1) / uSize) * uSize;
+
+    buffer.resize(((2 * uPadded) + 1) * lanes);
+    uint8_t* g = buffer.data();
+    uint8_t* h = g + (uPadded * lanes);
+    uint8_t* identity = h + (uPadded * lanes);
+
+    memset(identity, Max ? 0 : 255, lanes);
+
+    auto source = [&](uint64_t i) -> const uint8_t* {
+        return i >= radius && i - radius < count ? line + ((i - radius) * stride) : identity;
+    };
+
+    for (uint64_t i = 0; i < uPadded; i++)
+    {
+        if (i % uSize == 0)
+            memcpy(&g[i * lanes], source(i), lanes);
+        else
+            Extremum<Max>(&g[i * lanes], &g[(i - 1) * lanes], source(i), lanes);
+    }
+
+    // Only windows of the line itself need 'h'
+    for (uint64_t i = ((count - 1) / uSize + 1) * uSize; i-- > 0;)
+    {
+        if (i % uSize == uSize - 1)
+            memcpy(&h[i * lanes], source(i), lanes);
+        else
+            Extremum<Max>(&h[i * lanes], &h[(i + 1) * lanes], source(i), lanes);
+    }
+
+    // Everything is read by now, the line is overwritten
+    if (stride == lanes)
+    {
+        Extremum<Max>(line, h, &g[2 * radius * lanes], count * lanes);
+        return;
+    }
+
+    for (uint64_t j = 0; j < count; j++)
+        Extremum<Max>(line + (j * stride), &h[j * lanes], &g[(j + (2 * radius)) * lanes], lanes);
+}
+
+// -----------------------------------------------------------------------------
+void SWBitmaps::MorphLine(IN uint8_t* line,
+    IN const uint64_t& stride,
+    IN const uint64_t& count,
+    IN const uint64_t& lanes,
+    IN const uint32_t& radius,
+    IN const bool& dilate,
+    IN std::vector<uint8_t>& buffer)
+{
+    if (count == 0 || radius == 0)
+        return;
+
+    // Windows are clipped anyway, a wider one only grows the buffer
+    const uint32_t uRadius = static_cast<uint32_t>(std::min<uint64_t>(radius, count - 1));
+    if (uRadius == 0)
+        return;
+
+    if (lanes == 3)
+    {
+        if (dilate)
+            MorphLineOf<true, 3>(line, stride, count, lanes, uRadius, buffer);
+        else
+            MorphLineOf<false, 3>(line, stride, count, lanes, uRadius, buffer);
+        return;
+    }
+
+    if (dilate)
+        MorphLineOf<true, 0>(line, stride, count, lanes, uRadius, buffer);
+    else
+        MorphLineOf<false, 0>(line, stride, count, lanes, uRadius, buffer);
+}
+
+// -----------------------------------------------------------------------------
+// One erosion or dilation, rows first, then strips of columns
+static void MorphPass(IN Bitmap& bitmap,
+    IN const uint32_t& radiusX,
+    IN const uint32_t& radiusY,
+    IN const bool& dilate)
+{
+    const uint64_t uWidth = bitmap.GetWidth();
+    const uint64_t uHeight = bitmap.GetHeight();
+    const uint64_t uRowBytes = uWidth * 3;
+
+    if (radiusX > 0)
+    {
+        ParallelFor(0, uHeight, [&](uint64_t first, uint64_t last) {
+            std::vector<uint8_t> buffer;
+            for (uint64_t i = first; i < last; i++)
+                MorphLine(bitmap.GetRow(i), 3, uWidth, 3, radiusX, dilate, buffer);
+            });
+    }
+
+    if (radiusY > 0)
+    {
+        const uint64_t uStrips = (uRowBytes + MORPH_STRIP - 1) / MORPH_STRIP;
+
+        // A strip of every row is one element, min and max run across the whole strip
+        ParallelFor(0, uStrips, [&](uint64_t first, uint64_t last) {
+            std::vector<uint8_t> buffer;
+            for (uint64_t s = first; s < last; s++)
+            {
+                const uint64_t uOffset = s * MORPH_STRIP;
+                MorphLine(bitmap.GetRow(0) + uOffset, bitmap.GetPitch(), uHeight,
+                    std::min<uint64_t>(MORPH_STRIP, uRowBytes - uOffset), radiusY, dilate, buffer);
+            }
+            }, 1);
+    }
+}
+
+// -----------------------------------------------------------------------------
+bool SWBitmaps::Morphology(IN Bitmap& bitmap,
+    IN const MorphOp& op,
+    IN uint32_t radiusX,
+    IN uint32_t radiusY)
+{
+    if (!bitmap.IsValid() ||
+        bitmap.GetHeader().ColorDepth != 24)
+        return false;
+
+    // A window past the edges gives the same result as one clipped to them
+    radiusX = static_cast<uint32_t>(std::min<uint64_t>(radiusX, bitmap.GetWidth() - 1));
+    radiusY = static_cast<uint32_t>(std::min<uint64_t>(radiusY, bitmap.GetHeight() - 1));
+
+    if (radiusX == 0 && radiusY == 0)
+        return true;
+
+    bitmap.MarkModified();
+
+    switch (op)
+    {
+    case Erode:
+        MorphPass(bitmap, radiusX, radiusY, false);
+        return true;
+
+    case Dilate:
+        MorphPass(bitmap, radiusX, radiusY, true);
+        return true;
+
+    case Open:
+        MorphPass(bitmap, radiusX, radiusY, false);
+        MorphPass(bitmap, radiusX, radiusY, true);
+        return true;
+
+    case Close:
+        MorphPass(bitmap, radiusX, radiusY, true);
+        MorphPass(bitmap, radiusX, radiusY, false);
+        return true;
+
+    default:
+        throw;
+    }
+}
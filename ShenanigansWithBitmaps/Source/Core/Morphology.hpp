@@ -0,0 +1,36 @@
+#pragma once
+
+#include "Bitmap.hpp"
+
+namespace SWBitmaps
+{
+    enum MorphOp
+    {
+        // Minimum of the window, dark areas grow
+        Erode,
+        // Maximum of the window, bright areas grow
+        Dilate,
+        // Erode, then dilate, removes bright specks smaller than the window
+        Open,
+        // Dilate, then erode, fills dark specks and gaps smaller than the window
+        Close
+    };
+
+    // Running minimum or maximum over windows of (2 * radius + 1) elements, in place,
+    // van Herk / Gil-Werman. Elements are 'lanes' bytes at 'stride' apart, windows are
+    // clipped at the ends. About three min/max per element no matter the radius.
+    void MorphLine(IN uint8_t* line,
+        IN const uint64_t& stride,
+        IN const uint64_t& count,
+        IN const uint64_t& lanes,
+        IN const uint32_t& radius,
+        IN const bool& dilate,
+        IN std::vector<uint8_t>& buffer);
+
+    // Rectangular structuring element of (2 * radiusX + 1) x (2 * radiusY + 1), rows and then
+    // columns. Channels are filtered on their own, a binary image is one with only 0 and 255.
+    bool Morphology(IN Bitmap& bitmap,
+        IN const MorphOp& op,
+        IN uint32_t radiusX,
+        IN uint32_t radiusY);
+}
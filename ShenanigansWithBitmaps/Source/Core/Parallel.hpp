@@ -0,0 +1,52 @@
+#pragma once
+
+namespace SWBitmaps
+{
+    // Set on threads that already run one of many jobs, ParallelFor stays on them
+    inline thread_local bool t_bSerialParallelFor = false;
+
+    // -----------------------------------------------------------------------------
+    // Splits [begin, end) into contiguous chunks and calls fn(first, last) 
+    // for each of them on a separate thread, the last chunk runs on the caller
+    template<typename Fn>
+    void ParallelFor(IN const uint64_t& begin, 
+        IN const uint64_t& end, 
+        IN Fn&& fn, 
+        IN const uint64_t& minChunk = 16)
+    {
+        if (end <= begin)
+            return;
+
+        const uint64_t uCount = end - begin;
+        uint64_t uThreads = std::max<uint64_t>(1, std::thread::hardware_concurrency());
+        uThreads = std::min<uint64_t>(uThreads, std::max<uint64_t>(1, uCount / std::max<uint64_t>(1, minChunk)));
+
+        if (uThreads == 1 || t_bSerialParallelFor)
+        {
+            fn(begin, end);
+            return;
+        }
+
+        const uint64_t uChunk = uCount / uThreads;
+        const uint64_t uRest = uCount % uThreads;
+
+        std::vector<std::thread> workers;
+        workers.reserve(uThreads - 1);
+
+        uint64_t first = begin;
+        for (uint64_t i = 0; i < uThreads; i++)
+        {
+            const uint64_t last = first + uChunk + (i < uRest ? 1 : 0);
+
+            if (i + 1 == uThreads)
+                fn(first, last);
+            else
+                workers.emplace_back([&fn, first, last]() { fn(first, last); });
+
+            first = last;
+        }
+
+        for (auto& w : workers)
+            w.join();
+    }
+}
@@ -0,0 +1,289 @@
+#include "Pch.h"
+
+#include "PerceptualHash.hpp"
+#include "Parallel.hpp"
+
+using namespace SWBitmaps;
+
+#define PHASH_SIZE 32
+#define PHASH_KEPT 8
+#define HASH_PARTS 4
+#define HASH_PART_VALUES 65536
+
+// -----------------------------------------------------------------------------
+void SWBitmaps::AreaDownsample(IN const Bitmap& target,
+    IN const uint32_t& width,
+    IN const uint32_t& height,
+    IN std::vector<float>& luma)
+{
+    luma.assign((size_t)width * height, 0.f);
+
+    if (!target.IsValid() ||
+        target.GetHeader().ColorDepth != 24 ||
+        !width || !height)
+        return;
+
+    const uint64_t uSourceWidth = target.GetWidth();
+    const uint64_t uSourceHeight = target.GetHeight();
+    const bool bBottomUp = target.GetHeader().Height > 0;
+
+    // Every cell covers at least one source pixel
+    auto span = [](uint64_t cell, uint64_t cells, uint64_t size) {
+        const uint64_t first = (cell * size) / cells;
+        const uint64_t last = std::max(first + 1, ((cell + 1) * size) / cells);
+        return std::make_pair(first, std::min(last, size));
+    };
+
+    ParallelFor(0, height, [&](uint64_t first, uint64_t last) {
+        std::vector<uint8_t> row(uSourceWidth);
+        std::vector<double> sums(width);
+
+        for (uint64_t cy = first; cy < last; cy++)
+        {
+            std::fill(sums.begin(), sums.end(), 0.0);
+            const auto rows = span(cy, height, uSourceHeight);
+
+            for (uint64_t t = rows.first; t < rows.second; t++)
+            {
+                const uint64_t i = bBottomUp ? (uSourceHeight - 1 - t) : t;
+                ComputeLumaRow(target.GetRow(i), row.data(), uSourceWidth, BT601);
+
+                for (uint64_t cx = 0; cx < width; cx++)
+                {
+                    const auto cols = span(cx, width, uSourceWidth);
+
+                    uint32_t sum = 0;
+                    for (uint64_t k = cols.first; k < cols.second; k++)
+                        sum += row[k];
+
+                    sums[cx] += sum;
+                }
+            }
+
+            for (uint64_t cx = 0; cx < width; cx++)
+            {
+                const auto cols = span(cx, width, uSourceWidth);
+                const double area = static_cast<double>((cols.second - cols.first) * (rows.second - rows.first));
+                luma[(cy * width) + cx] = static_cast<float>(sums[cx] / area);
+            }
+        }
+        }, 1);
+}
+
+// -----------------------------------------------------------------------------
+uint64_t SWBitmaps::ComputePerceptualHash(IN const Bitmap& target, IN const HashKind& kind)
+{
+    std::vector<float> luma;
+    uint64_t hash = 0;
+
+    switch (kind)
+    {
+    case AHash:
+    {
+        // Brighter than the mean
+        AreaDownsample(target, 8, 8, luma);
+        const float fMean = std::accumulate(luma.begin(), luma.end(), 0.f) / luma.size();
+
+        for (uint8_t i = 0; i < 64; i++)
+            hash |= static_cast<uint64_t>(luma[i] > fMean) << i;
+
+        return hash;
+    }
+
+    case DHash:
+    {
+        // Brighter than the right neighbour
+        AreaDownsample(target, 9, 8, luma);
+
+        for (uint8_t y = 0; y < 8; y++)
+        {
+            for (uint8_t x = 0; x < 8; x++)
+                hash |= static_cast<uint64_t>(luma[(y * 9) + x] > luma[(y * 9) + x + 1]) << ((y * 8) + x);
+        }
+
+        return hash;
+    }
+
+    case PHash:
+    {
+        // Lowest 8x8 frequencies of a 32x32 DCT, above their median
+        AreaDownsample(target, PHASH_SIZE, PHASH_SIZE, luma);
+
+        static float cosines[PHASH_KEPT][PHASH_SIZE];
+        static std::once_flag built;
+        std::call_once(built, []() {
+            for (uint8_t u = 0; u < PHASH_KEPT; u++)
+                for (uint8_t x = 0; x < PHASH_SIZE; x++)
+                    cosines[u][x] = static_cast<float>(std::cos(((2 * x + 1) * u * 3.14159265358979) / (2 * PHASH_SIZE)));
+            });
+
+        float rows[PHASH_SIZE][PHASH_KEPT];
+        for (uint8_t y = 0; y < PHASH_SIZE; y++)
+        {
+            for (uint8_t u = 0; u < PHASH_KEPT; u++)
+            {
+                float sum = 0;
+                for (uint8_t x = 0; x < PHASH_SIZE; x++)
+                    sum += luma[(y * PHASH_SIZE) + x] * cosines[u][x];
+                rows[y][u] = sum;
+            }
+        }
+
+        float coefficients[PHASH_KEPT * PHASH_KEPT];
+        for (uint8_t v = 0; v < PHASH_KEPT; v++)
+        {
+            for (uint8_t u = 0; u < PHASH_KEPT; u++)
+            {
+                float sum = 0;
+                for (uint8_t y = 0; y < PHASH_SIZE; y++)
+                    sum += rows[y][u] * cosines[v][y];
+                coefficients[(v * PHASH_KEPT) + u] = sum;
+            }
+        }
+
+        // DC is left out of the median, it only carries the overall brightness
+        float sorted[PHASH_KEPT * PHASH_KEPT - 1];
+        std::copy(coefficients + 1, coefficients + (PHASH_KEPT * PHASH_KEPT), sorted);
+        std::nth_element(sorted, sorted + 31, std::end(sorted));
+        const float fMedian = sorted[31];
+
+        for (uint8_t i = 0; i < 64; i++)
+            hash |= static_cast<uint64_t>(coefficients[i] > fMedian) << i;
+
+        return hash;
+    }
+
+    default:
+        throw;
+    }
+}
+
+// -----------------------------------------------------------------------------
+uint8_t SWBitmaps::HammingDistance(IN const uint64_t& a, IN const uint64_t& b)
+{
+    return static_cast<uint8_t>(std::popcount(a ^ b));
+}
+
+// HashIndex -------------------------------------------------------------------
+
+// -----------------------------------------------------------------------------
+HashIndex::HashIndex()
+{
+    for (auto& table : m_Tables)
+        table.resize(HASH_PART_VALUES);
+}
+
+// -----------------------------------------------------------------------------
+void HashIndex::Add(IN const uint64_t& hash, IN const uint64_t& id)
+{
+    const uint32_t uIndex = static_cast<uint32_t>(m_Hashes.size());
+
+    m_Hashes.push_back(hash);
+    m_Ids.push_back(id);
+
+    for (uint8_t p = 0; p < HASH_PARTS; p++)
+        m_Tables[p][(hash >> (p * 16)) & 0xFFFF].push_back(uIndex);
+}
+
+// -----------------------------------------------------------------------------
+void HashIndex::Clear()
+{
+    m_Hashes.clear();
+    m_Ids.clear();
+
+    for (auto& table : m_Tables)
+    {
+        for (auto& bucket : table)
+            bucket.clear();
+    }
+}
+
+// -----------------------------------------------------------------------------
+std::vector<std::pair<uint64_t, uint8_t>> HashIndex::Query(IN const uint64_t& hash, IN const uint8_t& radius) const
+{
+    std::vector<uint32_t> candidates;
+    Candidates(hash, radius, 0, candidates);
+
+    std::vector<std::pair<uint64_t, uint8_t>> result;
+    result.reserve(candidates.size());
+
+    for (auto& c : candidates)
+        result.push_back({ m_Ids[c], HammingDistance(hash, m_Hashes[c]) });
+
+    return result;
+}
+
+// -----------------------------------------------------------------------------
+std::vector<HashMatch> HashIndex::FindDuplicates(IN const uint8_t& radius) const
+{
+    std::vector<HashMatch> result;
+    std::mutex resultMutex;
+
+    ParallelFor(0, m_Hashes.size(), [&](uint64_t first, uint64_t last) {
+        std::vector<HashMatch> local;
+        std::vector<uint32_t> candidates;
+
+        for (uint64_t i = first; i < last; i++)
+        {
+            Candidates(m_Hashes[i], radius, i + 1, candidates);
+
+            for (auto& c : candidates)
+                local.push_back({ m_Ids[i], m_Ids[c], HammingDistance(m_Hashes[i], m_Hashes[c]) });
+        }
+
+        std::lock_guard<std::mutex> lock(resultMutex);
+        result.insert(result.end(), local.begin(), local.end());
+        }, 1024);
+
+    return result;
+}
+
+// Private ---------------------------------------------------------------------
+
+// -----------------------------------------------------------------------------
+void HashIndex::Candidates(IN const uint64_t& hash, 
+    IN const uint8_t& radius, 
+    IN const uint64_t& skipBelow, 
+    IN std::vector<uint32_t>& out) const
+{
+    out.clear();
+
+    const uint8_t uPartRadius = radius / HASH_PARTS;
+
+    // Past this point nearly every bucket gets visited anyway
+    if (uPartRadius > 2)
+    {
+        for (uint64_t i = skipBelow; i < m_Hashes.size(); i++)
+        {
+            if (HammingDistance(hash, m_Hashes[i]) <= radius)
+                out.push_back(static_cast<uint32_t>(i));
+        }
+        return;
+    }
+
+    for (uint8_t p = 0; p < HASH_PARTS; p++)
+    {
+        const uint16_t part = static_cast<uint16_t>(hash >> (p * 16));
+
+        auto visit = [&](const uint16_t& key) {
+            for (auto& c : m_Tables[p][key])
+            {
+                if (c >= skipBelow && HammingDistance(hash, m_Hashes[c]) <= radius)
+                    out.push_back(c);
+            }
+        };
+
+        // Every key within uPartRadius bits of the part
+        visit(part);
+        for (uint8_t a = 0; a < 16 && uPartRadius >= 1; a++)
+        {
+            visit(part ^ (1 << a));
+            for (uint8_t b = a + 1; b < 16 && uPartRadius >= 2; b++)
+                visit(part ^ (1 << a) ^ (1 << b));
+        }
+    }
+
+    // The same hash can match in several parts
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+}
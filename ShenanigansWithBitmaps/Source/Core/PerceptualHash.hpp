@@ -0,0 +1,69 @@
+#pragma once
+
+#include "Bitmap.hpp"
+
+namespace SWBitmaps
+{
+    // Area averaged BT.601 luma, 'width' x 'height' values, top row first
+    void AreaDownsample(IN const Bitmap& target,
+        IN const uint32_t& width,
+        IN const uint32_t& height,
+        IN std::vector<float>& luma);
+
+    uint64_t ComputePerceptualHash(IN const Bitmap& target, IN const HashKind& kind);
+
+    uint8_t HammingDistance(IN const uint64_t& a, IN const uint64_t& b);
+
+    struct HashMatch
+    {
+        uint64_t First = 0;
+        uint64_t Second = 0;
+        uint8_t Distance = 0;
+    };
+
+    // Multi-index hashing, every 64-bit hash is split into four 16-bit parts
+    // with a table for each of them. If two hashes are within distance r,
+    // at least one of the parts is within r / 4, so only those buckets are visited.
+    class HashIndex
+    {
+    public:
+
+        HashIndex();
+
+        ~HashIndex() = default;
+
+    public:
+
+        void Add(IN const uint64_t& hash, IN const uint64_t& id);
+
+        void Clear();
+
+        // Ids of every hash within 'radius', with their distance
+        std::vector<std::pair<uint64_t, uint8_t>> Query(IN const uint64_t& hash, IN const uint8_t& radius) const;
+
+        // Every pair of ids within 'radius', each pair is reported once
+        std::vector<HashMatch> FindDuplicates(IN const uint8_t& radius) const;
+
+    public:
+
+        // Getters -------------------------------------------------------------
+
+        size_t GetSize() const { return m_Hashes.size(); }
+
+    private:
+
+        // Indices into m_Hashes within 'radius', 'skipBelow' drops lower ones
+        void Candidates(IN const uint64_t& hash, 
+            IN const uint8_t& radius, 
+            IN const uint64_t& skipBelow, 
+            IN std::vector<uint32_t>& out) const;
+
+    private:
+
+        std::vector<uint64_t> m_Hashes;
+        std::vector<uint64_t> m_Ids;
+
+        std::vector<std::vector<uint32_t>> m_Tables[4];
+
+    };
+}
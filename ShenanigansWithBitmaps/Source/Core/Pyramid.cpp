@@ -0,0 +1,312 @@
+#include "Pch.h"
+
+#include "Pyramid.hpp"
+#include "Parallel.hpp"
+
+using namespace SWBitmaps;
+
+#define PYRAMID_MAGIC 0x50425753 // "SWBP"
+#define PYRAMID_VERSION 1
+
+struct PyramidSidecarHeader
+{
+    uint32_t Magic = PYRAMID_MAGIC;
+    uint32_t Version = PYRAMID_VERSION;
+    int32_t Width = 0;
+    int32_t Height = 0;
+    uint64_t FileSize = 0;
+    int64_t LastWriteTime = 0;
+    uint32_t LevelCount = 0;
+    uint32_t Reserved = 0;
+};
+
+// -----------------------------------------------------------------------------
+static bool StampSource(IN const std::wstring& path, IN PyramidSidecarHeader& header)
+{
+    std::error_code error;
+
+    header.FileSize = std::filesystem::file_size(path, error);
+    if (error)
+        return false;
+
+    header.LastWriteTime = std::filesystem::last_write_time(path, error).time_since_epoch().count();
+    return !error;
+}
+
+// -----------------------------------------------------------------------------
+std::shared_ptr<const Bitmap> ImagePyramid::GetLevel(IN const uint8_t& level)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    Sync();
+
+    return BuildLevel(level);
+}
+
+// -----------------------------------------------------------------------------
+std::shared_ptr<const Bitmap> ImagePyramid::NearestLevel(IN const uint32_t& width, IN const uint32_t& height)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    Sync();
+
+    uint64_t uWidth = m_pSource->GetWidth();
+    uint64_t uHeight = m_pSource->GetHeight();
+
+    uint8_t level = 0;
+    for (; level + 1 < GetLevelCount(); level++)
+    {
+        uWidth = (uWidth + 1) / 2;
+        uHeight = (uHeight + 1) / 2;
+
+        if (uWidth < width || uHeight < height)
+            break;
+    }
+
+    return BuildLevel(level);
+}
+
+// -----------------------------------------------------------------------------
+void ImagePyramid::MakeThumbnail(IN const uint32_t& width, IN const uint32_t& height, IN Bitmap& out)
+{
+    out.Destroy();
+
+    if (!width || !height)
+        return;
+
+    const std::shared_ptr<const Bitmap> pSource = NearestLevel(width, height);
+    const Bitmap& source = *pSource;
+    if (!source.IsValid() ||
+        source.GetHeader().ColorDepth != 24)
+        return;
+
+    out.Initialize(width, source.GetHeader().Height > 0 ? height : -static_cast<int32_t>(height));
+    if (!out.IsValid())
+        return;
+
+    const uint64_t uSourceWidth = source.GetWidth();
+    const uint64_t uSourceHeight = source.GetHeight();
+
+    // Every cell covers at least one source pixel
+    auto span = [](uint64_t cell, uint64_t cells, uint64_t size) {
+        const uint64_t first = (cell * size) / cells;
+        const uint64_t last = std::max(first + 1, ((cell + 1) * size) / cells);
+        return std::make_pair(first, std::min(last, size));
+    };
+
+    std::vector<std::pair<uint64_t, uint64_t>> columns(width);
+    for (uint64_t x = 0; x < width; x++)
+        columns[x] = span(x, width, uSourceWidth);
+
+    ParallelFor(0, height, [&](uint64_t first, uint64_t last) {
+        std::vector<uint32_t> sums((size_t)width * 3);
+
+        for (uint64_t y = first; y < last; y++)
+        {
+            std::fill(sums.begin(), sums.end(), 0);
+            const auto rows = span(y, height, uSourceHeight);
+
+            for (uint64_t i = rows.first; i < rows.second; i++)
+            {
+                const uint8_t* src = source.GetRow(i);
+
+                for (uint64_t x = 0; x < width; x++)
+                {
+                    for (uint64_t k = columns[x].first; k < columns[x].second; k++)
+                    {
+                        sums[(x * 3) + 0] += src[(k * 3) + 0];
+                        sums[(x * 3) + 1] += src[(k * 3) + 1];
+                        sums[(x * 3) + 2] += src[(k * 3) + 2];
+                    }
+                }
+            }
+
+            uint8_t* dst = out.GetRow(y);
+            for (uint64_t x = 0; x < width; x++)
+            {
+                const uint32_t uArea = static_cast<uint32_t>((columns[x].second - columns[x].first) * (rows.second - rows.first));
+
+                for (uint8_t c = 0; c < 3; c++)
+                    dst[(x * 3) + c] = static_cast<uint8_t>((sums[(x * 3) + c] + (uArea / 2)) / uArea);
+            }
+        }
+        }, 8);
+}
+
+// -----------------------------------------------------------------------------
+bool ImagePyramid::SaveSidecar(IN const std::wstring& directory)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    Sync();
+
+    if (!m_pSource->IsAsLoaded())
+        return false;
+
+    PyramidSidecarHeader header;
+    header.Width = m_pSource->GetHeader().Width;
+    header.Height = m_pSource->GetHeader().Height;
+    header.LevelCount = GetLevelCount();
+    if (!StampSource(m_pSource->GetPath(), header))
+        return false;
+
+    for (uint8_t level = 1; level < header.LevelCount; level++)
+        BuildLevel(level);
+
+    std::ofstream file(std::filesystem::path(GetSidecarPath(directory)),
+        std::ios_base::binary | std::ios_base::out);
+
+    if (!file.is_open())
+        return false;
+
+    file.write((const char*)&header, sizeof(header));
+    for (uint8_t level = 1; level < header.LevelCount; level++)
+    {
+        const Bitmap& l = *m_Levels[level];
+        file.write((const char*)l.GetRow(0), l.GetPitch() * l.GetHeight());
+    }
+
+    return file.good();
+}
+
+// -----------------------------------------------------------------------------
+bool ImagePyramid::LoadSidecar(IN const std::wstring& directory)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    Sync();
+
+    if (!m_pSource->IsAsLoaded())
+        return false;
+
+    std::ifstream file(std::filesystem::path(GetSidecarPath(directory)),
+        std::ios_base::binary | std::ios_base::in);
+
+    if (!file.is_open())
+        return false;
+
+    PyramidSidecarHeader expected;
+    expected.Width = m_pSource->GetHeader().Width;
+    expected.Height = m_pSource->GetHeader().Height;
+    expected.LevelCount = GetLevelCount();
+    if (!StampSource(m_pSource->GetPath(), expected))
+        return false;
+
+    PyramidSidecarHeader header;
+    file.read((char*)&header, sizeof(header));
+
+    if (!file.good() ||
+        memcmp(&header, &expected, sizeof(header)) != 0)
+        return false;
+
+    std::vector<std::shared_ptr<Bitmap>> levels(header.LevelCount);
+
+    uint64_t uWidth = m_pSource->GetWidth();
+    uint64_t uHeight = m_pSource->GetHeight();
+    for (uint8_t level = 1; level < header.LevelCount; level++)
+    {
+        uWidth = (uWidth + 1) / 2;
+        uHeight = (uHeight + 1) / 2;
+
+        levels[level] = std::make_shared<Bitmap>();
+        Bitmap& l = *levels[level];
+        l.Initialize(static_cast<int32_t>(uWidth), header.Height > 0 ? static_cast<int32_t>(uHeight) : -static_cast<int32_t>(uHeight));
+
+        if (!l.IsValid())
+            return false;
+
+        file.read((char*)l.GetRow(0), l.GetPitch() * l.GetHeight());
+        if (!file.good())
+            return false;
+    }
+
+    m_Levels = std::move(levels);
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+uint8_t ImagePyramid::LevelCount(IN uint64_t width, IN uint64_t height)
+{
+    if (!width || !height)
+        return 0;
+
+    uint8_t uCount = 1;
+    while (width > 1 || height > 1)
+    {
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+        uCount++;
+    }
+
+    return uCount;
+}
+
+// Private ---------------------------------------------------------------------
+
+// -----------------------------------------------------------------------------
+void ImagePyramid::Sync()
+{
+    if (m_uGeneration == m_pSource->GetGeneration())
+        return;
+
+    m_Levels.clear();
+    m_uGeneration = m_pSource->GetGeneration();
+}
+
+// -----------------------------------------------------------------------------
+std::shared_ptr<const Bitmap> ImagePyramid::BuildLevel(IN const uint8_t& level)
+{
+    if (level == 0 ||
+        !m_pSource->IsValid() ||
+        m_pSource->GetHeader().ColorDepth != 24)
+        return std::shared_ptr<const Bitmap>(std::shared_ptr<const Bitmap>(), m_pSource);
+
+    const uint8_t uLevel = std::min<uint8_t>(level, GetLevelCount() - 1);
+
+    if (m_Levels.size() < GetLevelCount())
+        m_Levels.resize(GetLevelCount());
+
+    // Every level is made from the previous one
+    for (uint8_t l = 1; l <= uLevel; l++)
+    {
+        if (m_Levels[l])
+            continue;
+
+        // Only stored once it's complete
+        auto next = std::make_shared<Bitmap>();
+        Halve(l == 1 ? *m_pSource : *m_Levels[l - 1], *next);
+        m_Levels[l] = next;
+    }
+
+    return m_Levels[uLevel];
+}
+
+// -----------------------------------------------------------------------------
+void ImagePyramid::Halve(IN const Bitmap& source, IN Bitmap& target)
+{
+    const uint64_t uSourceWidth = source.GetWidth();
+    const uint64_t uSourceHeight = source.GetHeight();
+    const uint64_t uWidth = (uSourceWidth + 1) / 2;
+    const uint64_t uHeight = (uSourceHeight + 1) / 2;
+
+    target.Initialize(static_cast<int32_t>(uWidth), 
+        source.GetHeader().Height > 0 ? static_cast<int32_t>(uHeight) : -static_cast<int32_t>(uHeight));
+
+    // Odd edges repeat the last row and column
+    ParallelFor(0, uHeight, [&](uint64_t first, uint64_t last) {
+        for (uint64_t y = first; y < last; y++)
+        {
+            const uint8_t* top = source.GetRow(y * 2);
+            const uint8_t* bottom = source.GetRow(std::min((y * 2) + 1, uSourceHeight - 1));
+            uint8_t* dst = target.GetRow(y);
+
+            for (uint64_t x = 0; x < uWidth; x++)
+            {
+                const uint64_t left = x * 2 * 3;
+                const uint64_t right = std::min((x * 2) + 1, uSourceWidth - 1) * 3;
+
+                for (uint8_t c = 0; c < 3; c++)
+                {
+                    dst[(x * 3) + c] = static_cast<uint8_t>((top[left + c] + top[right + c] 
+                        + bottom[left + c] + bottom[right + c] + 2) >> 2);
+                }
+            }
+        }
+        }, 16);
+}
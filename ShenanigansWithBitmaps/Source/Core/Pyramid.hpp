@@ -0,0 +1,69 @@
+#pragma once
+
+#include "Bitmap.hpp"
+
+namespace SWBitmaps
+{
+    // Successive 2x box filtered levels of a 24-bit bitmap, built on demand.
+    // Level 0 is the source itself. Levels are dropped as soon as 
+    // the generation of the source changes, but one handed out stays 
+    // alive for as long as someone holds it.
+    class ImagePyramid
+    {
+    public:
+
+        ImagePyramid(IN const Bitmap& source) : m_pSource(&source) { }
+
+        ~ImagePyramid() = default;
+
+    public:
+
+        // Level 0 doesn't own the source, it lives as long as the source does
+        std::shared_ptr<const Bitmap> GetLevel(IN const uint8_t& level);
+
+        // Smallest level that is still at least 'width' x 'height'
+        std::shared_ptr<const Bitmap> NearestLevel(IN const uint32_t& width, IN const uint32_t& height);
+
+        // Area averaged from the nearest level, rows keep the order of the source
+        void MakeThumbnail(IN const uint32_t& width, IN const uint32_t& height, IN Bitmap& out);
+
+        // Sidecar is stored in 'directory' as 'FILE.bmp.pyr'.
+        // It's only valid for the exact file it was made from (size, dimensions, 
+        // last write time) and only while the source is unmodified since loading.
+        bool SaveSidecar(IN const std::wstring& directory);
+
+        bool LoadSidecar(IN const std::wstring& directory);
+
+    public:
+
+        // Getters -------------------------------------------------------------
+
+        uint8_t GetLevelCount() const { return LevelCount(m_pSource->GetWidth(), m_pSource->GetHeight()); }
+
+        static uint8_t LevelCount(IN uint64_t width, IN uint64_t height);
+
+    private:
+
+        void Sync();
+
+        // Both need m_Mutex held
+        std::shared_ptr<const Bitmap> BuildLevel(IN const uint8_t& level);
+
+        static void Halve(IN const Bitmap& source, IN Bitmap& target);
+
+        std::wstring GetSidecarPath(IN const std::wstring& directory) const 
+        { 
+            return (std::filesystem::path(directory) / std::filesystem::path(m_pSource->GetPath()).filename()).wstring() + L".pyr"; 
+        }
+
+    private:
+
+        const Bitmap* m_pSource = nullptr;
+        uint64_t m_uGeneration = 0;
+
+        // Index 0 is always empty, it's the source
+        std::vector<std::shared_ptr<Bitmap>> m_Levels;
+        std::mutex m_Mutex;
+
+    };
+}
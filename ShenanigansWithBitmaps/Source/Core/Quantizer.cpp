@@ -0,0 +1,468 @@
+#include "Pch.h"
+
+#include "Quantizer.hpp"
+#include "Parallel.hpp"
+#include "Simd.hpp"
+
+using namespace SWBitmaps;
+
+#define QUANTIZER_CELLS (32 * 32 * 32)
+#define QUANTIZER_MAX_SAMPLES (1024 * 1024)
+#define QUANTIZER_WAVEFRONT_CHUNK 64
+
+// Median cut box over 5-bit per channel coordinates, bounds are inclusive
+struct ColorBox
+{
+    uint8_t Low[3] = { 0, 0, 0 };
+    uint8_t High[3] = { 31, 31, 31 };
+    uint64_t Count = 0;
+};
+
+// -----------------------------------------------------------------------------
+static uint32_t CellIndex(IN const uint32_t& r, IN const uint32_t& g, IN const uint32_t& b)
+{
+    return (r << 10) | (g << 5) | b;
+}
+
+// -----------------------------------------------------------------------------
+// Shrinks the box to the populated cells and counts them
+static void FitBox(IN ColorBox& box, IN const std::vector<uint32_t>& histogram)
+{
+    uint8_t low[3] = { 31, 31, 31 };
+    uint8_t high[3] = { 0, 0, 0 };
+    box.Count = 0;
+
+    for (uint8_t r = box.Low[0]; r <= box.High[0]; r++)
+    {
+        for (uint8_t g = box.Low[1]; g <= box.High[1]; g++)
+        {
+            for (uint8_t b = box.Low[2]; b <= box.High[2]; b++)
+            {
+                const uint32_t count = histogram[CellIndex(r, g, b)];
+                if (!count)
+                    continue;
+
+                box.Count += count;
+                low[0] = std::min(low[0], r); high[0] = std::max(high[0], r);
+                low[1] = std::min(low[1], g); high[1] = std::max(high[1], g);
+                low[2] = std::min(low[2], b); high[2] = std::max(high[2], b);
+            }
+        }
+    }
+
+    if (!box.Count)
+        return;
+
+    std::copy(std::begin(low), std::end(low), std::begin(box.Low));
+    std::copy(std::begin(high), std::end(high), std::begin(box.High));
+}
+
+// -----------------------------------------------------------------------------
+static const uint8_t* GetBayerMatrix()
+{
+    static uint8_t matrix[64] = {};
+    static std::once_flag built;
+
+    std::call_once(built, []() {
+        // M(2n) = [4M, 4M + 2; 4M + 3, 4M + 1], the lowest bits of x and y are the most significant
+        for (uint8_t y = 0; y < 8; y++)
+        {
+            for (uint8_t x = 0; x < 8; x++)
+            {
+                uint8_t v = 0;
+                for (uint8_t bit = 0; bit < 3; bit++)
+                {
+                    const uint8_t xb = (x >> bit) & 1;
+                    const uint8_t yb = (y >> bit) & 1;
+                    v |= (((yb ^ xb) << 1) | yb) << (2 * (2 - bit));
+                }
+                matrix[(y * 8) + x] = v;
+            }
+        }
+        });
+
+    return matrix;
+}
+
+// Quantizer -------------------------------------------------------------------
+
+// -----------------------------------------------------------------------------
+void Quantizer::Initialize(IN const Bitmap& target, IN const uint16_t& colors)
+{
+    m_Palette.clear();
+    m_InverseMap.clear();
+
+    if (!target.IsValid() ||
+        target.GetHeader().ColorDepth != 24 ||
+        colors == 0 || colors > 256)
+        return;
+
+    const uint64_t uWidth = target.GetWidth();
+    const uint64_t uHeight = target.GetHeight();
+
+    // Histogram of a subsampled image --
+
+    const uint64_t uStep = std::max<uint64_t>(1, 
+        static_cast<uint64_t>(std::sqrt((long double)(uWidth * uHeight) / QUANTIZER_MAX_SAMPLES)));
+
+    std::vector<uint32_t> histogram(QUANTIZER_CELLS, 0);
+    std::mutex histogramMutex;
+
+    ParallelFor(0, (uHeight + uStep - 1) / uStep, [&](uint64_t first, uint64_t last) {
+        std::vector<uint32_t> local(QUANTIZER_CELLS, 0);
+
+        for (uint64_t i = first; i < last; i++)
+        {
+            const uint8_t* row = target.GetRow(i * uStep);
+            for (uint64_t k = 0; k < uWidth; k += uStep)
+                local[CellIndex(row[k * 3 + 2] >> 3, row[k * 3 + 1] >> 3, row[k * 3] >> 3)]++;
+        }
+
+        std::lock_guard<std::mutex> lock(histogramMutex);
+        for (uint32_t c = 0; c < QUANTIZER_CELLS; c++)
+            histogram[c] += local[c];
+        });
+
+    // Median cut ---------------------
+
+    std::vector<ColorBox> boxes(1);
+    FitBox(boxes[0], histogram);
+
+    while (boxes.size() < colors)
+    {
+        // Most populated box that can still be split
+        int64_t iSplit = -1;
+        for (size_t i = 0; i < boxes.size(); i++)
+        {
+            const ColorBox& b = boxes[i];
+            if (b.Low[0] == b.High[0] && b.Low[1] == b.High[1] && b.Low[2] == b.High[2])
+                continue;
+            if (iSplit < 0 || b.Count > boxes[iSplit].Count)
+                iSplit = i;
+        }
+        if (iSplit < 0)
+            break;
+
+        ColorBox& box = boxes[iSplit];
+
+        uint8_t axis = 0;
+        for (uint8_t a = 1; a < 3; a++)
+        {
+            if (box.High[a] - box.Low[a] > box.High[axis] - box.Low[axis])
+                axis = a;
+        }
+
+        // Cut where half of the pixels are on each side
+        std::vector<uint64_t> slices(32, 0);
+        for (uint8_t r = box.Low[0]; r <= box.High[0]; r++)
+            for (uint8_t g = box.Low[1]; g <= box.High[1]; g++)
+                for (uint8_t b = box.Low[2]; b <= box.High[2]; b++)
+                    slices[axis == 0 ? r : axis == 1 ? g : b] += histogram[CellIndex(r, g, b)];
+
+        uint8_t cut = box.Low[axis];
+        uint64_t uAccumulated = slices[cut];
+        while (cut + 1 < box.High[axis] && uAccumulated * 2 < box.Count)
+            uAccumulated += slices[++cut];
+
+        ColorBox upper = box;
+        box.High[axis] = cut;
+        upper.Low[axis] = cut + 1;
+
+        FitBox(box, histogram);
+        FitBox(upper, histogram);
+        boxes.push_back(upper);
+    }
+
+    // Palette ------------------------
+
+    for (auto& box : boxes)
+    {
+        if (!box.Count)
+            continue;
+
+        uint64_t sum[3] = { 0, 0, 0 };
+        for (uint8_t r = box.Low[0]; r <= box.High[0]; r++)
+        {
+            for (uint8_t g = box.Low[1]; g <= box.High[1]; g++)
+            {
+                for (uint8_t b = box.Low[2]; b <= box.High[2]; b++)
+                {
+                    const uint64_t count = histogram[CellIndex(r, g, b)];
+                    sum[0] += count * ((r << 3) | 4);
+                    sum[1] += count * ((g << 3) | 4);
+                    sum[2] += count * ((b << 3) | 4);
+                }
+            }
+        }
+
+        m_Palette.push_back({ 
+            static_cast<uint8_t>(sum[0] / box.Count), 
+            static_cast<uint8_t>(sum[1] / box.Count), 
+            static_cast<uint8_t>(sum[2] / box.Count) });
+    }
+
+    BuildInverseMap();
+}
+
+// -----------------------------------------------------------------------------
+void Quantizer::Map(IN const Bitmap& target, 
+    IN const DitherMode& dither, 
+    IN std::vector<uint8_t>& indices) const
+{
+    if (m_Palette.empty() ||
+        !target.IsValid() ||
+        target.GetHeader().ColorDepth != 24)
+        return;
+
+    indices.resize(target.GetWidth() * target.GetHeight());
+
+    switch (dither)
+    {
+    case NoDither:
+        MapPlain(target, indices);
+        return;
+
+    case Ordered:
+        MapOrdered(target, indices);
+        return;
+
+    case FloydSteinberg:
+        MapFloydSteinberg(target, indices);
+        return;
+
+    default:
+        throw;
+    }
+}
+
+// Private ---------------------------------------------------------------------
+
+// -----------------------------------------------------------------------------
+void Quantizer::BuildInverseMap()
+{
+    m_InverseMap.assign(QUANTIZER_CELLS + 3, 0);
+
+    ParallelFor(0, QUANTIZER_CELLS, [&](uint64_t first, uint64_t last) {
+        for (uint64_t c = first; c < last; c++)
+        {
+            const int32_t r = (((c >> 10) & 31) << 3) | 4;
+            const int32_t g = (((c >> 5) & 31) << 3) | 4;
+            const int32_t b = ((c & 31) << 3) | 4;
+
+            int32_t iBest = INT32_MAX;
+            for (size_t i = 0; i < m_Palette.size(); i++)
+            {
+                const int32_t dr = r - m_Palette[i].Red;
+                const int32_t dg = g - m_Palette[i].Green;
+                const int32_t db = b - m_Palette[i].Blue;
+                const int32_t distance = (dr * dr) + (dg * dg) + (db * db);
+
+                if (distance < iBest)
+                {
+                    iBest = distance;
+                    m_InverseMap[c] = static_cast<uint8_t>(i);
+                }
+            }
+        }
+        }, 1024);
+}
+
+// -----------------------------------------------------------------------------
+// Looks up palette indices of 'width' BGR pixels
+static void MapRow(IN const uint8_t* bgr, 
+    IN uint8_t* dst, 
+    IN const uint64_t& width, 
+    IN const uint8_t* inverseMap)
+{
+    uint64_t k = 0;
+
+#ifdef SWB_AVX2
+    const __m128i zero = _mm_setzero_si128();
+    const __m256i byteMask = _mm256_set1_epi32(0xFF);
+
+    for (; k + 16 <= width; k += 16)
+    {
+        __m128i b, g, r;
+        Simd::LoadBgr16(&bgr[k * 3], b, g, r);
+
+        // ((r >> 3) << 10) | ((g >> 3) << 5) | (b >> 3) in 16-bit lanes
+        const __m128i lo = _mm_or_si128(_mm_or_si128(
+            _mm_slli_epi16(_mm_srli_epi16(_mm_unpacklo_epi8(r, zero), 3), 10),
+            _mm_slli_epi16(_mm_srli_epi16(_mm_unpacklo_epi8(g, zero), 3), 5)),
+            _mm_srli_epi16(_mm_unpacklo_epi8(b, zero), 3));
+        const __m128i hi = _mm_or_si128(_mm_or_si128(
+            _mm_slli_epi16(_mm_srli_epi16(_mm_unpackhi_epi8(r, zero), 3), 10),
+            _mm_slli_epi16(_mm_srli_epi16(_mm_unpackhi_epi8(g, zero), 3), 5)),
+            _mm_srli_epi16(_mm_unpackhi_epi8(b, zero), 3));
+
+        const __m256i g0 = _mm256_and_si256(byteMask,
+            _mm256_i32gather_epi32((const int*)inverseMap, _mm256_cvtepu16_epi32(lo), 1));
+        const __m256i g1 = _mm256_and_si256(byteMask,
+            _mm256_i32gather_epi32((const int*)inverseMap, _mm256_cvtepu16_epi32(hi), 1));
+
+        // Pack 2 x 8 dwords into 16 bytes, packus works per 128-bit lane
+        const __m256i words = _mm256_permute4x64_epi64(_mm256_packus_epi32(g0, g1), 0xD8);
+        _mm_storeu_si128((__m128i*) &dst[k], _mm_packus_epi16(
+            _mm256_castsi256_si128(words), _mm256_extracti128_si256(words, 1)));
+    }
+#endif // SWB_AVX2
+
+    for (; k < width; k++)
+        dst[k] = inverseMap[((bgr[k * 3 + 2] >> 3) << 10) | ((bgr[k * 3 + 1] >> 3) << 5) | (bgr[k * 3] >> 3)];
+}
+
+// -----------------------------------------------------------------------------
+void Quantizer::MapPlain(IN const Bitmap& target, IN std::vector<uint8_t>& indices) const
+{
+    const uint64_t uWidth = target.GetWidth();
+
+    ParallelFor(0, target.GetHeight(), [&](uint64_t first, uint64_t last) {
+        for (uint64_t i = first; i < last; i++)
+            MapRow(target.GetRow(i), &indices[i * uWidth], uWidth, m_InverseMap.data());
+        });
+}
+
+// -----------------------------------------------------------------------------
+void Quantizer::MapOrdered(IN const Bitmap& target, IN std::vector<uint8_t>& indices) const
+{
+    const uint64_t uWidth = target.GetWidth();
+    const uint64_t uRowBytes = uWidth * 3;
+    const uint8_t* bayer = GetBayerMatrix();
+
+    // Roughly the distance between palette levels of one channel
+    const float fSpread = 255.f / std::max(1.f, std::cbrt((float)m_Palette.size()) - 1.f);
+
+    // Offsets of every row phase, split into the positive and the negative part, 
+    // so they can be applied with saturating adds and subtracts
+    std::vector<uint8_t> positive(8 * uRowBytes);
+    std::vector<uint8_t> negative(8 * uRowBytes);
+    for (uint8_t y = 0; y < 8; y++)
+    {
+        for (uint64_t k = 0; k < uWidth; k++)
+        {
+            const float fOffset = (((bayer[(y * 8) + (k & 7)] + 0.5f) / 64.f) - 0.5f) * fSpread;
+            const uint8_t uMagnitude = static_cast<uint8_t>(std::min(255.f, std::abs(fOffset) + 0.5f));
+
+            for (uint8_t c = 0; c < 3; c++)
+            {
+                positive[(y * uRowBytes) + (k * 3) + c] = fOffset > 0 ? uMagnitude : 0;
+                negative[(y * uRowBytes) + (k * 3) + c] = fOffset < 0 ? uMagnitude : 0;
+            }
+        }
+    }
+
+    ParallelFor(0, target.GetHeight(), [&](uint64_t first, uint64_t last) {
+        std::vector<uint8_t> dithered(uRowBytes);
+
+        for (uint64_t i = first; i < last; i++)
+        {
+            const uint8_t* row = target.GetRow(i);
+            const uint8_t* pos = &positive[(i & 7) * uRowBytes];
+            const uint8_t* neg = &negative[(i & 7) * uRowBytes];
+            uint64_t k = 0;
+
+#ifdef SWB_SSE2
+            for (; k + 16 <= uRowBytes; k += 16)
+            {
+                __m128i v = _mm_loadu_si128((const __m128i*) &row[k]);
+                v = _mm_adds_epu8(v, _mm_loadu_si128((const __m128i*) &pos[k]));
+                v = _mm_subs_epu8(v, _mm_loadu_si128((const __m128i*) &neg[k]));
+                _mm_storeu_si128((__m128i*) &dithered[k], v);
+            }
+#endif // SWB_SSE2
+
+            for (; k < uRowBytes; k++)
+                dithered[k] = static_cast<uint8_t>(std::clamp(row[k] + pos[k] - neg[k], 0, 255));
+
+            MapRow(dithered.data(), &indices[i * uWidth], uWidth, m_InverseMap.data());
+        }
+        });
+}
+
+// -----------------------------------------------------------------------------
+void Quantizer::MapFloydSteinberg(IN const Bitmap& target, IN std::vector<uint8_t>& indices) const
+{
+    // Pixel (x, y) pushes 7/16 of its error right and 3/16, 5/16, 1/16 
+    // to (x - 1, y + 1), (x, y + 1) and (x + 1, y + 1). 
+    // So row y + 1 can work on pixel x as soon as row y is past x + 1,
+    // every row trails the previous one by a few pixels and rows run in parallel.
+
+    const int64_t iWidth = target.GetWidth();
+    const int64_t iHeight = target.GetHeight();
+    const uint64_t uThreads = std::max<uint64_t>(1, std::min<uint64_t>(std::thread::hardware_concurrency(), iHeight));
+
+    // Error rows are reused, row y writes into the row of y + 1, 
+    // which was last used by y + 1 - uRingSize
+    const uint64_t uRingSize = (2 * uThreads) + 2;
+    const uint64_t uErrorPitch = (iWidth + 2) * 3;
+    std::vector<int16_t> errors(uRingSize * uErrorPitch, 0);
+
+    std::vector<std::atomic<int64_t>> progress(iHeight);
+    for (auto& p : progress)
+        p.store(0, std::memory_order_relaxed);
+
+    std::atomic<int64_t> nextRow = 0;
+
+    auto waitFor = [&](const int64_t& row, const int64_t& pixels) {
+        if (row < 0)
+            return;
+        while (progress[row].load(std::memory_order_acquire) < pixels)
+            std::this_thread::yield();
+    };
+
+    auto worker = [&]() {
+        for (int64_t y = nextRow.fetch_add(1); y < iHeight; y = nextRow.fetch_add(1))
+        {
+            waitFor(y + 1 - static_cast<int64_t>(uRingSize), iWidth);
+
+            // +3 so that x - 1 of the first pixel stays inside
+            const int16_t* current = &errors[(y % uRingSize) * uErrorPitch] + 3;
+            int16_t* next = &errors[((y + 1) % uRingSize) * uErrorPitch] + 3;
+            std::fill(next - 3, next - 3 + uErrorPitch, (int16_t)0);
+
+            const uint8_t* row = target.GetRow(y);
+            uint8_t* dst = &indices[y * iWidth];
+            int32_t carry[3] = { 0, 0, 0 };
+
+            for (int64_t x0 = 0; x0 < iWidth; x0 += QUANTIZER_WAVEFRONT_CHUNK)
+            {
+                const int64_t x1 = std::min<int64_t>(x0 + QUANTIZER_WAVEFRONT_CHUNK, iWidth);
+                waitFor(y - 1, std::min<int64_t>(x1 + 1, iWidth));
+
+                for (int64_t x = x0; x < x1; x++)
+                {
+                    // BGR in memory, palette is RGB
+                    uint8_t v[3];
+                    for (uint8_t c = 0; c < 3; c++)
+                    {
+                        const int32_t value = row[x * 3 + c] + ((current[x * 3 + c] + (7 * carry[c]) + 8) >> 4);
+                        v[c] = static_cast<uint8_t>(std::clamp(value, 0, 255));
+                    }
+
+                    const uint8_t index = Lookup(v[2], v[1], v[0]);
+                    const Color& p = m_Palette[index];
+                    dst[x] = index;
+
+                    const int32_t e[3] = { v[0] - p.Blue, v[1] - p.Green, v[2] - p.Red };
+                    for (uint8_t c = 0; c < 3; c++)
+                    {
+                        next[(x - 1) * 3 + c] += static_cast<int16_t>(3 * e[c]);
+                        next[x * 3 + c] += static_cast<int16_t>(5 * e[c]);
+                        next[(x + 1) * 3 + c] += static_cast<int16_t>(e[c]);
+                        carry[c] = e[c];
+                    }
+                }
+
+                progress[y].store(x1, std::memory_order_release);
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (uint64_t t = 1; t < uThreads; t++)
+        workers.emplace_back(worker);
+    worker();
+
+    for (auto& w : workers)
+        w.join();
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "Bitmap.hpp"
+
+namespace SWBitmaps
+{
+    class Quantizer
+    {
+    public:
+
+        Quantizer() = default;
+
+        ~Quantizer() = default;
+
+    public:
+
+        // Builds a palette of up to 'colors' entries with median cut 
+        // over a subsampled 5-bit per channel histogram
+        void Initialize(IN const Bitmap& target, IN const uint16_t& colors);
+
+        // Fills 'indices' with one palette index per pixel, rows in file order
+        void Map(IN const Bitmap& target, 
+            IN const DitherMode& dither, 
+            IN std::vector<uint8_t>& indices) const;
+
+    public:
+
+        // Getters -------------------------------------------------------------
+
+        const std::vector<Color>& GetPalette() const { return m_Palette; }
+
+    private:
+
+        void BuildInverseMap();
+
+        void MapPlain(IN const Bitmap& target, IN std::vector<uint8_t>& indices) const;
+
+        void MapOrdered(IN const Bitmap& target, IN std::vector<uint8_t>& indices) const;
+
+        void MapFloydSteinberg(IN const Bitmap& target, IN std::vector<uint8_t>& indices) const;
+
+        uint8_t Lookup(IN const uint8_t& r, IN const uint8_t& g, IN const uint8_t& b) const
+        {
+            return m_InverseMap[((r >> 3) << 10) | ((g >> 3) << 5) | (b >> 3)];
+        }
+
+    private:
+
+        std::vector<Color> m_Palette;
+
+        // Nearest palette entry for every 5-bit per channel color,
+        // padded so 32-bit gathers never read past the end
+        std::vector<uint8_t> m_InverseMap;
+
+    };
+}
@@ -0,0 +1,135 @@
+#include "Pch.h"
+
+#include "Random.hpp"
+
+using namespace SWBitmaps;
+
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+#define PHILOX_ROUNDS 10
+
+// Philox ----------------------------------------------------------------------
+
+// -----------------------------------------------------------------------------
+Philox::Philox(IN const uint64_t& seed)
+{
+    m_Key[0] = static_cast<uint32_t>(seed);
+    m_Key[1] = static_cast<uint32_t>(seed >> 32);
+}
+
+// -----------------------------------------------------------------------------
+void Philox::Block(IN const uint64_t& counter, IN uint32_t out[4]) const
+{
+    uint32_t x0 = static_cast<uint32_t>(counter);
+    uint32_t x1 = static_cast<uint32_t>(counter >> 32);
+    uint32_t x2 = 0;
+    uint32_t x3 = 0;
+    uint32_t k0 = m_Key[0];
+    uint32_t k1 = m_Key[1];
+
+    for (uint8_t r = 0; r < PHILOX_ROUNDS; r++)
+    {
+        if (r)
+        {
+            k0 += PHILOX_W0;
+            k1 += PHILOX_W1;
+        }
+
+        const uint64_t p0 = static_cast<uint64_t>(PHILOX_M0) * x0;
+        const uint64_t p1 = static_cast<uint64_t>(PHILOX_M1) * x2;
+
+        x0 = static_cast<uint32_t>(p1 >> 32) ^ x1 ^ k0;
+        x1 = static_cast<uint32_t>(p1);
+        x2 = static_cast<uint32_t>(p0 >> 32) ^ x3 ^ k1;
+        x3 = static_cast<uint32_t>(p0);
+    }
+
+    out[0] = x0;
+    out[1] = x1;
+    out[2] = x2;
+    out[3] = x3;
+}
+
+#ifdef SWB_SSE2
+// -----------------------------------------------------------------------------
+// 32 x 32 -> 64 bit multiply of four lanes
+static inline void MulHiLo(IN const __m128i& x, IN const __m128i& m, __m128i& lo, __m128i& hi)
+{
+    const __m128i p02 = _mm_mul_epu32(x, m);
+    const __m128i p13 = _mm_mul_epu32(_mm_srli_epi64(x, 32), m);
+
+    const __m128i a = _mm_shuffle_epi32(p02, _MM_SHUFFLE(3, 1, 2, 0));
+    const __m128i b = _mm_shuffle_epi32(p13, _MM_SHUFFLE(3, 1, 2, 0));
+
+    lo = _mm_unpacklo_epi32(a, b);
+    hi = _mm_unpackhi_epi32(a, b);
+}
+#endif // SWB_SSE2
+
+// -----------------------------------------------------------------------------
+void Philox::Fill(IN const uint64_t& firstBlock, IN uint8_t* dst, IN const uint64_t& size) const
+{
+    uint64_t i = 0;
+    uint64_t counter = firstBlock;
+
+#ifdef SWB_SSE2
+    // Four blocks at once, one per lane
+    const __m128i m0 = _mm_set1_epi32(PHILOX_M0);
+    const __m128i m1 = _mm_set1_epi32(PHILOX_M1);
+
+    for (; i + 64 <= size; i += 64, counter += 4)
+    {
+        __m128i x0 = _mm_setr_epi32(static_cast<uint32_t>(counter), 
+            static_cast<uint32_t>(counter + 1), 
+            static_cast<uint32_t>(counter + 2), 
+            static_cast<uint32_t>(counter + 3));
+        __m128i x1 = _mm_setr_epi32(static_cast<uint32_t>(counter >> 32), 
+            static_cast<uint32_t>((counter + 1) >> 32),
+            static_cast<uint32_t>((counter + 2) >> 32), 
+            static_cast<uint32_t>((counter + 3) >> 32));
+        __m128i x2 = _mm_setzero_si128();
+        __m128i x3 = _mm_setzero_si128();
+
+        uint32_t k0 = m_Key[0];
+        uint32_t k1 = m_Key[1];
+
+        for (uint8_t r = 0; r < PHILOX_ROUNDS; r++)
+        {
+            if (r)
+            {
+                k0 += PHILOX_W0;
+                k1 += PHILOX_W1;
+            }
+
+            __m128i lo0, hi0, lo1, hi1;
+            MulHiLo(x0, m0, lo0, hi0);
+            MulHiLo(x2, m1, lo1, hi1);
+
+            x0 = _mm_xor_si128(_mm_xor_si128(hi1, x1), _mm_set1_epi32(k0));
+            x1 = lo1;
+            x2 = _mm_xor_si128(_mm_xor_si128(hi0, x3), _mm_set1_epi32(k1));
+            x3 = lo0;
+        }
+
+        // Lanes hold the same word of four blocks, transpose to block order
+        const __m128i t0 = _mm_unpacklo_epi32(x0, x1);
+        const __m128i t1 = _mm_unpacklo_epi32(x2, x3);
+        const __m128i t2 = _mm_unpackhi_epi32(x0, x1);
+        const __m128i t3 = _mm_unpackhi_epi32(x2, x3);
+
+        _mm_storeu_si128((__m128i*) &dst[i], _mm_unpacklo_epi64(t0, t1));
+        _mm_storeu_si128((__m128i*) &dst[i + 16], _mm_unpackhi_epi64(t0, t1));
+        _mm_storeu_si128((__m128i*) &dst[i + 32], _mm_unpacklo_epi64(t2, t3));
+        _mm_storeu_si128((__m128i*) &dst[i + 48], _mm_unpackhi_epi64(t2, t3));
+    }
+#endif // SWB_SSE2
+
+    uint32_t block[4];
+    for (; i < size; i += 16, counter++)
+    {
+        Block(counter, block);
+        memcpy(&dst[i], block, std::min<uint64_t>(16, size - i));
+    }
+}
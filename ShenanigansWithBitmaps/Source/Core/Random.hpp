@@ -0,0 +1,31 @@
+#pragma once
+
+namespace SWBitmaps
+{
+    // Counter based Philox4x32-10 generator.
+    // Every 16 byte block depends only on the seed and the block index,
+    // so work can be split between threads in any way and the output 
+    // stays the same.
+    class Philox
+    {
+    public:
+
+        Philox(IN const uint64_t& seed);
+
+        ~Philox() = default;
+
+    public:
+
+        void Block(IN const uint64_t& counter, IN uint32_t out[4]) const;
+
+        // Fills 'size' bytes with consecutive blocks, starting with 'firstBlock'
+        void Fill(IN const uint64_t& firstBlock, IN uint8_t* dst, IN const uint64_t& size) const;
+
+        static uint64_t BlocksFor(IN const uint64_t& size) { return (size + 15) / 16; }
+
+    private:
+
+        uint32_t m_Key[2];
+
+    };
+}
@@ -0,0 +1,244 @@
+#include "Pch.h"
+
+#include "RangeEdit.hpp"
+#include "Parallel.hpp"
+
+#define RANGE_EDIT_MAGIC 0x44455753 // "SWED"
+#define RANGE_EDIT_VERSION 1
+// Six 64-bit fields and the 32-bit pattern size, the pattern follows
+#define RANGE_EDIT_RECORD_SIZE (6 * 8 + 4)
+
+// Big ranges are split between threads in chunks of at least this many bytes
+#define RANGE_EDIT_CHUNK (1024 * 1024)
+
+// -----------------------------------------------------------------------------
+static void XorBytes(IN uint8_t* dst, IN const uint64_t& size, IN const uint8_t& value)
+{
+    uint64_t i = 0;
+
+#if defined(SWB_AVX2)
+    const __m256i v = _mm256_set1_epi8((char)value);
+    for (; i + 32 <= size; i += 32)
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(dst + i)), v));
+#elif defined(SWB_SSE2)
+    const __m128i v = _mm_set1_epi8((char)value);
+    for (; i + 16 <= size; i += 16)
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_xor_si128(_mm_loadu_si128((const __m128i*)(dst + i)), v));
+#endif
+
+    for (; i < size; i++)
+        dst[i] ^= value;
+}
+
+// -----------------------------------------------------------------------------
+static void AddBytes(IN uint8_t* dst, IN const uint64_t& size, IN const uint8_t& value)
+{
+    uint64_t i = 0;
+
+#if defined(SWB_AVX2)
+    const __m256i v = _mm256_set1_epi8((char)value);
+    for (; i + 32 <= size; i += 32)
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_add_epi8(_mm256_loadu_si256((const __m256i*)(dst + i)), v));
+#elif defined(SWB_SSE2)
+    const __m128i v = _mm_set1_epi8((char)value);
+    for (; i + 16 <= size; i += 16)
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_add_epi8(_mm_loadu_si128((const __m128i*)(dst + i)), v));
+#endif
+
+    for (; i < size; i++)
+        dst[i] += value;
+}
+
+// -----------------------------------------------------------------------------
+// 'phase' is how far into the pattern dst[0] is
+static void FillPattern(IN uint8_t* dst, 
+    IN const uint64_t& size, 
+    IN const std::vector<uint8_t>& pattern, 
+    IN const uint64_t& phase)
+{
+    if (pattern.size() == 1)
+    {
+        memset(dst, pattern[0], size);
+        return;
+    }
+
+    // A block of whole periods at least 64 bytes long is copied over and over
+    const uint64_t uLength = pattern.size();
+    const uint64_t uBlock = uLength * ((64 + uLength - 1) / uLength);
+    std::vector<uint8_t> block(uBlock);
+    for (uint64_t i = 0; i < uBlock; i++)
+        block[i] = pattern[(i + phase) % uLength];
+
+    uint64_t i = 0;
+    for (; i + uBlock <= size; i += uBlock)
+        memcpy(dst + i, block.data(), uBlock);
+
+    memcpy(dst + i, block.data(), size - i);
+}
+
+// -----------------------------------------------------------------------------
+bool SWHexEditor::ApplyRangeEdit(IN char* buffer, IN const uint64_t& size, IN const RangeEdit& edit)
+{
+    if (edit.Offset >= size)
+        return false;
+
+    const uint64_t uSize = std::min(edit.Size, size - edit.Offset);
+    uint8_t* dst = (uint8_t*)buffer + edit.Offset;
+
+    if (uSize == 0)
+        return false;
+
+    switch (edit.Operation)
+    {
+    case Fill:
+    case Xor:
+    case Add:
+    {
+        if (edit.Pattern.empty())
+            return false;
+
+        SWBitmaps::ParallelFor(0, uSize, [&](uint64_t first, uint64_t last) {
+            if (edit.Operation == Fill)
+                FillPattern(dst + first, last - first, edit.Pattern, first % edit.Pattern.size());
+            else if (edit.Operation == Xor)
+                XorBytes(dst + first, last - first, edit.Pattern[0]);
+            else
+                AddBytes(dst + first, last - first, edit.Pattern[0]);
+            }, RANGE_EDIT_CHUNK);
+
+        return true;
+    }
+
+    case Copy:
+    {
+        if (edit.Source >= size)
+            return false;
+
+        memmove(dst, buffer + edit.Source, std::min(uSize, size - edit.Source));
+        return true;
+    }
+
+    case ZeroPadding:
+    {
+        if (edit.Pitch == 0 || 
+            edit.RowBytes >= edit.Pitch)
+            return false;
+
+        // Only the padding inside of the range is touched
+        const uint64_t uEnd = edit.Offset + uSize;
+        const uint64_t uFirstRow = edit.Offset > edit.Source ? (edit.Offset - edit.Source) / edit.Pitch : 0;
+
+        for (uint64_t row = uFirstRow; ; row++)
+        {
+            const uint64_t uPadding = edit.Source + (row * edit.Pitch) + edit.RowBytes;
+            if (uPadding >= uEnd)
+                break;
+
+            const uint64_t uFrom = std::max(uPadding, edit.Offset);
+            const uint64_t uTo = std::min(edit.Source + ((row + 1) * edit.Pitch), uEnd);
+            if (uFrom < uTo)
+                memset(buffer + uFrom, 0, uTo - uFrom);
+        }
+
+        return true;
+    }
+
+    default:
+        throw;
+    }
+}
+
+// RangeEditLog ----------------------------------------------------------------
+
+// -----------------------------------------------------------------------------
+void SWHexEditor::RangeEditLog::Replay(IN char* buffer, IN const uint64_t& size) const
+{
+    for (auto& edit : m_Edits)
+        ApplyRangeEdit(buffer, size, edit);
+}
+
+// -----------------------------------------------------------------------------
+bool SWHexEditor::RangeEditLog::SaveToFile(IN const std::wstring& path) const
+{
+    std::ofstream file(std::filesystem::path(path),
+        std::ios_base::binary | std::ios_base::out);
+
+    if (!file.is_open())
+        return false;
+
+    const uint32_t header[3] = { RANGE_EDIT_MAGIC, RANGE_EDIT_VERSION, static_cast<uint32_t>(m_Edits.size()) };
+    file.write((const char*)header, sizeof(header));
+
+    for (auto& edit : m_Edits)
+    {
+        const uint64_t fields[6] = { static_cast<uint64_t>(edit.Operation), edit.Offset, edit.Size, edit.Source, edit.Pitch, edit.RowBytes };
+        const uint32_t uPatternSize = static_cast<uint32_t>(edit.Pattern.size());
+
+        file.write((const char*)fields, sizeof(fields));
+        file.write((const char*)&uPatternSize, sizeof(uPatternSize));
+        file.write((const char*)edit.Pattern.data(), uPatternSize);
+    }
+
+    return file.good();
+}
+
+// -----------------------------------------------------------------------------
+bool SWHexEditor::RangeEditLog::LoadFromFile(IN const std::wstring& path)
+{
+    std::ifstream file(std::filesystem::path(path),
+        std::ios_base::binary | std::ios_base::in | std::ios_base::ate);
+
+    if (!file.is_open())
+        return false;
+
+    const uint64_t uFileSize = file.tellg();
+    file.seekg(0, std::ios_base::beg);
+
+    uint32_t header[3] = {};
+    file.read((char*)header, sizeof(header));
+    if (!file.good() ||
+        header[0] != RANGE_EDIT_MAGIC ||
+        header[1] != RANGE_EDIT_VERSION)
+        return false;
+
+    // Sizes come from the file, nothing bigger than what is left of it gets allocated
+    uint64_t uRemaining = uFileSize - sizeof(header);
+    if (header[2] > uRemaining / RANGE_EDIT_RECORD_SIZE)
+        return false;
+
+    std::vector<RangeEdit> edits;
+    for (uint32_t i = 0; i < header[2]; i++)
+    {
+        RangeEdit edit;
+        uint64_t fields[6] = {};
+        uint32_t uPatternSize = 0;
+
+        file.read((char*)fields, sizeof(fields));
+        file.read((char*)&uPatternSize, sizeof(uPatternSize));
+        uRemaining -= RANGE_EDIT_RECORD_SIZE;
+
+        if (!file.good() || 
+            fields[0] > ZeroPadding ||
+            uPatternSize > uRemaining)
+            return false;
+
+        edit.Operation = static_cast<RangeOperation>(fields[0]);
+        edit.Offset = fields[1];
+        edit.Size = fields[2];
+        edit.Source = fields[3];
+        edit.Pitch = fields[4];
+        edit.RowBytes = fields[5];
+
+        edit.Pattern.resize(uPatternSize);
+        file.read((char*)edit.Pattern.data(), uPatternSize);
+        uRemaining -= uPatternSize;
+
+        if (!file.good())
+            return false;
+
+        edits.push_back(std::move(edit));
+    }
+
+    m_Edits = std::move(edits);
+    return true;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+namespace SWHexEditor
+{
+    enum RangeOperation
+    {
+        // Pattern repeated over the range, starting at its first byte
+        Fill,
+        Xor,
+        // Wraps around, every byte gets Pattern[0] added
+        Add,
+        // From Source, ranges can overlap
+        Copy,
+        // Bytes after RowBytes in every Pitch long row, counted from Source
+        ZeroPadding
+    };
+
+    // One edit of [Offset, Offset + Size), the size of a descriptor
+    // doesn't depend on the size of the range
+    struct RangeEdit
+    {
+        RangeOperation Operation = Fill;
+        uint64_t Offset = 0;
+        uint64_t Size = 0;
+        uint64_t Source = 0;
+        uint64_t Pitch = 0;
+        uint64_t RowBytes = 0;
+        std::vector<uint8_t> Pattern = {};
+    };
+
+    // Clamps the range to the buffer, false if nothing was left of it
+    bool ApplyRangeEdit(IN char* buffer, IN const uint64_t& size, IN const RangeEdit& edit);
+
+    // Every applied edit in order, replaying it on the same 
+    // original bytes gives the same result
+    class RangeEditLog
+    {
+    public:
+
+        RangeEditLog() = default;
+
+        ~RangeEditLog() = default;
+
+    public:
+
+        void Record(IN const RangeEdit& edit) { m_Edits.push_back(edit); }
+
+        void Clear() { m_Edits.clear(); }
+
+        void Replay(IN char* buffer, IN const uint64_t& size) const;
+
+        bool SaveToFile(IN const std::wstring& path) const;
+
+        bool LoadFromFile(IN const std::wstring& path);
+
+    public:
+
+        // Getters -------------------------------------------------------------
+
+        const std::vector<RangeEdit>& GetEdits() const { return m_Edits; }
+
+    private:
+
+        std::vector<RangeEdit> m_Edits;
+
+    };
+}
@@ -0,0 +1,183 @@
+#include "Pch.h"
+
+#include "Resample.hpp"
+#include "Parallel.hpp"
+
+using namespace SWBitmaps;
+
+// Weights are fixed point in 1/2^14, every set sums up to exactly 2^14
+#define RESAMPLE_PRECISION 14
+
+// Taps of every output pixel, 'Stride' weights are stored for each of them
+struct Contributions
+{
+    std::vector<uint32_t> First;
+    std::vector<uint32_t> Count;
+    std::vector<int32_t> Weights;
+    uint32_t Stride = 0;
+};
+
+// -----------------------------------------------------------------------------
+static double FilterKernel(IN const ScaleFilter& filter, IN const double& x)
+{
+    const double ax = std::abs(x);
+
+    switch (filter)
+    {
+    case Nearest:
+        return ax <= 0.5 ? 1.0 : 0.0;
+
+    case Bilinear:
+        return ax < 1.0 ? 1.0 - ax : 0.0;
+
+    case Lanczos:
+    {
+        if (ax < 1e-8)
+            return 1.0;
+        if (ax >= 3.0)
+            return 0.0;
+
+        const double pi = 3.14159265358979323846;
+        return (3.0 * std::sin(pi * ax) * std::sin(pi * ax / 3.0)) / (pi * pi * ax * ax);
+    }
+
+    default:
+        throw;
+    }
+}
+
+// -----------------------------------------------------------------------------
+static Contributions ComputeContributions(IN const uint64_t& srcSize, 
+    IN const uint64_t& dstSize, 
+    IN const ScaleFilter& filter)
+{
+    const double fRadius = filter == Lanczos ? 3.0 : (filter == Bilinear ? 1.0 : 0.5);
+    const double fScale = (double)srcSize / dstSize;
+    const double fFilterScale = std::max(1.0, fScale);
+    const double fSupport = fRadius * fFilterScale;
+
+    Contributions c;
+    c.Stride = static_cast<uint32_t>(std::ceil(fSupport) * 2 + 1);
+    c.First.resize(dstSize);
+    c.Count.resize(dstSize);
+    c.Weights.assign(dstSize * c.Stride, 0);
+
+    std::vector<double> weights(c.Stride);
+
+    for (uint64_t i = 0; i < dstSize; i++)
+    {
+        const double fCenter = (i + 0.5) * fScale;
+        const int64_t first = std::max<int64_t>(0, static_cast<int64_t>(std::floor(fCenter - fSupport)));
+        const int64_t last = std::min<int64_t>(srcSize, static_cast<int64_t>(std::ceil(fCenter + fSupport)));
+        const uint32_t uCount = static_cast<uint32_t>(std::min<int64_t>(last - first, c.Stride));
+
+        double fSum = 0.0;
+        for (uint32_t k = 0; k < uCount; k++)
+        {
+            weights[k] = FilterKernel(filter, ((first + k + 0.5) - fCenter) / fFilterScale);
+            fSum += weights[k];
+        }
+
+        // Edges lose taps, the rest is normalized back to 1
+        int32_t* fixed = &c.Weights[i * c.Stride];
+        int32_t total = 0;
+        uint32_t uLargest = 0;
+        for (uint32_t k = 0; k < uCount; k++)
+        {
+            fixed[k] = static_cast<int32_t>(std::lround((weights[k] / (fSum != 0.0 ? fSum : 1.0)) * (1 << RESAMPLE_PRECISION)));
+            total += fixed[k];
+            if (fixed[k] > fixed[uLargest])
+                uLargest = k;
+        }
+
+        // Rounding error goes to the largest weight, so flat areas stay flat
+        if (uCount)
+            fixed[uLargest] += (1 << RESAMPLE_PRECISION) - total;
+
+        c.First[i] = static_cast<uint32_t>(first);
+        c.Count[i] = uCount;
+    }
+
+    return c;
+}
+
+// -----------------------------------------------------------------------------
+static inline uint8_t ClampFixed(IN const int32_t& v)
+{
+    return static_cast<uint8_t>(std::clamp((v + (1 << (RESAMPLE_PRECISION - 1))) >> RESAMPLE_PRECISION, 0, 255));
+}
+
+// -----------------------------------------------------------------------------
+void SWBitmaps::ResampleBgr(IN const uint8_t* src, 
+    IN const uint64_t& srcWidth, 
+    IN const uint64_t& srcHeight, 
+    IN const uint64_t& srcPitch, 
+    IN uint8_t* dst, 
+    IN const uint64_t& dstWidth, 
+    IN const uint64_t& dstHeight, 
+    IN const uint64_t& dstPitch, 
+    IN const ScaleFilter& filter)
+{
+    if (srcWidth == 0 || srcHeight == 0 || 
+        dstWidth == 0 || dstHeight == 0)
+        return;
+
+    const Contributions horizontal = ComputeContributions(srcWidth, dstWidth, filter);
+    const Contributions vertical = ComputeContributions(srcHeight, dstHeight, filter);
+    const uint64_t uRowBytes = dstWidth * 3;
+
+    // Only the source rows some output row needs
+    const uint64_t uFirstRow = vertical.First.front();
+    const uint64_t uLastRow = vertical.First.back() + vertical.Count.back();
+    std::vector<uint8_t> between((uLastRow - uFirstRow) * uRowBytes);
+
+    SWBitmaps::ParallelFor(uFirstRow, uLastRow, [&](uint64_t first, uint64_t last) {
+        for (uint64_t y = first; y < last; y++)
+        {
+            const uint8_t* in = src + (y * srcPitch);
+            uint8_t* out = between.data() + ((y - uFirstRow) * uRowBytes);
+
+            for (uint64_t x = 0; x < dstWidth; x++)
+            {
+                const uint8_t* p = in + ((uint64_t)horizontal.First[x] * 3);
+                const int32_t* w = &horizontal.Weights[x * horizontal.Stride];
+                int32_t b = 0, g = 0, r = 0;
+
+                for (uint32_t k = 0; k < horizontal.Count[x]; k++, p += 3)
+                {
+                    b += p[0] * w[k];
+                    g += p[1] * w[k];
+                    r += p[2] * w[k];
+                }
+
+                out[(x * 3) + 0] = ClampFixed(b);
+                out[(x * 3) + 1] = ClampFixed(g);
+                out[(x * 3) + 2] = ClampFixed(r);
+            }
+        }
+        }, 8);
+
+    SWBitmaps::ParallelFor(0, dstHeight, [&](uint64_t first, uint64_t last) {
+        // Taps go in the outer loop, so the inner one runs over whole rows and vectorizes
+        std::vector<int32_t> sums(uRowBytes);
+
+        for (uint64_t y = first; y < last; y++)
+        {
+            const int32_t* w = &vertical.Weights[y * vertical.Stride];
+            std::fill(sums.begin(), sums.end(), 0);
+
+            for (uint32_t k = 0; k < vertical.Count[y]; k++)
+            {
+                const uint8_t* in = between.data() + ((vertical.First[y] + k - uFirstRow) * uRowBytes);
+                const int32_t weight = w[k];
+
+                for (uint64_t i = 0; i < uRowBytes; i++)
+                    sums[i] += in[i] * weight;
+            }
+
+            uint8_t* out = dst + (y * dstPitch);
+            for (uint64_t i = 0; i < uRowBytes; i++)
+                out[i] = ClampFixed(sums[i]);
+        }
+        }, 8);
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+namespace SWBitmaps
+{
+    enum ScaleFilter
+    {
+        // Closest source pixel
+        Nearest,
+        // Triangle filter, widened when downscaling so every source pixel counts
+        Bilinear,
+        // Lanczos with 3 lobes, widened when downscaling
+        Lanczos
+    };
+
+    // Scales rows of BGR pixels with a separable filter, rows are 
+    // in the same order in both buffers, horizontal pass goes first
+    void ResampleBgr(IN const uint8_t* src, 
+        IN const uint64_t& srcWidth, 
+        IN const uint64_t& srcHeight, 
+        IN const uint64_t& srcPitch, 
+        IN uint8_t* dst, 
+        IN const uint64_t& dstWidth, 
+        IN const uint64_t& dstHeight, 
+        IN const uint64_t& dstPitch, 
+        IN const ScaleFilter& filter);
+}
@@ -0,0 +1,326 @@
+#include "Pch.h"
+
+#include "ResultCache.hpp"
+#include "Parallel.hpp"
+
+// Bumped whenever an op changes its output, older results stop matching
+#define RESULT_CACHE_VERSION 1
+// Rows hashed as one chunk
+#define RESULT_CACHE_CHUNK (1024 * 1024)
+// Marks a directory as the cache's own, nothing is evicted from one without it
+#define RESULT_CACHE_MARKER ".swb-result-cache"
+// Temporary files older than this were left by a Store that didn't finish
+#define RESULT_CACHE_STALE_MINUTES 10
+
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ull
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4Full
+#define XXH_PRIME64_3 0x165667B19E3779F9ull
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ull
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ull
+
+// -----------------------------------------------------------------------------
+static uint64_t Xxh64Round(IN uint64_t acc, IN const uint64_t& input)
+{
+    acc += input * XXH_PRIME64_2;
+    acc = std::rotl(acc, 31);
+    return acc * XXH_PRIME64_1;
+}
+
+// -----------------------------------------------------------------------------
+static uint64_t Xxh64Merge(IN uint64_t acc, IN const uint64_t& value)
+{
+    acc ^= Xxh64Round(0, value);
+    return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+// -----------------------------------------------------------------------------
+uint64_t SWBitmaps::Xxh64(IN const void* data, IN const uint64_t& size, IN const uint64_t& seed)
+{
+    const uint8_t* p = (const uint8_t*)data;
+    const uint8_t* end = p + size;
+    uint64_t hash = 0;
+
+    auto read64 = [](const uint8_t* src) { uint64_t v; memcpy(&v, src, sizeof(v)); return v; };
+    auto read32 = [](const uint8_t* src) { uint32_t v; memcpy(&v, src, sizeof(v)); return v; };
+
+    if (size >= 32)
+    {
+        uint64_t v[4] = { seed + XXH_PRIME64_1 + XXH_PRIME64_2, seed + XXH_PRIME64_2, seed, seed - XXH_PRIME64_1 };
+
+        for (; p + 32 <= end; p += 32)
+            for (uint8_t i = 0; i < 4; i++)
+                v[i] = Xxh64Round(v[i], read64(p + i * 8));
+
+        hash = std::rotl(v[0], 1) + std::rotl(v[1], 7) + std::rotl(v[2], 12) + std::rotl(v[3], 18);
+        for (uint8_t i = 0; i < 4; i++)
+            hash = Xxh64Merge(hash, v[i]);
+    }
+    else
+    {
+        hash = seed + XXH_PRIME64_5;
+    }
+
+    hash += size;
+
+    for (; p + 8 <= end; p += 8)
+    {
+        hash ^= Xxh64Round(0, read64(p));
+        hash = std::rotl(hash, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+    }
+
+    if (p + 4 <= end)
+    {
+        hash ^= read32(p) * XXH_PRIME64_1;
+        hash = std::rotl(hash, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        p += 4;
+    }
+
+    for (; p < end; p++)
+    {
+        hash ^= *p * XXH_PRIME64_5;
+        hash = std::rotl(hash, 11) * XXH_PRIME64_1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= XXH_PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= XXH_PRIME64_3;
+    hash ^= hash >> 32;
+
+    return hash;
+}
+
+// -----------------------------------------------------------------------------
+SWBitmaps::ResultCache::ResultCache(IN const std::filesystem::path& directory, IN const uint64_t& capacity)
+    : m_Directory(directory), m_uCapacity(capacity)
+{
+    std::error_code error;
+    std::filesystem::create_directories(m_Directory, error);
+    if (!std::filesystem::is_directory(m_Directory, error))
+        return;
+
+    // Eviction deletes files, so it only ever runs in a directory the cache made 
+    // or found empty. Anything else could be somebody's images
+    const std::filesystem::path marker = m_Directory / RESULT_CACHE_MARKER;
+    if (!std::filesystem::is_regular_file(marker, error))
+    {
+        if (!std::filesystem::is_empty(m_Directory, error) || error)
+            return;
+
+        std::ofstream file(marker, std::ios_base::binary | std::ios_base::out);
+        if (!file.is_open())
+            return;
+    }
+
+    const auto now = std::filesystem::file_time_type::clock::now();
+
+    std::vector<std::pair<std::filesystem::file_time_type, std::filesystem::path>> files;
+    for (const auto& entry : std::filesystem::directory_iterator(m_Directory, error))
+    {
+        if (!entry.is_regular_file(error))
+            continue;
+
+        const std::filesystem::path& path = entry.path();
+        const std::filesystem::file_time_type time = entry.last_write_time(error);
+
+        if (path.extension() == ".bmp" && IsKey(path.stem().string()))
+        {
+            files.emplace_back(time, path);
+            continue;
+        }
+
+        // Leftovers of a Store that never got to the rename. A fresh one can 
+        // belong to another process sharing the directory, it's left alone
+        if (path.extension() == ".tmp" && IsKey(path.filename().string().substr(0, 16)) && 
+            now - time > std::chrono::minutes(RESULT_CACHE_STALE_MINUTES))
+            std::filesystem::remove(path, error);
+    }
+
+    // A hit touches the file, so the modification time is the last use
+    std::sort(files.begin(), files.end());
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    for (const auto& file : files)
+        Touch(file.second.stem().string(), std::filesystem::file_size(file.second, error));
+
+    Evict("");
+    m_bValid = true;
+}
+
+// -----------------------------------------------------------------------------
+std::string SWBitmaps::ResultCache::MakeKey(IN const Bitmap& input, IN const std::string& chain)
+{
+    const std::string material = std::format("{:016x}\n{}", HashPixels(input), chain);
+    return std::format("{:016x}", Xxh64(material.data(), material.size(), RESULT_CACHE_VERSION));
+}
+
+// -----------------------------------------------------------------------------
+uint64_t SWBitmaps::ResultCache::HashPixels(IN const Bitmap& bitmap)
+{
+    const BitmapHeader& header = bitmap.GetHeader();
+    const uint64_t uPitch = bitmap.GetPitch();
+    const uint64_t uRowBytes = (header.ColorDepth * bitmap.GetWidth() + 7) / 8;
+    const uint64_t uHeight = bitmap.GetHeight();
+    const uint64_t uRowsPerChunk = std::max<uint64_t>(1, RESULT_CACHE_CHUNK / std::max<uint64_t>(1, uPitch));
+    const uint64_t uChunks = (uHeight + uRowsPerChunk - 1) / uRowsPerChunk;
+
+    // Chunks, then the palette
+    std::vector<uint64_t> hashes(uChunks + 1, 0);
+
+    ParallelFor(0, uChunks, [&](uint64_t first, uint64_t last) {
+        for (uint64_t c = first; c < last; c++)
+        {
+            const uint64_t uFirstRow = c * uRowsPerChunk;
+            const uint64_t uLastRow = std::min(uHeight, uFirstRow + uRowsPerChunk);
+
+            if (uRowBytes == uPitch)
+            {
+                hashes[c] = Xxh64(bitmap.GetRow(uFirstRow), (uLastRow - uFirstRow) * uPitch, c);
+                continue;
+            }
+
+            uint64_t hash = c;
+            for (uint64_t y = uFirstRow; y < uLastRow; y++)
+                hash = Xxh64(bitmap.GetRow(y), uRowBytes, hash);
+            hashes[c] = hash;
+        }
+        }, 1);
+
+    // Palette sits between the info header and the pixels
+    const uint64_t uPaletteOffset = 14 + header.SizeOfHeader;
+    if (header.FileBeginOffset > uPaletteOffset)
+    {
+        const uint8_t* palette = bitmap.GetRow(0) - header.FileBeginOffset + uPaletteOffset;
+        hashes[uChunks] = Xxh64(palette, header.FileBeginOffset - uPaletteOffset, 0);
+    }
+
+    // Sign of the height is the row order
+    const int64_t geometry[] = { header.Width, header.Height, header.ColorDepth, header.CompressionMethod };
+
+    return Xxh64(hashes.data(), hashes.size() * sizeof(uint64_t), Xxh64(geometry, sizeof(geometry), 0));
+}
+
+// -----------------------------------------------------------------------------
+bool SWBitmaps::ResultCache::Lookup(IN const std::string& key, IN Bitmap& output)
+{
+    const std::filesystem::path path = GetPath(key);
+
+    // Another process sharing the directory could have written it
+    output.Initialize(path.wstring());
+    if (!output.IsValid())
+    {
+        m_uMisses++;
+        return false;
+    }
+
+    std::error_code error;
+    std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error);
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    Touch(key, output.GetHeader().FileSize);
+    m_uHits++;
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+bool SWBitmaps::ResultCache::Store(IN const std::string& key, IN Bitmap& result)
+{
+    if (!m_bValid || !result.IsValid())
+        return false;
+
+#ifdef _WIN32
+    const uint64_t uProcess = GetCurrentProcessId();
+#else
+    const uint64_t uProcess = getpid();
+#endif // _WIN32
+
+    const std::filesystem::path path = GetPath(key);
+    std::filesystem::path temporary = path;
+    temporary += std::format(".{}.{}.tmp", uProcess, m_uTemporaryCounter++);
+
+    // A failed save invalidates the bitmap, it's still in use
+    {
+        std::ofstream probe(temporary, std::ios_base::binary | std::ios_base::out);
+        if (!probe.is_open())
+            return false;
+    }
+
+    std::error_code error;
+    const bool bSaved = result.SaveToFile(temporary.wstring());
+    const uint64_t uSize = std::filesystem::file_size(temporary, error);
+
+    if (bSaved && !error)
+        std::filesystem::rename(temporary, path, error);
+
+    if (!bSaved || error)
+    {
+        std::filesystem::remove(temporary, error);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    Touch(key, uSize);
+    Evict(key);
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+uint64_t SWBitmaps::ResultCache::GetBytes() const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_uBytes;
+}
+
+// Private ---------------------------------------------------------------------
+
+// -----------------------------------------------------------------------------
+std::filesystem::path SWBitmaps::ResultCache::GetPath(IN const std::string& key) const
+{
+    return m_Directory / (key + ".bmp");
+}
+
+// -----------------------------------------------------------------------------
+bool SWBitmaps::ResultCache::IsKey(IN const std::string& name)
+{
+    return name.size() == 16 && 
+        std::all_of(name.begin(), name.end(), [](char c) { return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'); });
+}
+
+// -----------------------------------------------------------------------------
+void SWBitmaps::ResultCache::Touch(IN const std::string& key, IN const uint64_t& size)
+{
+    auto it = m_Entries.find(key);
+    if (it != m_Entries.end())
+    {
+        m_uBytes -= it->second.second;
+        m_Order.erase(it->second.first);
+        m_Entries.erase(it);
+    }
+
+    m_Order.push_front(key);
+    m_Entries[key] = { m_Order.begin(), size };
+    m_uBytes += size;
+}
+
+// -----------------------------------------------------------------------------
+void SWBitmaps::ResultCache::Evict(IN const std::string& keep)
+{
+    while (m_uBytes > m_uCapacity && !m_Order.empty() && m_Order.back() != keep)
+    {
+        const std::string key = m_Order.back();
+        auto it = m_Entries.find(key);
+
+        std::error_code error;
+        std::filesystem::remove(GetPath(key), error);
+
+        m_uBytes -= it->second.second;
+        m_Order.pop_back();
+        m_Entries.erase(it);
+        m_uEvictions++;
+    }
+}
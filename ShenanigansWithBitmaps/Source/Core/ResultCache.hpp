@@ -0,0 +1,86 @@
+#pragma once
+
+#include "Bitmap.hpp"
+
+namespace SWBitmaps
+{
+    // https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md
+    uint64_t Xxh64(IN const void* data, IN const uint64_t& size, IN const uint64_t& seed);
+
+    // Results of op chains on disk, one .bmp per key. The key is a hash of
+    // the input pixels and of the chain, so the same ops on the same image
+    // find the result of any earlier run. Files are written under a temporary
+    // name and renamed, a reader never sees half of one. Least recently used
+    // results go first once the directory grows over the capacity. The 
+    // directory has to be empty or one the cache made before, only files
+    // named by a key are ever evicted.
+    class ResultCache
+    {
+    public:
+
+        // Results already in 'directory' are kept, oldest first in the LRU order.
+        // Invalid when 'directory' holds anything but an earlier cache
+        ResultCache(IN const std::filesystem::path& directory, IN const uint64_t& capacity);
+
+        ~ResultCache() = default;
+
+    public:
+
+        // 'chain' is the canonical text of the ops, equal chains give equal keys
+        static std::string MakeKey(IN const Bitmap& input, IN const std::string& chain);
+
+        // Hash of the pixels, the palette and the geometry, padding at the end of rows is skipped.
+        // Chunks of rows are hashed in parallel, then the hashes of the chunks.
+        static uint64_t HashPixels(IN const Bitmap& bitmap);
+
+        // False on a miss, 'output' is initialized from the cached file otherwise
+        bool Lookup(IN const std::string& key, IN Bitmap& output);
+
+        bool Store(IN const std::string& key, IN Bitmap& result);
+
+    public:
+
+        // Getters -------------------------------------------------------------
+
+        bool IsValid() const { return m_bValid; }
+
+        uint64_t GetHits() const { return m_uHits.load(); }
+
+        uint64_t GetMisses() const { return m_uMisses.load(); }
+
+        uint64_t GetEvictions() const { return m_uEvictions.load(); }
+
+        uint64_t GetBytes() const;
+
+    private:
+
+        std::filesystem::path GetPath(IN const std::string& key) const;
+
+        // 16 lowercase hex digits, as MakeKey gives them
+        static bool IsKey(IN const std::string& name);
+
+        // Moves the key to the front of the LRU order, adds it if it's new
+        void Touch(IN const std::string& key, IN const uint64_t& size);
+
+        // Removes least recently used files until the bytes fit, 'keep' stays
+        void Evict(IN const std::string& keep);
+
+    private:
+
+        std::filesystem::path m_Directory = "";
+        uint64_t m_uCapacity = 0;
+        bool m_bValid = false;
+
+        mutable std::mutex m_Mutex;
+        // Front is the most recently used
+        std::list<std::string> m_Order;
+        std::unordered_map<std::string, std::pair<std::list<std::string>::iterator, uint64_t>> m_Entries;
+        uint64_t m_uBytes = 0;
+
+        std::atomic<uint64_t> m_uHits = 0;
+        std::atomic<uint64_t> m_uMisses = 0;
+        std::atomic<uint64_t> m_uEvictions = 0;
+        std::atomic<uint64_t> m_uTemporaryCounter = 0;
+
+    };
+}
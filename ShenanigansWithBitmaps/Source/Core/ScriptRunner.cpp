@@ -0,0 +1,850 @@
+#include "Pch.h"
+
+#include "ScriptRunner.hpp"
+#include "Atlas.hpp"
+
+// -----------------------------------------------------------------------------
+// Whitespace separates arguments, double quotes only group. Backslashes are 
+// kept as they are, so Windows paths need no escaping.
+static std::vector<std::string> SplitArguments(IN const std::string& line)
+{
+    std::vector<std::string> args;
+    std::string arg;
+    bool bInArg = false;
+    bool bQuoted = false;
+
+    for (const char c : line)
+    {
+        if (c == '"')
+        {
+            bQuoted = !bQuoted;
+            bInArg = true;
+            continue;
+        }
+
+        if (!bQuoted && c == '#')
+            break;
+
+        if (!bQuoted && std::isspace(static_cast<unsigned char>(c)))
+        {
+            if (bInArg)
+                args.push_back(arg);
+
+            arg.clear();
+            bInArg = false;
+            continue;
+        }
+
+        arg += c;
+        bInArg = true;
+    }
+
+    if (bInArg)
+        args.push_back(arg);
+
+    return args;
+}
+
+// -----------------------------------------------------------------------------
+static bool ParseNumber(IN const std::string& text, IN uint64_t& value)
+{
+    char* end = nullptr;
+    value = std::strtoull(text.c_str(), &end, 10);
+
+    return !text.empty() && text[0] != '-' && *end == '\0';
+}
+
+// -----------------------------------------------------------------------------
+static bool ParseNumber(IN const std::string& text, IN int64_t& value)
+{
+    char* end = nullptr;
+    value = std::strtoll(text.c_str(), &end, 10);
+
+    return !text.empty() && *end == '\0';
+}
+
+// -----------------------------------------------------------------------------
+// "nan" and "inf" would slip past range checks
+static bool ParseNumber(IN const std::string& text, IN float& value)
+{
+    char* end = nullptr;
+    value = std::strtof(text.c_str(), &end);
+
+    return !text.empty() && *end == '\0' && std::isfinite(value);
+}
+
+// Script files are UTF-8 on every platform
+// -----------------------------------------------------------------------------
+static std::wstring ToWidePath(IN const std::string& path)
+{
+    return std::filesystem::path(std::u8string(path.begin(), path.end())).wstring();
+}
+
+// -----------------------------------------------------------------------------
+// "shm:NAME" or "fd:N", false for file paths
+static bool ParseSharedTarget(IN const std::string& target, IN std::string& name, IN int& fd)
+{
+    uint64_t uFd = 0;
+    name.clear();
+    fd = -1;
+
+    if (target.rfind("shm:", 0) == 0)
+    {
+        name = target.substr(4);
+        return true;
+    }
+
+    if (target.rfind("fd:", 0) == 0)
+    {
+        if (ParseNumber(target.substr(3), uFd) && uFd <= INT32_MAX)
+            fd = static_cast<int>(uFd);
+        return true;
+    }
+
+    return false;
+}
+
+// -----------------------------------------------------------------------------
+bool ScriptRunner::RunFile(IN const std::string& path, IN std::ostream& report)
+{
+    if (path == "-")
+        return Run(std::cin, report);
+
+    std::ifstream file(std::filesystem::path(std::u8string(path.begin(), path.end())));
+    if (!file.is_open())
+    {
+        m_Error = "can't open script " + path;
+        return false;
+    }
+
+    return Run(file, report);
+}
+
+// -----------------------------------------------------------------------------
+bool ScriptRunner::Run(IN std::istream& script, IN std::ostream& report)
+{
+    std::string line;
+    uint64_t uLine = 0;
+
+    report << std::format("{:<10} {:>12} {:>12} {:>12}\n", "command", "ms", "MB", "MPix/s");
+
+    while (std::getline(script, line))
+    {
+        uLine++;
+
+        if (!RunLine(line, report))
+        {
+            m_Error = "line " + std::to_string(uLine) + ": " + m_Error;
+            return false;
+        }
+    }
+
+    // Ops still queued at the end have to reach the image, an inplace load 
+    // expects them in the segment
+    const auto start = std::chrono::steady_clock::now();
+    if (!Flush(report))
+    {
+        m_Error = "end of script: " + m_Error;
+        return false;
+    }
+    m_Total.Milliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    PrintStats(m_Total, report);
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+bool ScriptRunner::RunLine(IN const std::string& line, IN std::ostream& report)
+{
+    const std::vector<std::string> args = SplitArguments(line);
+    if (args.empty())
+        return true;
+
+    CommandStats stats = { args[0] };
+
+    const auto start = std::chrono::steady_clock::now();
+    const bool bResult = Execute(args, stats, report);
+    stats.Milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    if (!bResult)
+        return false;
+
+    m_Total.Milliseconds += stats.Milliseconds;
+    m_Total.Bytes += stats.Bytes;
+    m_Total.Pixels += stats.Pixels;
+
+    PrintStats(stats, report);
+    return true;
+}
+
+// Private ---------------------------------------------------------------------
+
+// -----------------------------------------------------------------------------
+bool ScriptRunner::Execute(IN const std::vector<std::string>& args, IN CommandStats& stats, IN std::ostream& report)
+{
+    const std::string& command = args[0];
+
+    auto expect = [&](uint64_t min, uint64_t max) {
+        if (args.size() - 1 >= min && args.size() - 1 <= max)
+            return true;
+
+        m_Error = command + " takes " + (min == max ? std::to_string(min) : std::to_string(min) + " to " + std::to_string(max)) + " arguments";
+        return false;
+    };
+
+    if (m_bOpsOnly && 
+        (command == "load" || command == "save" || command == "atlas" || command == "cache"))
+    {
+        m_Error = command + " can't be used here";
+        return false;
+    }
+
+    if (command == "load")
+    {
+        if (!expect(1, 2))
+            return false;
+
+        std::string name;
+        int fd = -1;
+        const bool bShared = ParseSharedTarget(args[1], name, fd);
+
+        if (args.size() > 2 && (args[2] != "inplace" || !bShared))
+        {
+            m_Error = "only shm: and fd: can be loaded inplace";
+            return false;
+        }
+
+        const bool bInPlace = args.size() > 2;
+
+        m_Pending.clear();
+        m_pBitmap = std::make_shared<SWBitmaps::Bitmap>();
+        if (!bShared)
+            m_pBitmap->Initialize(ToWidePath(args[1]));
+        else if (!name.empty())
+            m_pBitmap->InitializeFromSharedMemory(name, bInPlace);
+        else if (fd >= 0)
+            m_pBitmap->InitializeFromFd(fd, bInPlace);
+
+        if (!m_pBitmap->IsValid())
+        {
+            m_pBitmap.reset();
+            m_Error = "can't load " + args[1];
+            return false;
+        }
+
+        stats.Bytes = m_pBitmap->GetHeader().FileSize;
+        stats.Pixels = m_pBitmap->GetWidth() * m_pBitmap->GetHeight();
+        return true;
+    }
+
+    if (command == "new")
+    {
+        uint64_t w = 0, h = 0;
+        if (!expect(2, 2))
+            return false;
+        if (!ParseNumber(args[1], w) || !ParseNumber(args[2], h) ||
+            w == 0 || h == 0 || w > INT32_MAX || h > INT32_MAX)
+        {
+            m_Error = "invalid size";
+            return false;
+        }
+
+        m_Pending.clear();
+        m_pBitmap = std::make_shared<SWBitmaps::Bitmap>();
+        m_pBitmap->Initialize(static_cast<int32_t>(w), static_cast<int32_t>(h));
+
+        stats.Bytes = m_pBitmap->GetHeader().FileSize;
+        stats.Pixels = w * h;
+        return true;
+    }
+
+    if (command == "atlas")
+    {
+        uint64_t uWidth = 0, uPadding = 0;
+        if (!expect(2, 4))
+            return false;
+        if ((args.size() > 3 && (!ParseNumber(args[3], uWidth) || uWidth > INT32_MAX)) ||
+            (args.size() > 4 && (!ParseNumber(args[4], uPadding) || uPadding > UINT16_MAX)))
+        {
+            m_Error = "invalid atlas width or padding";
+            return false;
+        }
+
+        std::ifstream list(std::filesystem::path(ToWidePath(args[1])));
+        if (!list.is_open())
+        {
+            m_Error = "can't open list " + args[1];
+            return false;
+        }
+
+        std::vector<std::wstring> paths;
+        std::string line;
+        while (std::getline(list, line))
+        {
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+            if (!line.empty())
+                paths.push_back(ToWidePath(line));
+        }
+
+        const std::filesystem::path output = ToWidePath(args[2]);
+        std::filesystem::path index = output;
+        index.replace_extension(".json");
+
+        SWBitmaps::AtlasBuilder atlas;
+        if (!atlas.Pack(paths, static_cast<uint32_t>(uWidth), static_cast<uint32_t>(uPadding)) ||
+            !atlas.Write(output.wstring()) ||
+            !atlas.WriteIndex(index.wstring(), output.filename().wstring()))
+        {
+            m_Error = atlas.GetError().empty() ? "can't write " + index.string() : atlas.GetError();
+            return false;
+        }
+
+        for (const auto& placement : atlas.GetPlacements())
+            stats.Pixels += placement.Width * placement.Height;
+        stats.Bytes = SWBitmaps::Bitmap::CalcPitch(24, atlas.GetWidth()) * atlas.GetHeight();
+
+        report << std::format("{:<10} {}x{} atlas of {} images, {} skipped\n", "",
+            atlas.GetWidth(),
+            atlas.GetHeight(),
+            atlas.GetPlacements().size(),
+            atlas.GetSkipped().size());
+        return true;
+    }
+
+    if (command == "cache")
+    {
+        uint64_t uMegabytes = 1024;
+        if (!expect(1, 2))
+            return false;
+        if (args.size() > 2 && !ParseNumber(args[2], uMegabytes))
+        {
+            m_Error = "invalid cache size";
+            return false;
+        }
+
+        // Queued ops were meant for the old cache
+        if (!Flush(report))
+            return false;
+
+        if (args[1] == "off")
+        {
+            m_pCache.reset();
+            return true;
+        }
+
+        m_pCache = std::make_shared<SWBitmaps::ResultCache>(ToWidePath(args[1]), uMegabytes * 1024 * 1024);
+        if (!m_pCache->IsValid())
+        {
+            m_pCache.reset();
+            m_Error = "can't use " + args[1] + " as a cache, it has to be empty or an earlier cache";
+            return false;
+        }
+
+        return true;
+    }
+
+    // Every other command works on the loaded image
+    if (!m_pBitmap)
+    {
+        m_Error = "no image, " + command + " needs load or new first";
+        return false;
+    }
+
+    // Anything else needs the queued ops applied first
+    if (!IsDeterministic(args) && !Flush(report))
+        return false;
+
+    SWBitmaps::Bitmap& bitmap = *m_pBitmap;
+    stats.Bytes = bitmap.GetPitch() * bitmap.GetHeight();
+    stats.Pixels = bitmap.GetWidth() * bitmap.GetHeight();
+
+    if (command == "save")
+    {
+        if (!expect(1, 3))
+            return false;
+
+        SWBitmaps::SaveFormat format = SWBitmaps::Native;
+        SWBitmaps::DitherMode dither = SWBitmaps::NoDither;
+
+        if (args.size() > 2)
+        {
+            const std::string names[] = { "native", "gray8", "pal8", "pal4", "mono1" };
+            auto it = std::find(std::begin(names), std::end(names), args[2]);
+            if (it == std::end(names))
+            {
+                m_Error = "unknown format " + args[2];
+                return false;
+            }
+            format = static_cast<SWBitmaps::SaveFormat>(it - std::begin(names));
+        }
+
+        if (args.size() > 3)
+        {
+            const std::string names[] = { "none", "ordered", "fs" };
+            auto it = std::find(std::begin(names), std::end(names), args[3]);
+            if (it == std::end(names))
+            {
+                m_Error = "unknown dither " + args[3];
+                return false;
+            }
+            dither = static_cast<SWBitmaps::DitherMode>(it - std::begin(names));
+        }
+
+        std::string name;
+        int fd = -1;
+
+        if (ParseSharedTarget(args[1], name, fd))
+        {
+            const bool bResult = format == SWBitmaps::Native &&
+                (name.empty() ? fd >= 0 && bitmap.SaveToFd(fd) : bitmap.SaveToSharedMemory(name));
+
+            if (!bResult)
+            {
+                m_Error = "can't save " + args[1] + (format != SWBitmaps::Native ? ", shared memory takes only native" : "");
+                return false;
+            }
+
+            stats.Bytes = bitmap.GetHeader().FileSize;
+            return true;
+        }
+
+        if (format != SWBitmaps::Native && bitmap.GetHeader().ColorDepth != 24)
+        {
+            m_Error = "can't save " + args[1] + ", " + args[2] + " needs a 24-bit image";
+            return false;
+        }
+
+        const std::wstring path = ToWidePath(args[1]);
+        if (!bitmap.SaveToFile(path, format, dither))
+        {
+            m_Error = "can't save " + args[1];
+            return false;
+        }
+
+        std::error_code error;
+        stats.Bytes = std::filesystem::file_size(path, error);
+
+        return true;
+    }
+
+    if (command == "scale")
+    {
+        uint64_t w = 0, h = 0;
+        if (!expect(2, 3))
+            return false;
+        if (!ParseNumber(args[1], w) || !ParseNumber(args[2], h) ||
+            w == 0 || w > INT32_MAX || h > INT32_MAX)
+        {
+            m_Error = "invalid size";
+            return false;
+        }
+
+        SWBitmaps::ScaleFilter filter = SWBitmaps::Nearest;
+        if (args.size() > 3)
+        {
+            const std::string names[] = { "nearest", "bilinear", "lanczos" };
+            auto it = std::find(std::begin(names), std::end(names), args[3]);
+            if (it == std::end(names))
+            {
+                m_Error = "unknown filter " + args[3];
+                return false;
+            }
+            filter = static_cast<SWBitmaps::ScaleFilter>(it - std::begin(names));
+        }
+
+        if (Defer(args, std::format("scale {} {} {}", w, h, static_cast<uint32_t>(filter)), stats))
+            return true;
+
+        bitmap.ScaleTo(static_cast<uint32_t>(w), static_cast<uint32_t>(h), filter);
+
+        // Both the read and the written pixels
+        stats.Bytes += bitmap.GetPitch() * bitmap.GetHeight();
+        stats.Pixels = bitmap.GetWidth() * bitmap.GetHeight();
+        return true;
+    }
+
+    if (command == "color")
+    {
+        uint64_t rgb[3] = {};
+        if (!expect(3, 3))
+            return false;
+        for (uint8_t i = 0; i < 3; i++)
+        {
+            if (!ParseNumber(args[i + 1], rgb[i]) || rgb[i] > 255)
+            {
+                m_Error = "invalid color";
+                return false;
+            }
+        }
+
+        if (Defer(args, std::format("color {} {} {}", rgb[0], rgb[1], rgb[2]), stats))
+            return true;
+
+        bitmap.ColorWhole({ (uint8_t)rgb[0], (uint8_t)rgb[1], (uint8_t)rgb[2] });
+        return true;
+    }
+
+    if (command == "noise")
+    {
+        float fAmount = 0.f;
+        uint64_t uSeed = static_cast<uint64_t>(time(NULL));
+        if (!expect(2, 3))
+            return false;
+        if ((args[1] != "uniform" && args[1] != "gaussian") ||
+            !ParseNumber(args[2], fAmount) ||
+            (args.size() > 3 && !ParseNumber(args[3], uSeed)))
+        {
+            m_Error = "invalid noise arguments";
+            return false;
+        }
+
+        if (args.size() > 3 && Defer(args, std::format("noise {} {} {}", args[1], fAmount, uSeed), stats))
+            return true;
+
+        bitmap.AddNoise(args[1] == "uniform" ? SWBitmaps::Uniform : SWBitmaps::Gaussian, fAmount, uSeed);
+        return true;
+    }
+
+    if (command == "rnbw")
+    {
+        uint64_t uSeed = 0;
+        if (!expect(0, 1))
+            return false;
+        if (args.size() > 1 && !ParseNumber(args[1], uSeed))
+        {
+            m_Error = "invalid seed";
+            return false;
+        }
+
+        if (args.size() > 1 && Defer(args, std::format("rnbw {}", uSeed), stats))
+            return true;
+
+        if (args.size() > 1)
+            bitmap.MakeItRainbow(uSeed);
+        else
+            bitmap.MakeItRainbow();
+        return true;
+    }
+
+    if (command == "blur")
+    {
+        uint64_t uRadius = 0;
+        if (!expect(1, 1))
+            return false;
+        if (!ParseNumber(args[1], uRadius) || uRadius > UINT32_MAX)
+        {
+            m_Error = "invalid radius";
+            return false;
+        }
+
+        if (Defer(args, std::format("blur {}", uRadius), stats))
+            return true;
+
+        bitmap.BoxBlur(static_cast<uint32_t>(uRadius));
+        return true;
+    }
+
+    if (command == "edges")
+    {
+        SWBitmaps::EdgeOperator op = SWBitmaps::Sobel;
+        if (!expect(0, 1))
+            return false;
+
+        if (args.size() > 1)
+        {
+            const std::string names[] = { "sobel", "scharr" };
+            auto it = std::find(std::begin(names), std::end(names), args[1]);
+            if (it == std::end(names))
+            {
+                m_Error = "unknown edge operator " + args[1];
+                return false;
+            }
+            op = static_cast<SWBitmaps::EdgeOperator>(it - std::begin(names));
+        }
+
+        if (Defer(args, op == SWBitmaps::Scharr ? "edges scharr" : "edges sobel", stats))
+            return true;
+
+        bitmap.DetectEdges(op);
+        return true;
+    }
+
+    if (command == "otsu")
+    {
+        if (!expect(0, 0))
+            return false;
+
+        // Never deferred, the threshold line would be lost on a cache hit
+        report << std::format("{:<10} threshold {}\n", "", bitmap.ThresholdOtsu());
+        return true;
+    }
+
+    if (command == "adaptive")
+    {
+        uint64_t uRadius = 0;
+        int64_t iOffset = 0;
+        if (!expect(1, 2))
+            return false;
+        if (!ParseNumber(args[1], uRadius) || uRadius == 0 || uRadius > UINT32_MAX ||
+            (args.size() > 2 && (!ParseNumber(args[2], iOffset) || iOffset < -255 || iOffset > 255)))
+        {
+            m_Error = "invalid radius or offset";
+            return false;
+        }
+
+        if (Defer(args, std::format("adaptive {} {}", uRadius, iOffset), stats))
+            return true;
+
+        bitmap.ThresholdAdaptive(static_cast<uint32_t>(uRadius), static_cast<int32_t>(iOffset));
+        return true;
+    }
+
+    if (command == "median")
+    {
+        uint64_t uRadius = 0;
+        if (!expect(1, 1))
+            return false;
+        if (!ParseNumber(args[1], uRadius) || uRadius > MEDIAN_MAX_RADIUS)
+        {
+            m_Error = std::format("invalid radius, the median goes up to {}", MEDIAN_MAX_RADIUS);
+            return false;
+        }
+
+        if (Defer(args, std::format("median {}", uRadius), stats))
+            return true;
+
+        SWBitmaps::MedianFilter(bitmap, static_cast<uint32_t>(uRadius));
+        return true;
+    }
+
+    if (command == "morph")
+    {
+        uint64_t uRadiusX = 0, uRadiusY = 0;
+        if (!expect(2, 3))
+            return false;
+
+        const std::string names[] = { "erode", "dilate", "open", "close" };
+        auto it = std::find(std::begin(names), std::end(names), args[1]);
+        if (it == std::end(names))
+        {
+            m_Error = "unknown morphology " + args[1];
+            return false;
+        }
+
+        if (!ParseNumber(args[2], uRadiusX) || uRadiusX > UINT32_MAX ||
+            (args.size() > 3 && (!ParseNumber(args[3], uRadiusY) || uRadiusY > UINT32_MAX)))
+        {
+            m_Error = "invalid radius";
+            return false;
+        }
+
+        // Square unless told otherwise
+        if (args.size() < 4)
+            uRadiusY = uRadiusX;
+
+        if (Defer(args, std::format("morph {} {} {}", *it, uRadiusX, uRadiusY), stats))
+            return true;
+
+        SWBitmaps::Morphology(bitmap, 
+            static_cast<SWBitmaps::MorphOp>(it - std::begin(names)), 
+            static_cast<uint32_t>(uRadiusX), 
+            static_cast<uint32_t>(uRadiusY));
+        return true;
+    }
+
+    if (command == "overlay")
+    {
+        int64_t x = 0, y = 0;
+        float fOpacity = 1.f;
+        SWBitmaps::BlendMode mode = SWBitmaps::BlendNormal;
+        if (!expect(3, 5))
+            return false;
+        if (!ParseNumber(args[2], x) || !ParseNumber(args[3], y) ||
+            (args.size() > 4 && (!ParseNumber(args[4], fOpacity) || fOpacity < 0.f || fOpacity > 1.f)))
+        {
+            m_Error = "invalid overlay position or opacity";
+            return false;
+        }
+
+        if (args.size() > 5)
+        {
+            const std::string names[] = { "normal", "multiply", "screen", "add" };
+            auto it = std::find(std::begin(names), std::end(names), args[5]);
+            if (it == std::end(names))
+            {
+                m_Error = "unknown blend mode " + args[5];
+                return false;
+            }
+            mode = static_cast<SWBitmaps::BlendMode>(it - std::begin(names));
+        }
+
+        std::string name;
+        int fd = -1;
+        const bool bShared = ParseSharedTarget(args[1], name, fd);
+
+        if (m_bOpsOnly)
+        {
+            if (!bShared || !name.empty() || fd < 0 || (uint64_t)fd >= m_OpsDescriptors.size())
+            {
+                m_Error = "overlay here only takes fd:K of a descriptor sent along";
+                return false;
+            }
+
+            fd = m_OpsDescriptors[fd];
+        }
+
+        SWBitmaps::Bitmap overlay;
+        if (!bShared)
+            overlay.Initialize(ToWidePath(args[1]));
+        else if (!name.empty())
+            overlay.InitializeFromSharedMemory(name);
+        else if (fd >= 0)
+            overlay.InitializeFromFd(fd);
+
+        if (!SWBitmaps::Composite(bitmap, overlay, x, y, fOpacity, mode))
+        {
+            m_Error = "can't overlay " + args[1] + ", it needs a 24-bit image and a 24-bit or 32-bit BGR(A) overlay";
+            return false;
+        }
+
+        stats.Bytes += overlay.IsValid() ? overlay.GetHeader().FileSize : 0;
+        stats.Pixels = std::min(bitmap.GetWidth(), overlay.GetWidth()) * std::min(bitmap.GetHeight(), overlay.GetHeight());
+        return true;
+    }
+
+    if (command == "hash")
+    {
+        if (!expect(0, 0))
+            return false;
+
+        report << std::format("{:<10} aHash {:016x} dHash {:016x} pHash {:016x}\n", "",
+            bitmap.ComputeHash(SWBitmaps::AHash), 
+            bitmap.ComputeHash(SWBitmaps::DHash), 
+            bitmap.ComputeHash(SWBitmaps::PHash));
+        return true;
+    }
+
+    if (command == "negative" ||
+        command == "gray" ||
+        command == "luma" ||
+        command == "ds")
+    {
+        if (!expect(0, 0))
+            return false;
+
+        if (Defer(args, command, stats))
+            return true;
+
+        if (command == "negative")
+            bitmap.MakeItNegative();
+        else if (command == "gray")
+            bitmap.MakeItGrayScale();
+        else if (command == "luma")
+            bitmap.MakeItGrayScale(SWBitmaps::BT709);
+        else
+            bitmap.DeleteShadows();
+
+        return true;
+    }
+
+    m_Error = "unknown command " + command;
+    return false;
+}
+
+// -----------------------------------------------------------------------------
+bool ScriptRunner::Defer(IN const std::vector<std::string>& args, IN const std::string& canonical, IN CommandStats& stats)
+{
+    if (!m_pCache || m_bFlushing)
+        return false;
+
+    m_Pending.emplace_back(args, canonical);
+
+    // The work shows up in the command that flushes
+    stats.Bytes = 0;
+    stats.Pixels = 0;
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+bool ScriptRunner::Flush(IN std::ostream& report)
+{
+    if (m_Pending.empty())
+        return true;
+
+    std::string chain;
+    for (const auto& op : m_Pending)
+        chain += op.second + "\n";
+
+    const std::string key = SWBitmaps::ResultCache::MakeKey(*m_pBitmap, chain);
+    auto pCached = std::make_shared<SWBitmaps::Bitmap>();
+    const bool bHit = m_pCache->Lookup(key, *pCached);
+
+    if (bHit)
+    {
+        // A hit is a private copy, pixels of an inplace load go back into the
+        // mapped pages. Ops that changed the size would have left them anyway
+        if (!m_pBitmap->IsWritingThrough() || !m_pBitmap->CopyPixels(*pCached))
+            m_pBitmap = pCached;
+    }
+    else
+    {
+        bool bResult = true;
+        CommandStats stats = {};
+
+        m_bFlushing = true;
+        for (uint64_t i = 0; i < m_Pending.size() && bResult; i++)
+            bResult = Execute(m_Pending[i].first, stats, report);
+        m_bFlushing = false;
+
+        if (!bResult)
+        {
+            m_Pending.clear();
+            return false;
+        }
+
+        m_pCache->Store(key, *m_pBitmap);
+    }
+
+    report << std::format("{:<10} cache {} {} after {} ops\n", "", bHit ? "hit" : "miss", key, m_Pending.size());
+
+    m_Pending.clear();
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+bool ScriptRunner::IsDeterministic(IN const std::vector<std::string>& args)
+{
+    const std::string& command = args[0];
+
+    // Without a seed they take the time
+    if (command == "noise")
+        return args.size() > 3;
+    if (command == "rnbw")
+        return args.size() > 1;
+
+    return command == "scale" ||
+        command == "color" ||
+        command == "blur" ||
+        command == "edges" ||
+        command == "adaptive" ||
+        command == "morph" ||
+        command == "median" ||
+        command == "negative" ||
+        command == "gray" ||
+        command == "luma" ||
+        command == "ds";
+}
+
+// -----------------------------------------------------------------------------
+void ScriptRunner::PrintStats(IN const CommandStats& stats, IN std::ostream& report)
+{
+    const double fSeconds = stats.Milliseconds / 1000.0;
+    const double fMPixPerSecond = fSeconds > 0.0 ? (stats.Pixels / 1e6) / fSeconds : 0.0;
+
+    report << std::format("{:<10} {:>12.3f} {:>12.2f} {:>12.1f}\n", 
+        stats.Name, 
+        stats.Milliseconds, 
+        stats.Bytes / (1024.0 * 1024.0), 
+        fMPixPerSecond);
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "Bitmap.hpp"
+#include "ResultCache.hpp"
+#include "Composite.hpp"
+#include "Morphology.hpp"
+#include "Median.hpp"
+
+// What one command did, pixels are the ones the command produced or touched
+struct CommandStats
+{
+    std::string Name = "";
+    double Milliseconds = 0.0;
+    uint64_t Bytes = 0;
+    uint64_t Pixels = 0;
+};
+
+// Runs commands without prompts, every argument is on the command line:
+//   load PATH [inplace]            new WIDTH HEIGHT
+//   save PATH [native|gray8|pal8|pal4|mono1] [none|ordered|fs]
+//   scale WIDTH HEIGHT [nearest|bilinear|lanczos]
+//   color R G B                    blur RADIUS
+//   noise uniform|gaussian AMOUNT [SEED]
+//   rnbw [SEED]    negative    gray    luma    ds    hash
+//   edges [sobel|scharr]    otsu    adaptive RADIUS [OFFSET]
+//   morph erode|dilate|open|close RADIUS_X [RADIUS_Y]    median RADIUS
+//   overlay PATH X Y [OPACITY] [normal|multiply|screen|add]
+//   cache DIRECTORY [MB]|off
+//   atlas LIST OUTPUT [WIDTH] [PADDING]   LIST has a path per line,
+//                                         the index goes next to OUTPUT as .json
+// Paths with spaces go in double quotes, backslashes in them are plain characters.
+// '#' outside of quotes starts a comment.
+// Load, save and overlay also take "shm:NAME" for a POSIX shared memory segment
+// and "fd:N" for an open descriptor, the image is then mapped, not copied.
+// Ops change the source too only when it's loaded 'inplace'.
+// With a cache, ops that always give the same result wait until save or
+// hash needs the pixels or the script ends, and the whole chain since load 
+// is looked up first.
+class ScriptRunner
+{
+public:
+
+    ScriptRunner() = default;
+
+    ~ScriptRunner() = default;
+
+public:
+
+    // "-" reads the script from stdin
+    bool RunFile(IN const std::string& path, IN std::ostream& report);
+
+    // Stops at the first failing command, every command gets a line in 'report'
+    bool Run(IN std::istream& script, IN std::ostream& report);
+
+    // Empty and comment lines succeed without a report line
+    bool RunLine(IN const std::string& line, IN std::ostream& report);
+
+public:
+
+    // Getters -----------------------------------------------------------------
+
+    const std::string& GetError() const { return m_Error; }
+
+    // After RunLine, ops still queued for the cache aren't applied to it
+    std::shared_ptr<SWBitmaps::Bitmap> GetBitmap() const { return m_pBitmap; }
+
+    const CommandStats& GetTotal() const { return m_Total; }
+
+public:
+
+    // Setters -----------------------------------------------------------------
+
+    // Shared by runners on different threads, nullptr turns it off
+    void SetCache(IN std::shared_ptr<SWBitmaps::ResultCache> cache) { m_pCache = cache; }
+
+    // Refuses load, save, atlas and cache, and overlay only takes "fd:K" for the 
+    // K-th of 'descriptors'. Commands from someone else can then only change 
+    // the image, never open files, segments or descriptors of their choice
+    void SetOpsOnly(IN const bool& opsOnly, IN const std::vector<int>& descriptors = {}) 
+    { 
+        m_bOpsOnly = opsOnly; 
+        m_OpsDescriptors = descriptors;
+    }
+
+private:
+
+    bool Execute(IN const std::vector<std::string>& args, IN CommandStats& stats, IN std::ostream& report);
+
+    // Queues the op instead of running it when there's a cache, 'canonical' 
+    // is its text in the key, with parsed arguments and defaults filled in
+    bool Defer(IN const std::vector<std::string>& args, IN const std::string& canonical, IN CommandStats& stats);
+
+    // Runs the queued ops, or loads their result from the cache
+    bool Flush(IN std::ostream& report);
+
+    // Same arguments always give the same pixels
+    static bool IsDeterministic(IN const std::vector<std::string>& args);
+
+    static void PrintStats(IN const CommandStats& stats, IN std::ostream& report);
+
+private:
+
+    std::shared_ptr<SWBitmaps::Bitmap> m_pBitmap = std::shared_ptr<SWBitmaps::Bitmap>(nullptr);
+
+    std::string m_Error = "";
+
+    std::shared_ptr<SWBitmaps::ResultCache> m_pCache = nullptr;
+    std::vector<std::pair<std::vector<std::string>, std::string>> m_Pending;
+    bool m_bFlushing = false;
+    bool m_bOpsOnly = false;
+    std::vector<int> m_OpsDescriptors;
+
+    CommandStats m_Total = { "total" };
+
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+#ifdef SWB_SSSE3
+
+namespace SWBitmaps
+{
+    namespace Simd
+    {
+        // -----------------------------------------------------------------------------
+        // Splits 16 BGR pixels (48 bytes) into three planes
+        inline void LoadBgr16(IN const uint8_t* src, __m128i& b, __m128i& g, __m128i& r)
+        {
+            const __m128i a0 = _mm_loadu_si128((const __m128i*) (src));
+            const __m128i a1 = _mm_loadu_si128((const __m128i*) (src + 16));
+            const __m128i a2 = _mm_loadu_si128((const __m128i*) (src + 32));
+
+            b = _mm_or_si128(_mm_or_si128(
+                _mm_shuffle_epi8(a0, _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+                _mm_shuffle_epi8(a1, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1))),
+                _mm_shuffle_epi8(a2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13)));
+
+            g = _mm_or_si128(_mm_or_si128(
+                _mm_shuffle_epi8(a0, _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+                _mm_shuffle_epi8(a1, _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1))),
+                _mm_shuffle_epi8(a2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14)));
+
+            r = _mm_or_si128(_mm_or_si128(
+                _mm_shuffle_epi8(a0, _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+                _mm_shuffle_epi8(a1, _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1))),
+                _mm_shuffle_epi8(a2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15)));
+        }
+
+        // -----------------------------------------------------------------------------
+        // Splits 16 BGRA pixels (64 bytes) into four planes
+        inline void LoadBgra16(IN const uint8_t* src, __m128i& b, __m128i& g, __m128i& r, __m128i& a)
+        {
+            // Every load becomes [B B B B G G G G R R R R A A A A] of its 4 pixels
+            const __m128i gather = _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+
+            const __m128i t0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) (src)), gather);
+            const __m128i t1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) (src + 16)), gather);
+            const __m128i t2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) (src + 32)), gather);
+            const __m128i t3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) (src + 48)), gather);
+
+            // Then a 4x4 transpose of the 32-bit lanes
+            const __m128i u0 = _mm_unpacklo_epi32(t0, t1);
+            const __m128i u1 = _mm_unpackhi_epi32(t0, t1);
+            const __m128i u2 = _mm_unpacklo_epi32(t2, t3);
+            const __m128i u3 = _mm_unpackhi_epi32(t2, t3);
+
+            b = _mm_unpacklo_epi64(u0, u2);
+            g = _mm_unpackhi_epi64(u0, u2);
+            r = _mm_unpacklo_epi64(u1, u3);
+            a = _mm_unpackhi_epi64(u1, u3);
+        }
+
+        // -----------------------------------------------------------------------------
+        // Merges three planes back into 16 BGR pixels (48 bytes)
+        inline void StoreBgr16(IN uint8_t* dst, IN const __m128i& b, IN const __m128i& g, IN const __m128i& r)
+        {
+            const __m128i a0 = _mm_or_si128(_mm_or_si128(
+                _mm_shuffle_epi8(b, _mm_setr_epi8(0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1, 5)),
+                _mm_shuffle_epi8(g, _mm_setr_epi8(-1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1))),
+                _mm_shuffle_epi8(r, _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1)));
+
+            const __m128i a1 = _mm_or_si128(_mm_or_si128(
+                _mm_shuffle_epi8(b, _mm_setr_epi8(-1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10, -1)),
+                _mm_shuffle_epi8(g, _mm_setr_epi8(5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10))),
+                _mm_shuffle_epi8(r, _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1)));
+
+            const __m128i a2 = _mm_or_si128(_mm_or_si128(
+                _mm_shuffle_epi8(b, _mm_setr_epi8(-1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1)),
+                _mm_shuffle_epi8(g, _mm_setr_epi8(-1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1))),
+                _mm_shuffle_epi8(r, _mm_setr_epi8(10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15)));
+
+            _mm_storeu_si128((__m128i*) (dst), a0);
+            _mm_storeu_si128((__m128i*) (dst + 16), a1);
+            _mm_storeu_si128((__m128i*) (dst + 32), a2);
+        }
+    }
+}
+
+#endif // SWB_SSSE3
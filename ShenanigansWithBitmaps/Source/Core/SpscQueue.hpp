@@ -0,0 +1,61 @@
+#pragma once
+
+namespace SWBitmaps
+{
+    // -----------------------------------------------------------------------------
+    // Bounded lock-free ring for exactly one producer and one consumer thread.
+    // Capacity has to be a power of two, one slot is never used.
+    template<typename T, uint64_t Capacity>
+    class SpscQueue
+    {
+        static_assert((Capacity & (Capacity - 1)) == 0, "Capacity has to be a power of two");
+
+    public:
+
+        SpscQueue() = default;
+
+        ~SpscQueue() = default;
+
+    public:
+
+        // Producer only
+        bool TryPush(IN const T& value)
+        {
+            const uint64_t uTail = m_uTail.load(std::memory_order_relaxed);
+            const uint64_t uNext = (uTail + 1) & (Capacity - 1);
+
+            if (uNext == m_uHead.load(std::memory_order_acquire))
+                return false;
+
+            m_Buffer[uTail] = value;
+            m_uTail.store(uNext, std::memory_order_release);
+            return true;
+        }
+
+        // Consumer only
+        bool TryPop(IN T& value)
+        {
+            const uint64_t uHead = m_uHead.load(std::memory_order_relaxed);
+
+            if (uHead == m_uTail.load(std::memory_order_acquire))
+                return false;
+
+            value = m_Buffer[uHead];
+            m_uHead.store((uHead + 1) & (Capacity - 1), std::memory_order_release);
+            return true;
+        }
+
+        bool IsEmpty() const
+        {
+            return m_uHead.load(std::memory_order_acquire) == m_uTail.load(std::memory_order_acquire);
+        }
+
+    private:
+
+        // Each index on its own cache line, so the two threads don't fight over it
+        alignas(64) std::atomic<uint64_t> m_uHead = 0;
+        alignas(64) std::atomic<uint64_t> m_uTail = 0;
+        alignas(64) T m_Buffer[Capacity] = {};
+
+    };
+}
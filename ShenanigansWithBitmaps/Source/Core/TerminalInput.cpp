@@ -0,0 +1,244 @@
+#include "Pch.h"
+
+#include "TerminalInput.hpp"
+
+// Bytes of one escape sequence arrive together, a key typed after ESC doesn't
+#define TERMINAL_ESCAPE_TIMEOUT_MS 25
+
+#ifdef _WIN32
+
+// Win32ConsoleInput -----------------------------------------------------------
+
+class Win32ConsoleInput : public SWHexEditor::TerminalInput
+{
+public:
+
+    ~Win32ConsoleInput() override
+    {
+        Close();
+    }
+
+public:
+
+    bool Open() override
+    {
+        m_Console = GetStdHandle(STD_INPUT_HANDLE);
+        if (m_Console == NULL || m_Console == INVALID_HANDLE_VALUE)
+            return false;
+
+        m_WakeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+        if (m_WakeEvent == NULL)
+            return false;
+
+        GetConsoleMode(m_Console, &m_OriginalMode);
+        SetConsoleMode(m_Console, m_OriginalMode & ~(ENABLE_LINE_INPUT | ENABLE_ECHO_INPUT));
+
+        // The console doesn't have a separate screen buffer for VT, 
+        // but the alternate screen escape is understood by Windows Terminal
+        std::cout << "\x1b[?1049h" << std::flush;
+
+        return true;
+    }
+
+    void Close() override
+    {
+        if (m_WakeEvent == NULL)
+            return;
+
+        std::cout << "\x1b[?1049l" << std::flush;
+
+        SetConsoleMode(m_Console, m_OriginalMode);
+        FlushConsoleInputBuffer(m_Console);
+
+        CloseHandle(m_WakeEvent);
+        m_WakeEvent = NULL;
+    }
+
+    bool ReadKey(IN char& key) override
+    {
+        const HANDLE handles[2] = { m_Console, m_WakeEvent };
+
+        while (true)
+        {
+            const DWORD result = WaitForMultipleObjects(2, handles, FALSE, INFINITE);
+            if (result != WAIT_OBJECT_0)
+                return false;
+
+            DWORD numberOfEvents = 0;
+            INPUT_RECORD iRec;
+            if (!ReadConsoleInput(m_Console, &iRec, 1, &numberOfEvents) || 
+                numberOfEvents == 0)
+                return false;
+
+            if (iRec.EventType != KEY_EVENT || 
+                !((KEY_EVENT_RECORD&)iRec.Event).bKeyDown ||
+                ((KEY_EVENT_RECORD&)iRec.Event).uChar.AsciiChar == 0)
+                continue;
+
+            key = ((KEY_EVENT_RECORD&)iRec.Event).uChar.AsciiChar;
+            return true;
+        }
+    }
+
+    void Wake() override
+    {
+        if (m_WakeEvent != NULL)
+            SetEvent(m_WakeEvent);
+    }
+
+private:
+
+    HANDLE m_Console = NULL;
+    HANDLE m_WakeEvent = NULL;
+    DWORD m_OriginalMode = 0;
+
+};
+
+#else
+
+// PosixTerminalInput ----------------------------------------------------------
+
+class PosixTerminalInput : public SWHexEditor::TerminalInput
+{
+public:
+
+    ~PosixTerminalInput() override
+    {
+        Close();
+    }
+
+public:
+
+    bool Open() override
+    {
+        if (!isatty(STDIN_FILENO) ||
+            tcgetattr(STDIN_FILENO, &m_OriginalMode) != 0)
+            return false;
+
+        // Wake() writes to the pipe, poll() watches it next to stdin
+        if (pipe(m_WakePipe) != 0)
+            return false;
+        fcntl(m_WakePipe[0], F_SETFL, O_NONBLOCK);
+        fcntl(m_WakePipe[1], F_SETFL, O_NONBLOCK);
+
+        termios raw = m_OriginalMode;
+        raw.c_lflag &= ~(ICANON | ECHO);
+        raw.c_cc[VMIN] = 1;
+        raw.c_cc[VTIME] = 0;
+        tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw);
+
+        std::cout << "\x1b[?1049h" << std::flush;
+
+        return true;
+    }
+
+    void Close() override
+    {
+        if (m_WakePipe[0] < 0)
+            return;
+
+        std::cout << "\x1b[?1049l" << std::flush;
+
+        tcsetattr(STDIN_FILENO, TCSAFLUSH, &m_OriginalMode);
+
+        close(m_WakePipe[0]);
+        close(m_WakePipe[1]);
+        m_WakePipe[0] = m_WakePipe[1] = -1;
+    }
+
+    bool ReadKey(IN char& key) override
+    {
+        pollfd fds[2] = {
+            { STDIN_FILENO, POLLIN, 0 },
+            { m_WakePipe[0], POLLIN, 0 }
+        };
+
+        while (true)
+        {
+            if (poll(fds, 2, -1) < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+
+            if (fds[1].revents & POLLIN)
+            {
+                char drain[64];
+                while (read(m_WakePipe[0], drain, sizeof(drain)) > 0) { }
+                return false;
+            }
+
+            if (!(fds[0].revents & (POLLIN | POLLHUP)))
+                continue;
+
+            if (read(STDIN_FILENO, &key, 1) != 1)
+                return false;
+
+            if (key != 0x1b || !ReadSequence(key))
+                return true;
+        }
+    }
+
+    void Wake() override
+    {
+        if (m_WakePipe[1] < 0)
+            return;
+
+        const char c = 0;
+        [[maybe_unused]] const auto written = write(m_WakePipe[1], &c, 1);
+    }
+
+private:
+
+    // Arrow and function keys send ESC and more bytes right after it, a lone
+    // ESC is one without a byte within the timeout. True when a sequence was 
+    // swallowed, otherwise 'key' is ESC, or the key pressed with Alt
+    bool ReadSequence(IN char& key)
+    {
+        char next = 0;
+        if (!ReadPending(next))
+            return false;
+
+        // SS3 has one final byte, CSI parameters until one in '@'..'~'
+        if (next == 'O')
+        {
+            ReadPending(next);
+            return true;
+        }
+
+        if (next == '[')
+        {
+            while (ReadPending(next) && (next < '@' || next > '~')) { }
+            return true;
+        }
+
+        key = next;
+        return false;
+    }
+
+    bool ReadPending(IN char& byte)
+    {
+        pollfd fd = { STDIN_FILENO, POLLIN, 0 };
+        return poll(&fd, 1, TERMINAL_ESCAPE_TIMEOUT_MS) > 0 && 
+            read(STDIN_FILENO, &byte, 1) == 1;
+    }
+
+private:
+
+    termios m_OriginalMode = {};
+    int m_WakePipe[2] = { -1, -1 };
+
+};
+
+#endif // _WIN32
+
+// -----------------------------------------------------------------------------
+std::unique_ptr<SWHexEditor::TerminalInput> SWHexEditor::TerminalInput::Create()
+{
+#ifdef _WIN32
+    return std::make_unique<Win32ConsoleInput>();
+#else
+    return std::make_unique<PosixTerminalInput>();
+#endif // _WIN32
+}
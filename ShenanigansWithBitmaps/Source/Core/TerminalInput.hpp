@@ -0,0 +1,34 @@
+#pragma once
+
+namespace SWHexEditor
+{
+    // Raw keyboard input of the terminal the session runs in
+    class TerminalInput
+    {
+    public:
+
+        virtual ~TerminalInput() = default;
+
+    public:
+
+        // Switches the terminal to raw input and the alternate screen
+        virtual bool Open() = 0;
+
+        // Restores the terminal as it was before Open()
+        virtual void Close() = 0;
+
+        // Blocks until a key is pressed or Wake() is called, 
+        // false means that there was no key. Arrow and function keys 
+        // are skipped, ESC only comes when it was pressed on its own
+        virtual bool ReadKey(IN char& key) = 0;
+
+        // Safe to call from any thread, makes the current ReadKey() return
+        virtual void Wake() = 0;
+
+    public:
+
+        // Backend of the platform the application was built for
+        static std::unique_ptr<TerminalInput> Create();
+
+    };
+}
@@ -0,0 +1,240 @@
+#include "Pch.h"
+
+#include "TerminalRenderer.hpp"
+#include "Pyramid.hpp"
+#include "IntegralImage.hpp"
+#include "Parallel.hpp"
+
+// Decimal text of every byte value, escapes are built without formatting
+struct ByteText
+{
+    char Text[256][4] = {};
+    uint8_t Size[256] = {};
+
+    ByteText()
+    {
+        for (uint16_t v = 0; v < 256; v++)
+        {
+            const std::string s = std::to_string(v);
+            memcpy(Text[v], s.data(), s.size());
+            Size[v] = static_cast<uint8_t>(s.size());
+        }
+    }
+
+    void Append(IN std::string& out, IN const uint8_t& v) const
+    {
+        out.append(Text[v], Size[v]);
+    }
+};
+
+static const ByteText s_ByteText;
+
+// -----------------------------------------------------------------------------
+std::string SWHexEditor::TerminalRenderer::Render(IN const SWBitmaps::Bitmap& target, 
+    IN const uint32_t& columns, 
+    IN const RenderMode& mode, 
+    IN const bool& clamp)
+{
+    if (!target.IsValid() ||
+        target.GetHeader().ColorDepth != 24 ||
+        target.GetWidth() == 0 ||
+        columns == 0)
+        return std::string();
+
+    // Terminal cells are about twice as tall as wide, ascii uses two characters 
+    // per pixel and true color two pixels per cell, so rows keep the aspect ratio
+    uint32_t uRows = static_cast<uint32_t>(std::max<uint64_t>(1, ((uint64_t)columns * target.GetHeight()) / target.GetWidth()));
+    if (mode == TrueColor)
+        uRows += uRows & 1;
+
+    const std::vector<uint8_t> pixels = Sample(target, columns, uRows);
+    std::string frame;
+
+    if (mode == Ascii)
+    {
+        const std::string colors = " .:-=o%@$";
+        const uint8_t uIndexSizeOfColors = static_cast<uint8_t>(colors.size() - 1);
+
+        std::vector<uint8_t> gray(pixels.size() / 3);
+        for (uint64_t i = 0; i < gray.size(); i++)
+            gray[i] = static_cast<uint8_t>(((uint32_t)pixels[(i * 3) + 0] + pixels[(i * 3) + 1] + pixels[(i * 3) + 2]) / 3);
+
+        uint8_t uMin = 0, uMax = 255;
+        if (clamp)
+        {
+            uMin = *std::min_element(gray.begin(), gray.end());
+            uMax = *std::max_element(gray.begin(), gray.end());
+        }
+
+        // Every gray value maps to a character once
+        char ramp[256];
+        for (uint16_t v = 0; v < 256; v++)
+        {
+            const uint16_t uClamped = std::clamp<uint16_t>(v, uMin, uMax);
+            ramp[v] = uMax == uMin ? colors[0] : colors[((uClamped - uMin) * uIndexSizeOfColors) / (uMax - uMin)];
+        }
+
+        frame.reserve(((uint64_t)columns * 2 + 1) * uRows);
+        for (uint32_t y = 0; y < uRows; y++)
+        {
+            for (uint32_t x = 0; x < columns; x++)
+            {
+                frame.push_back(ramp[gray[((uint64_t)y * columns) + x]]);
+                frame.push_back(' ');
+            }
+            frame.push_back('\n');
+        }
+
+        return frame;
+    }
+
+    // Worst case is both colors changing in every cell
+    frame.reserve(((uint64_t)columns * 41 + 5) * (uRows / 2));
+
+    for (uint32_t y = 0; y < uRows; y += 2)
+    {
+        const uint8_t* upper = pixels.data() + ((uint64_t)y * columns * 3);
+        AppendHalfBlockRow(frame, upper, upper + ((uint64_t)columns * 3), columns);
+        frame.push_back('\n');
+    }
+
+    return frame;
+}
+
+// -----------------------------------------------------------------------------
+void SWHexEditor::TerminalRenderer::AppendHalfBlockRow(IN std::string& out, 
+    IN const uint8_t* upper, 
+    IN const uint8_t* lower, 
+    IN const uint32_t& columns)
+{
+    // Escapes are only emitted when the color changes
+    int32_t lastUpper = -1, lastLower = -1;
+
+    for (uint32_t x = 0; x < columns; x++)
+    {
+        const uint8_t* u = upper + (x * 3);
+        const uint8_t* l = lower + (x * 3);
+        const int32_t upperColor = (u[2] << 16) | (u[1] << 8) | u[0];
+        const int32_t lowerColor = (l[2] << 16) | (l[1] << 8) | l[0];
+
+        if (upperColor != lastUpper)
+        {
+            out += "\x1b[38;2;";
+            s_ByteText.Append(out, u[2]);
+            out.push_back(';');
+            s_ByteText.Append(out, u[1]);
+            out.push_back(';');
+            s_ByteText.Append(out, u[0]);
+            out.push_back('m');
+            lastUpper = upperColor;
+        }
+        if (lowerColor != lastLower)
+        {
+            out += "\x1b[48;2;";
+            s_ByteText.Append(out, l[2]);
+            out.push_back(';');
+            s_ByteText.Append(out, l[1]);
+            out.push_back(';');
+            s_ByteText.Append(out, l[0]);
+            out.push_back('m');
+            lastLower = lowerColor;
+        }
+
+        // U+2580 upper half block
+        out += "\xE2\x96\x80";
+    }
+
+    out += "\x1b[0m";
+}
+
+// -----------------------------------------------------------------------------
+void SWHexEditor::TerminalRenderer::Present(IN const std::string& frame)
+{
+    std::cout.flush();
+
+#ifdef _WIN32
+    DWORD written = 0;
+    WriteFile(GetStdHandle(STD_OUTPUT_HANDLE), frame.data(), static_cast<DWORD>(frame.size()), &written, NULL);
+
+    return;
+#endif // _WIN32
+
+    std::wcout.flush();
+
+    // stdout can already be wide oriented, so the descriptor is written directly
+    for (uint64_t i = 0; i < frame.size(); )
+    {
+        const ssize_t written = write(STDOUT_FILENO, frame.data() + i, frame.size() - i);
+        if (written <= 0)
+            return;
+        i += written;
+    }
+}
+
+// -----------------------------------------------------------------------------
+bool SWHexEditor::TerminalRenderer::EnableVirtualTerminal()
+{
+#ifdef _WIN32
+    HANDLE hOut = GetStdHandle(STD_OUTPUT_HANDLE);
+    DWORD mode = 0;
+
+    if (!GetConsoleMode(hOut, &mode))
+        return false;
+
+    SetConsoleOutputCP(CP_UTF8);
+    return SetConsoleMode(hOut, mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
+#endif // _WIN32
+
+    return true;
+}
+
+// Private ---------------------------------------------------------------------
+
+// -----------------------------------------------------------------------------
+std::vector<uint8_t> SWHexEditor::TerminalRenderer::Sample(IN const SWBitmaps::Bitmap& target, 
+    IN const uint32_t& columns, 
+    IN const uint32_t& rows)
+{
+    // Held until the end, the pyramid may drop the level meanwhile
+    const std::shared_ptr<const SWBitmaps::Bitmap> pSource = target.GetPyramid().NearestLevel(columns, rows);
+    const SWBitmaps::Bitmap& source = *pSource;
+    const std::shared_ptr<const SWBitmaps::IntegralImage> pSat = source.GetIntegralImage();
+    const SWBitmaps::IntegralImage& sat = *pSat;
+
+    const uint64_t uSourceWidth = source.GetWidth();
+    const uint64_t uSourceHeight = source.GetHeight();
+    const bool bBottomUp = source.GetHeader().Height > 0;
+
+    // Every cell covers at least one source pixel
+    auto span = [](uint64_t cell, uint64_t cells, uint64_t size) {
+        const uint64_t first = (cell * size) / cells;
+        const uint64_t last = std::max(first + 1, ((cell + 1) * size) / cells);
+        return std::make_pair(first, std::min(last, size));
+    };
+
+    std::vector<uint8_t> pixels((uint64_t)columns * rows * 3);
+
+    SWBitmaps::ParallelFor(0, rows, [&](uint64_t first, uint64_t last) {
+        for (uint64_t y = first; y < last; y++)
+        {
+            const auto r = span(y, rows, uSourceHeight);
+            // Terminal goes top to bottom
+            const uint64_t uFileRow = bBottomUp ? uSourceHeight - r.second : r.first;
+            const uint64_t uHeight = r.second - r.first;
+
+            for (uint64_t x = 0; x < columns; x++)
+            {
+                const auto c = span(x, columns, uSourceWidth);
+                const uint64_t uWidth = c.second - c.first;
+                const uint64_t uArea = uWidth * uHeight;
+                uint8_t* dst = pixels.data() + (((y * columns) + x) * 3);
+
+                // BGR, the same as in the file
+                for (uint8_t ch = 0; ch < 3; ch++)
+                    dst[ch] = static_cast<uint8_t>((sat.Sum(2 - ch, c.first, uFileRow, uWidth, uHeight) + (uArea / 2)) / uArea);
+            }
+        }
+        }, 8);
+
+    return pixels;
+}
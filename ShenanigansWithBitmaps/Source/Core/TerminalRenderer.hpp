@@ -0,0 +1,48 @@
+#pragma once
+
+#include "Bitmap.hpp"
+
+namespace SWHexEditor
+{
+    enum RenderMode
+    {
+        // Gray ramp, two characters per pixel
+        Ascii,
+        // 24-bit ANSI colors, upper half block with 
+        // the foreground and background as two pixels
+        TrueColor
+    };
+
+    // Builds a whole frame into one buffer, so it goes out in a single write
+    class TerminalRenderer
+    {
+    public:
+
+        // Every cell is the area average of the pixels it covers,
+        // taken from the nearest pyramid level through its integral image
+        static std::string Render(IN const SWBitmaps::Bitmap& target, 
+            IN const uint32_t& columns, 
+            IN const RenderMode& mode, 
+            IN const bool& clamp);
+
+        // Two rows of 'columns' BGR pixels as one line of half blocks, 
+        // without the line break, colors are reset at the end
+        static void AppendHalfBlockRow(IN std::string& out, 
+            IN const uint8_t* upper, 
+            IN const uint8_t* lower, 
+            IN const uint32_t& columns);
+
+        static void Present(IN const std::string& frame);
+
+        // ANSI escapes and UTF-8 output on Windows consoles
+        static bool EnableVirtualTerminal();
+
+    private:
+
+        // Top row first, 'rows' x 'columns' pixels of BGR
+        static std::vector<uint8_t> Sample(IN const SWBitmaps::Bitmap& target, 
+            IN const uint32_t& columns, 
+            IN const uint32_t& rows);
+
+    };
+}
@@ -0,0 +1,236 @@
+#include "Pch.h"
+
+#include "ToneLut.hpp"
+
+using namespace SWBitmaps;
+
+// -----------------------------------------------------------------------------
+static uint8_t ClampToByte(IN const float& v)
+{
+    return static_cast<uint8_t>(std::clamp(v + 0.5f, 0.f, 255.f));
+}
+
+// ToneLut ---------------------------------------------------------------------
+
+// -----------------------------------------------------------------------------
+ToneLut::ToneLut()
+{
+    for (uint16_t v = 0; v < 256; v++)
+    {
+        m_Table[0][v] = static_cast<uint8_t>(v);
+        m_Table[1][v] = static_cast<uint8_t>(v);
+        m_Table[2][v] = static_cast<uint8_t>(v);
+    }
+}
+
+// -----------------------------------------------------------------------------
+template<typename Fn>
+ToneLut ToneLut::FromFunction(IN Fn&& fn)
+{
+    ToneLut result;
+
+    for (uint16_t v = 0; v < 256; v++)
+    {
+        const uint8_t mapped = fn(static_cast<uint8_t>(v));
+
+        result.m_Table[0][v] = mapped;
+        result.m_Table[1][v] = mapped;
+        result.m_Table[2][v] = mapped;
+    }
+
+    return result;
+}
+
+// Tone operations -------------------------------------------------------------
+
+// -----------------------------------------------------------------------------
+ToneLut ToneLut::Negative()
+{
+    return FromFunction([](uint8_t v) -> uint8_t {
+        return 255 - v;
+        });
+}
+
+// -----------------------------------------------------------------------------
+ToneLut ToneLut::Brightness(IN const int16_t& delta)
+{
+    return FromFunction([delta](uint8_t v) -> uint8_t {
+        return static_cast<uint8_t>(std::clamp(v + delta, 0, 255));
+        });
+}
+
+// -----------------------------------------------------------------------------
+ToneLut ToneLut::Contrast(IN const float& factor)
+{
+    return FromFunction([factor](uint8_t v) -> uint8_t {
+        return ClampToByte(((v - 127.5f) * factor) + 127.5f);
+        });
+}
+
+// -----------------------------------------------------------------------------
+ToneLut ToneLut::Gamma(IN const float& gamma)
+{
+    if (gamma <= 0.f)
+        throw;
+
+    return FromFunction([gamma](uint8_t v) -> uint8_t {
+        return ClampToByte(std::pow(v / 255.f, 1.f / gamma) * 255.f);
+        });
+}
+
+// -----------------------------------------------------------------------------
+ToneLut ToneLut::Threshold(IN const uint8_t& level)
+{
+    return FromFunction([level](uint8_t v) -> uint8_t {
+        return v >= level ? 255 : 0;
+        });
+}
+
+// -----------------------------------------------------------------------------
+ToneLut ToneLut::Posterize(IN const uint8_t& levels)
+{
+    if (levels < 2)
+        throw;
+
+    const float fStep = 255.f / (levels - 1);
+
+    return FromFunction([levels, fStep](uint8_t v) -> uint8_t {
+        const uint32_t bucket = (static_cast<uint32_t>(v) * levels) / 256;
+        return ClampToByte(bucket * fStep);
+        });
+}
+
+// -----------------------------------------------------------------------------
+ToneLut ToneLut::Levels(IN const uint8_t& inBlack,
+    IN const uint8_t& inWhite,
+    IN const float& gamma,
+    IN const uint8_t& outBlack,
+    IN const uint8_t& outWhite)
+{
+    if (inWhite <= inBlack || gamma <= 0.f)
+        throw;
+
+    return FromFunction([=](uint8_t v) -> uint8_t {
+        const float fNormalized = std::clamp((v - inBlack) / static_cast<float>(inWhite - inBlack), 0.f, 1.f);
+        return ClampToByte(outBlack + (std::pow(fNormalized, 1.f / gamma) * (outWhite - outBlack)));
+        });
+}
+
+// -----------------------------------------------------------------------------
+ToneLut ToneLut::ForChannel(IN const uint8_t& channel, IN const ToneLut& lut)
+{
+    if (channel > 2)
+        throw;
+
+    ToneLut result;
+    std::copy(std::begin(lut.m_Table[channel]), 
+        std::end(lut.m_Table[channel]), 
+        std::begin(result.m_Table[channel]));
+
+    return result;
+}
+
+// -----------------------------------------------------------------------------
+ToneLut& ToneLut::Then(IN const ToneLut& next)
+{
+    for (uint8_t c = 0; c < 3; c++)
+    {
+        for (uint16_t v = 0; v < 256; v++)
+            m_Table[c][v] = next.m_Table[c][m_Table[c][v]];
+    }
+
+    return *this;
+}
+
+// -----------------------------------------------------------------------------
+void ToneLut::ApplyRow(IN uint8_t* row, IN const uint64_t& width) const
+{
+    if (IsUniform())
+    {
+        ApplyUniform(row, width * 3);
+        return;
+    }
+
+    // Pixels are stored as BGR
+    const uint8_t* blue = m_Table[2];
+    const uint8_t* green = m_Table[1];
+    const uint8_t* red = m_Table[0];
+
+    for (uint64_t k = 0; k < width; k++, row += 3)
+    {
+        row[0] = blue[row[0]];
+        row[1] = green[row[1]];
+        row[2] = red[row[2]];
+    }
+}
+
+// -----------------------------------------------------------------------------
+bool ToneLut::IsUniform() const
+{
+    return std::equal(std::begin(m_Table[0]), std::end(m_Table[0]), std::begin(m_Table[1])) &&
+        std::equal(std::begin(m_Table[0]), std::end(m_Table[0]), std::begin(m_Table[2]));
+}
+
+// Private ---------------------------------------------------------------------
+
+// -----------------------------------------------------------------------------
+void ToneLut::ApplyUniform(IN uint8_t* bytes, IN const uint64_t& size) const
+{
+    const uint8_t* table = m_Table[0];
+    uint64_t i = 0;
+
+#if defined(SWB_SSSE3)
+    // Nibble lookup, the table is split into 16 slices of 16 entries.
+    // For slice h the bytes are shifted down by 16 * h and saturated with 0x70,
+    // so only bytes from this slice keep the top bit clear and pshufb 
+    // returns zero for the rest.
+#if defined(SWB_AVX2)
+    __m256i slices[16];
+    for (uint8_t h = 0; h < 16; h++)
+        slices[h] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) &table[h * 16]));
+
+    const __m256i sixteen = _mm256_set1_epi8(16);
+    const __m256i saturate = _mm256_set1_epi8(0x70);
+
+    for (; i + 32 <= size; i += 32)
+    {
+        __m256i x = _mm256_loadu_si256((const __m256i*) &bytes[i]);
+        __m256i result = _mm256_shuffle_epi8(slices[0], _mm256_adds_epu8(x, saturate));
+
+        for (uint8_t h = 1; h < 16; h++)
+        {
+            x = _mm256_sub_epi8(x, sixteen);
+            result = _mm256_or_si256(result, 
+                _mm256_shuffle_epi8(slices[h], _mm256_adds_epu8(x, saturate)));
+        }
+
+        _mm256_storeu_si256((__m256i*) &bytes[i], result);
+    }
+#endif // SWB_AVX2
+
+    __m128i slices128[16];
+    for (uint8_t h = 0; h < 16; h++)
+        slices128[h] = _mm_loadu_si128((const __m128i*) &table[h * 16]);
+
+    const __m128i sixteen128 = _mm_set1_epi8(16);
+    const __m128i saturate128 = _mm_set1_epi8(0x70);
+
+    for (; i + 16 <= size; i += 16)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i*) &bytes[i]);
+        __m128i result = _mm_shuffle_epi8(slices128[0], _mm_adds_epu8(x, saturate128));
+
+        for (uint8_t h = 1; h < 16; h++)
+        {
+            x = _mm_sub_epi8(x, sixteen128);
+            result = _mm_or_si128(result, 
+                _mm_shuffle_epi8(slices128[h], _mm_adds_epu8(x, saturate128)));
+        }
+
+        _mm_storeu_si128((__m128i*) &bytes[i], result);
+    }
+#endif // SWB_SSSE3
+
+    for (; i < size; i++)
+        bytes[i] = table[bytes[i]];
+}
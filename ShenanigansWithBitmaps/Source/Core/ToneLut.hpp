@@ -0,0 +1,72 @@
+#pragma once
+
+namespace SWBitmaps
+{
+    // Per channel 8-bit -> 8-bit map. Any chain of tone operations
+    // is composed into a single table and applied in one pass.
+    // Channels are indexed the same way as in Color, 0 - Red, 1 - Green, 2 - Blue.
+    class ToneLut
+    {
+    public:
+
+        ToneLut();
+
+        ~ToneLut() = default;
+
+    public:
+
+        // Tone operations -----------------------------------------------------
+
+        static ToneLut Identity() { return ToneLut(); }
+
+        static ToneLut Negative();
+
+        static ToneLut Brightness(IN const int16_t& delta);
+
+        // Factor of 1.0 leaves the image unchanged, pivot is the middle gray
+        static ToneLut Contrast(IN const float& factor);
+
+        static ToneLut Gamma(IN const float& gamma);
+
+        static ToneLut Threshold(IN const uint8_t& level);
+
+        static ToneLut Posterize(IN const uint8_t& levels);
+
+        static ToneLut Levels(IN const uint8_t& inBlack,
+            IN const uint8_t& inWhite,
+            IN const float& gamma,
+            IN const uint8_t& outBlack,
+            IN const uint8_t& outWhite);
+
+        // Uses 'lut' for a single channel and identity for the rest
+        static ToneLut ForChannel(IN const uint8_t& channel, IN const ToneLut& lut);
+
+    public:
+
+        // Composes 'next' after this table, so the result is next(this(v))
+        ToneLut& Then(IN const ToneLut& next);
+
+        // Applies the table to 'width' BGR pixels
+        void ApplyRow(IN uint8_t* row, IN const uint64_t& width) const;
+
+    public:
+
+        // Getters -------------------------------------------------------------
+
+        bool IsUniform() const;
+
+        const uint8_t& At(IN const uint8_t& channel, IN const uint8_t& value) const { return m_Table[channel][value]; }
+
+    private:
+
+        template<typename Fn>
+        static ToneLut FromFunction(IN Fn&& fn);
+
+        void ApplyUniform(IN uint8_t* bytes, IN const uint64_t& size) const;
+
+    private:
+
+        uint8_t m_Table[3][256];
+
+    };
+}
@@ -0,0 +1,90 @@
+#include "Pch.h"
+
+#include "WorkerPool.hpp"
+#include "Parallel.hpp"
+
+// -----------------------------------------------------------------------------
+SWBitmaps::WorkerPool::WorkerPool(IN const uint32_t& threads, IN const uint64_t& capacity) :
+    m_uCapacity(std::max<uint64_t>(1, capacity))
+{
+    const uint32_t uThreads = std::max<uint32_t>(1, threads);
+
+    m_Workers.reserve(uThreads);
+    for (uint32_t i = 0; i < uThreads; i++)
+        m_Workers.emplace_back(&SWBitmaps::WorkerPool::WorkerLoop, this);
+}
+
+// -----------------------------------------------------------------------------
+bool SWBitmaps::WorkerPool::Submit(IN std::function<void()> task)
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+
+    m_NotFull.wait(lock, [this]() { return m_bStopping || m_Tasks.size() < m_uCapacity; });
+    if (m_bStopping)
+        return false;
+
+    m_Tasks.push_back(std::move(task));
+    m_uPeakQueueDepth = std::max<uint64_t>(m_uPeakQueueDepth, m_Tasks.size());
+    m_NotEmpty.notify_one();
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+void SWBitmaps::WorkerPool::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_bStopping = true;
+    }
+
+    m_NotEmpty.notify_all();
+    m_NotFull.notify_all();
+
+    for (auto& w : m_Workers)
+        if (w.joinable())
+            w.join();
+}
+
+// -----------------------------------------------------------------------------
+uint64_t SWBitmaps::WorkerPool::GetQueueDepth() const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    return m_Tasks.size();
+}
+
+// -----------------------------------------------------------------------------
+uint64_t SWBitmaps::WorkerPool::GetPeakQueueDepth() const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    return m_uPeakQueueDepth;
+}
+
+// Private ---------------------------------------------------------------------
+
+// -----------------------------------------------------------------------------
+void SWBitmaps::WorkerPool::WorkerLoop()
+{
+    t_bSerialParallelFor = true;
+
+    while (true)
+    {
+        std::function<void()> task;
+
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+
+            m_NotEmpty.wait(lock, [this]() { return m_bStopping || !m_Tasks.empty(); });
+            if (m_Tasks.empty())
+                return;
+
+            task = std::move(m_Tasks.front());
+            m_Tasks.pop_front();
+        }
+
+        m_NotFull.notify_one();
+        task();
+    }
+}
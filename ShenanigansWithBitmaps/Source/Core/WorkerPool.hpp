@@ -0,0 +1,56 @@
+#pragma once
+
+namespace SWBitmaps
+{
+    // Fixed number of threads over a bounded queue. Every worker runs one 
+    // task at a time and ParallelFor stays on the calling worker, 
+    // so the pool never has more threads busy than it was created with.
+    class WorkerPool
+    {
+    public:
+
+        WorkerPool(IN const uint32_t& threads, IN const uint64_t& capacity);
+
+        ~WorkerPool()
+        {
+            Stop();
+        }
+
+    public:
+
+        // Blocks while the queue is full, false once the pool is stopping
+        bool Submit(IN std::function<void()> task);
+
+        // Finishes every queued task, then joins the workers
+        void Stop();
+
+    public:
+
+        // Getters -------------------------------------------------------------
+
+        // Tasks waiting for a worker
+        uint64_t GetQueueDepth() const;
+
+        uint64_t GetPeakQueueDepth() const;
+
+        uint32_t GetThreadCount() const { return static_cast<uint32_t>(m_Workers.size()); }
+
+    private:
+
+        void WorkerLoop();
+
+    private:
+
+        std::vector<std::thread> m_Workers;
+        std::deque<std::function<void()>> m_Tasks;
+
+        mutable std::mutex m_Mutex;
+        std::condition_variable m_NotEmpty;
+        std::condition_variable m_NotFull;
+
+        const uint64_t m_uCapacity;
+        uint64_t m_uPeakQueueDepth = 0;
+        bool m_bStopping = false;
+
+    };
+}
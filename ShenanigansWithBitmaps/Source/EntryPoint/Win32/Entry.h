@@ -1,9 +1,111 @@
 #pragma once
 
 #include "Core/Application.hpp"
+#include "Core/ScriptRunner.hpp"
+#include "Core/ImageServer.hpp"
 
-int main()
+#define SERVE_MAX_WORKERS 1024
+#define SERVE_MAX_QUEUE (1024 * 1024)
+// Megabytes, the byte counts stay far from overflowing
+#define SERVE_MAX_MEGABYTES (1024 * 1024)
+
+#define SERVE_USAGE "usage: --serve SOCKET [WORKERS] [QUEUE] [POOL_MB] [CACHE_DIR] [CACHE_MB]"
+
+// -----------------------------------------------------------------------------
+// Digits only like numbers in scripts, no sign, nothing after them
+static bool ParseArgument(IN const char* text, IN const uint64_t& min, IN const uint64_t& max, IN uint64_t& value)
+{
+    if (!std::isdigit(static_cast<unsigned char>(text[0])))
+        return false;
+
+    char* end = nullptr;
+    errno = 0;
+    value = std::strtoull(text, &end, 10);
+
+    return *end == '\0' && errno == 0 && value >= min && value <= max;
+}
+
+int main(int argc, char** argv)
 {
+    // '--script FILE' or '--script -' for stdin, runs without any prompts
+    if (argc == 3 && std::string(argv[1]) == "--script")
+    {
+        auto runner = ScriptRunner();
+
+        if (!runner.RunFile(argv[2], std::cout))
+        {
+            std::cerr << runner.GetError() << std::endl;
+            return 1;
+        }
+
+        return 0;
+    }
+
+    // '--serve SOCKET [WORKERS] [QUEUE] [POOL_MB] [CACHE_DIR] [CACHE_MB]' runs jobs until a shutdown request
+    if (argc >= 3 && argc <= 8 && std::string(argv[1]) == "--serve")
+    {
+        uint64_t uWorkers = std::clamp<uint64_t>(std::thread::hardware_concurrency(), 1, SERVE_MAX_WORKERS);
+        uint64_t uQueue = 0;
+        uint64_t uPoolMegabytes = 512;
+
+        if ((argc > 3 && !ParseArgument(argv[3], 1, SERVE_MAX_WORKERS, uWorkers)) ||
+            (argc > 4 && !ParseArgument(argv[4], 1, SERVE_MAX_QUEUE, uQueue)) ||
+            (argc > 5 && !ParseArgument(argv[5], 0, SERVE_MAX_MEGABYTES, uPoolMegabytes)))
+        {
+            std::cerr << SERVE_USAGE << "\n"
+                << "WORKERS 1 to " << SERVE_MAX_WORKERS << ", QUEUE 1 to " << SERVE_MAX_QUEUE
+                << ", sizes up to " << SERVE_MAX_MEGABYTES << " MB" << std::endl;
+            return 1;
+        }
+
+        if (argc <= 4)
+            uQueue = uWorkers * 4;
+        const uint64_t uPoolBytes = uPoolMegabytes * 1024 * 1024;
+
+        // The cache is checked first, a failed start leaves no socket behind
+        std::shared_ptr<SWBitmaps::ResultCache> cache = nullptr;
+        if (argc > 6)
+        {
+            uint64_t uCacheMegabytes = 1024;
+            if (argc > 7 && !ParseArgument(argv[7], 0, SERVE_MAX_MEGABYTES, uCacheMegabytes))
+            {
+                std::cerr << SERVE_USAGE << "\n"
+                    << "CACHE_MB up to " << SERVE_MAX_MEGABYTES << std::endl;
+                return 1;
+            }
+
+            cache = std::make_shared<SWBitmaps::ResultCache>(argv[6], uCacheMegabytes * 1024 * 1024);
+            if (!cache->IsValid())
+            {
+                std::cerr << "can't use " << argv[6] << " as a cache, it has to be empty or an earlier cache" << std::endl;
+                return 1;
+            }
+        }
+
+        auto server = ImageServer();
+        if (!server.Start(argv[2], static_cast<uint32_t>(uWorkers), uQueue, uPoolBytes))
+        {
+            std::cerr << server.GetError() << std::endl;
+            return 1;
+        }
+
+        server.SetCache(cache);
+        server.Run();
+        return 0;
+    }
+
+    // '--client SOCKET' sends the job lines from stdin
+    if (argc == 3 && std::string(argv[1]) == "--client")
+    {
+        if (!ImageServer::RunClient(argv[2], std::cin, std::cout))
+        {
+            std::cerr << "can't connect to " << argv[2] << std::endl;
+            return 1;
+        }
+
+        return 0;
+    }
+
     auto app = Application();
     
     app.Initialize();
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <iostream>
+#include <cstring>
 #include <string>
 #include <algorithm>
 #include <vector>
@@ -10,9 +11,52 @@
 #include <iomanip>
 #include <sstream>
 #include <format>
+#include <functional>
+#include <mutex>
+#include <limits>
+#include <numeric>
+#include <bit>
+#include <memory>
+#include <cmath>
+#include <filesystem>
+#include <chrono>
+#include <deque>
+#include <list>
+#include <unordered_map>
+#include <condition_variable>
+
+#if defined(_M_X64) || defined(_M_AMD64) || defined(__SSE2__)
+    #define SWB_SSE2
+#endif
+#if defined(__AVX__) || defined(__SSSE3__)
+    #define SWB_SSSE3
+#endif
+#if defined(__AVX2__)
+    #define SWB_AVX2
+#endif
+
+#ifdef SWB_SSE2
+    #include <immintrin.h>
+#endif
 
 #ifdef _WIN32
+    #define NOMINMAX
     #include <Windows.h>
 
     #define	HInstance() GetModuleHandle(NULL)
+#else
+    #include <termios.h>
+    #include <unistd.h>
+    #include <poll.h>
+    #include <fcntl.h>
+    #include <limits.h>
+    #include <sys/socket.h>
+    #include <sys/un.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
 #endif // _WIN64
+
+// Annotation of parameters, Windows headers define it already
+#ifndef IN
+    #define IN
+#endif